@@ -0,0 +1,101 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : BufferPool.cpp
+// Product : PubSubx
+// Brief   : Pool of size class message buffers with intrusive reference counts
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "BufferPool.hpp"
+
+#include <new>
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+BufferPool::~BufferPool() {
+    for (FreeList& l_list : m_free) {
+        while (l_list.head) {
+            MsgBuffer* l_buf = l_list.head;
+            l_list.head = l_buf->next;
+            destroy(l_buf);
+        }
+    }
+}
+
+
+/******************************************************************************/
+/**********************          POOL FUNCTIONS          **********************/
+/******************************************************************************/
+BufRef BufferPool::get(size_t capacity) {
+
+    // Smallest power of two class that fits, POOL_CLASSES if none does
+    uint8_t l_cls = 0;
+    if (capacity > ((size_t)1 << POOL_MIN_SHIFT)) {
+        l_cls = (64 - __builtin_clzll(capacity - 1)) - POOL_MIN_SHIFT;
+    }
+
+    MsgBuffer* l_buf = nullptr;
+    if (l_cls < POOL_CLASSES) {
+        FreeList& l_list = m_free[l_cls];
+        std::lock_guard<std::mutex> l_lock(l_list.lock);
+        if (l_list.head) {
+            l_buf = l_list.head;
+            l_list.head = l_buf->next;
+            l_list.count--;
+        }
+        capacity = (size_t)1 << (l_cls + POOL_MIN_SHIFT);
+    }
+    else {
+        l_cls = POOL_CLASSES;
+    }
+
+    if (!l_buf) {
+        void* l_mem = ::operator new(sizeof(MsgBuffer) + capacity);
+        l_buf = new (l_mem) MsgBuffer();
+        l_buf->capacity = capacity;
+        l_buf->cls = l_cls;
+        l_buf->pool = this;
+        m_heap_allocs++;
+        m_heap_bytes += capacity;
+    }
+
+    l_buf->refs.store(1, std::memory_order_relaxed);
+    l_buf->size = 0;
+    l_buf->next = nullptr;
+    m_in_use++;
+    return BufRef(l_buf);
+}
+
+void BufferPool::release(MsgBuffer* buf) {
+
+    m_in_use--;
+    if (buf->cls < POOL_CLASSES) {
+        FreeList& l_list = m_free[buf->cls];
+        std::lock_guard<std::mutex> l_lock(l_list.lock);
+        if (l_list.count < POOL_MAX_FREE) {
+            buf->next = l_list.head;
+            l_list.head = buf;
+            l_list.count++;
+            return;
+        }
+    }
+    destroy(buf);
+}
+
+void BufferPool::destroy(MsgBuffer* buf) {
+    m_heap_bytes -= buf->capacity;
+    buf->~MsgBuffer();
+    ::operator delete(buf);
+}
@@ -0,0 +1,140 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : BufferPool.hpp
+// Product : PubSubx
+// Brief   : Pool of size class message buffers with intrusive reference counts
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_BUFFER_POOL_H
+#define PUBSUBX_BUFFER_POOL_H
+
+#include <string_view>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define POOL_MIN_SHIFT 7        // Smallest size class holds 128 bytes
+#define POOL_CLASSES 8          // Classes 128 B .. 16 KB, larger buffers are not pooled
+#define POOL_MAX_FREE 4096      // Free buffers kept per class, the rest goes back to the heap
+
+class BufferPool;
+
+// Header placed in front of the data of every buffer
+struct MsgBuffer {
+    std::atomic<uint32_t> refs;
+    uint32_t    size;           // Bytes of data in use
+    uint32_t    capacity;       // Bytes of data available
+    uint8_t     cls;            // Size class, POOL_CLASSES for unpooled buffers
+    MsgBuffer*  next;           // Free list link
+    BufferPool* pool;
+
+    char* data(void) { return reinterpret_cast<char*>(this + 1); }
+};
+
+
+/******************************************************************************/
+/************************          BUFREF CLASS          **********************/
+/******************************************************************************/
+// Counted handle of a pooled buffer, the last handle returns the buffer to
+// its pool. Copies share the buffer, moves leave an empty handle behind.
+class BufRef {
+
+public:
+    BufRef() = default;
+    explicit BufRef(MsgBuffer* buf) : m_buf(buf) {}     // Adopts one reference
+    BufRef(const BufRef& other) : m_buf(other.m_buf) {
+        if (m_buf) { m_buf->refs.fetch_add(1, std::memory_order_relaxed); }
+    }
+    BufRef(BufRef&& other) noexcept : m_buf(std::exchange(other.m_buf, nullptr)) {}
+    BufRef& operator=(BufRef other) noexcept {
+        std::swap(m_buf, other.m_buf);
+        return *this;
+    }
+    ~BufRef() { reset(); }
+
+    void reset(void);
+
+    explicit operator bool(void) const { return m_buf != nullptr; }
+    char*    data(void) const { return m_buf->data(); }
+    size_t   size(void) const { return m_buf ? m_buf->size : 0; }
+    size_t   capacity(void) const { return m_buf ? m_buf->capacity : 0; }
+    void     set_size(size_t size) { m_buf->size = size; }
+    uint32_t use_count(void) const { return m_buf ? m_buf->refs.load(std::memory_order_relaxed) : 0; }
+    std::string_view view(void) const { return m_buf ? std::string_view(m_buf->data(), m_buf->size) : std::string_view(); }
+
+private:
+    MsgBuffer* m_buf = nullptr;
+};
+
+
+/******************************************************************************/
+/**********************          BUFFER POOL CLASS          *******************/
+/******************************************************************************/
+// Power of two size classes, each with its own locked free list, so buffers
+// taken on API threads can be returned from the socket thread. Once the free
+// lists are warm, get() and the last release do no heap allocation. The pool
+// must outlive every buffer taken from it.
+class BufferPool {
+
+public:
+    BufferPool() = default;
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Buffer with at least capacity bytes and size 0
+    BufRef get(size_t capacity);
+
+    // Statistics
+    uint64_t heap_allocs(void) const { return m_heap_allocs; }  // Buffers taken from the heap
+    uint64_t in_use(void) const { return m_in_use; }            // Buffers handed out and not returned
+    uint64_t heap_bytes(void) const { return m_heap_bytes; }    // Bytes held, free lists included
+
+private:
+    friend class BufRef;
+
+    struct alignas(64) FreeList {
+        std::mutex lock;
+        MsgBuffer* head = nullptr;
+        size_t     count = 0;
+    };
+
+    FreeList m_free[POOL_CLASSES];
+    std::atomic<uint64_t> m_heap_allocs{ 0 };
+    std::atomic<uint64_t> m_in_use{ 0 };
+    std::atomic<uint64_t> m_heap_bytes{ 0 };
+
+    void release(MsgBuffer* buf);
+    void destroy(MsgBuffer* buf);
+};
+
+inline void BufRef::reset(void) {
+    if (m_buf && m_buf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_buf->pool->release(m_buf);
+    }
+    m_buf = nullptr;
+}
+
+#endif
@@ -0,0 +1,345 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Cli.cpp
+// Product : PubSubx
+// Brief   : Command line interface built on top of the pubsubx library
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Cli.hpp"
+
+
+/******************************************************************************/
+/********************          HELPER FUNCTIONS          **********************/
+/******************************************************************************/
+/* Function to split vector by delimiter into a vector of strings*/
+vector<string> split(const string& s, const string& delim, const bool keep_empty) {
+    vector<string> result;
+    if (delim.empty()) {
+        result.push_back(s);
+        return result;
+    }
+    string::const_iterator substart = s.begin(), subend;
+    while (true) {
+        subend = search(substart, s.end(), delim.begin(), delim.end());
+        string temp(substart, subend);
+        if (keep_empty || !temp.empty()) {
+            result.push_back(temp);
+        }
+        if (subend == s.end()) {
+            break;
+        }
+        substart = subend + delim.size();
+    }
+    return result;
+}
+void toUpper(string* input) {
+    std::for_each(input->begin(), input->end(), [](char& c) {
+        c = ::toupper(c);
+        });
+}
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+Cli::Cli(Client& client, bool interactive, chrono::milliseconds flush_interval)
+    :m_client(client),
+    m_endpoint(client.endpoint()),
+    m_interactive(interactive),
+    m_sink(STDOUT_FILENO, flush_interval)
+{
+    // Messages on topics restored by the server are printed as well
+    m_client.set_default_handler([this](string_view topic, span<const byte> payload) {
+        print_message(topic, payload);
+    });
+    m_client.set_batch_handler([this]() {
+        print_prompt();
+    });
+
+    // Socket thread and command loop print through the same sink
+    m_client.set_log_handler([this](bool is_error, const string& text) {
+        m_sink.write({ text, "\n" }, m_interactive);
+    });
+}
+
+
+Cli::~Cli() {
+    m_client.disconnect();
+    m_client.set_default_handler(nullptr);
+    m_client.set_batch_handler(nullptr);
+    m_client.set_log_handler(nullptr);
+}
+
+
+/******************************************************************************/
+/*********************          PRINT FUNCTIONS          **********************/
+/******************************************************************************/
+void Cli::print_help(void) {
+    m_sink.write({
+        "client - list of possible client commands:\n"
+        "CONNECT <port> <client_name>    : connect to PubSubX server at specified port with client name\n"
+        "CONNECT <endpoint> <client_name>: connect to tcp://host:port, unix:///path.sock or shm:///path.sock with client name\n"
+        "DISCONNECT                      : disconect from to PubSubX server, all subscriptions will be removed\n"
+        "PUBLISH <topic_name> <message>  : publish message to topic on PubSubX server\n"
+        "SUBSCRIBE <topic>               : subscribe client to a topic on a PubSubX server, + and # wildcards allowed\n"
+        "UNSUBSCRIBE <topic_name>        : remove subscription from a topic on PubSubX server\n"
+        "STATS                           : print client counters and latency histograms\n" });
+}
+
+void Cli::print_message(string_view topic, span<const byte> payload) {
+
+    // Start received messages on a new line, the prompt is already printed
+    string_view l_lead = m_interactive && !m_in_batch.exchange(true) ? "\n" : "";
+
+    // Record is copied once into the sink ring, no temporary string
+    m_sink.write({ l_lead, "Topic: ", topic, " Data: ",
+        string_view((const char*)payload.data(), payload.size()), "\n" });
+}
+
+void Cli::print_prompt(void) {
+    if (!m_interactive) {
+        return;
+    }
+    m_in_batch = false;
+    m_sink.write({ PROMPT }, true);
+}
+
+
+/******************************************************************************/
+/*******************          COMMANDS FUNCTIONS          ********************/
+/******************************************************************************/
+bool Cli::command_parse(string_view input) {
+
+    // Words are separated by runs of spaces, members keep their capacity between commands
+    string_view l_rest = input;
+    auto l_next_word = [&l_rest](string& word) {
+        size_t l_start = l_rest.find_first_not_of(' ');
+        l_rest = l_start == string_view::npos ? string_view() : l_rest.substr(l_start);
+        size_t l_end = l_rest.find(' ');
+        word.assign(l_rest.substr(0, l_end));
+        l_rest = l_end == string_view::npos ? string_view() : l_rest.substr(l_end);
+    };
+
+    l_next_word(m_command);
+    toUpper(&m_command);
+
+    // Check if command is in commands vector
+    if (find(commands.begin(), commands.end(), m_command) == commands.end()) {
+        return false;
+    }
+
+    // Missing arguments are left empty
+    l_next_word(m_arg1);
+    l_next_word(m_arg2);
+
+    return true;
+}
+
+void Cli::command_process(void) {
+
+    if (m_command == "DISCONNECT") {
+        command_disconnect();
+    }
+    else if (m_command == "PUBLISH") {
+        command_publish();
+    }
+    else if (m_command == "SUBSCRIBE") {
+        command_subscribe();
+    }
+    else if (m_command == "UNSUBSCRIBE") {
+        command_unsubscribe();
+    }
+    else {
+        cout << "Error in command process";
+        assert(0);
+    }
+}
+
+void Cli::command_connect(void) {
+
+    // Endpoint with a scheme replaces the one of the client
+    if (m_arg1.find("://") != string::npos) {
+        if (m_client.set_endpoint(m_arg1)) {
+            m_client.connect(0, m_arg2);
+        }
+        return;
+    }
+
+    // Check if first argument-> port is adequate number
+    if (m_arg1 == "" || m_arg1.size() > 5 || m_arg1.find_first_not_of("0123456789") != string::npos) {
+        m_client.print_error(WRONG_PORT);
+        return;
+    }
+
+    m_client.set_endpoint(m_endpoint);
+    m_client.connect(stoi(m_arg1), m_arg2);
+}
+
+void Cli::command_disconnect(void) {
+    m_client.disconnect();
+}
+
+void Cli::command_publish(void) {
+    m_client.publish(m_arg1, m_arg2);
+}
+
+void Cli::command_subscribe(void) {
+    m_client.subscribe(m_arg1, [this](string_view topic, span<const byte> payload) {
+        print_message(topic, payload);
+    });
+}
+
+void Cli::command_unsubscribe(void) {
+    m_client.unsubscribe(m_arg1);
+}
+
+void Cli::command_stats(void) {
+    OutboundState l_out = m_client.outbound_state();
+    string l_text = Metrics::format(m_client.stats());
+    l_text += "outbound_messages     " + to_string(l_out.messages) + "\n";
+    l_text += "outbound_memory       " + to_string(l_out.memory) + "\n";
+    l_text += "congested             " + string(l_out.congested ? "yes" : "no") + "\n";
+    m_sink.write({ l_text }, m_interactive);
+}
+
+
+
+void Cli::command_line(string_view input) {
+
+    // Blank lines (and line ends of files edited on Windows) are ignored
+    if (!input.empty() && input.back() == '\r') {
+        input.remove_suffix(1);
+    }
+    if (input.find_first_not_of(' ') == string_view::npos) {
+        return;
+    }
+
+    if (!command_parse(input)) {
+        m_client.print_error(WRONG_CMD);
+        return;
+    }
+
+    if (m_command == "-H") {
+        print_help();
+        return;
+    }
+
+    // Statistics are kept across connections
+    if (m_command == "STATS") {
+        command_stats();
+        return;
+    }
+
+    // Commands entered while reconnecting are queued for the new connection
+    if (!m_client.connected() && !m_client.reconnecting()) {
+        if (m_command == "CONNECT") {
+            command_connect();
+        }
+        // Spool takes publishes until the next CONNECT
+        else if (m_command == "PUBLISH" && m_client.spooling()) {
+            command_publish();
+        }
+        else {
+            m_client.print_error(NOT_CONN);
+        }
+    }
+    else {
+        if (m_command == "CONNECT") {
+            m_client.print_info(ALR_CONN);
+        }
+        else {
+            command_process();
+        }
+    }
+}
+
+void Cli::command_loop(void) {
+
+    string input;
+
+    // The main loop
+    while (1) {
+
+        print_prompt();
+
+        // End of input (closed terminal or pipe) ends the loop
+        if (!getline(std::cin, input)) {
+            break;
+        }
+
+        command_line(input);
+    }
+}
+
+void Cli::command_batch(int fd) {
+
+    vector<char> l_block(BATCH_BLOCK_SIZE);
+    size_t   l_carry = 0;           // Bytes of an incomplete line kept from previous block
+    uint64_t l_lines = 0, l_bytes = 0;
+    bool     l_eof = false;
+
+    MetricsSnapshot l_before = m_client.stats();
+    auto l_start = chrono::steady_clock::now();
+
+    while (!l_eof) {
+        ssize_t l_size = read(fd, l_block.data() + l_carry, l_block.size() - l_carry);
+        if (l_size < 0 && errno == EINTR) { continue; }
+        l_eof = l_size <= 0;
+        l_size = max<ssize_t>(l_size, 0);
+        l_bytes += l_size;
+
+        // Every complete line of the block, last line of input may lack its newline
+        string_view l_data(l_block.data(), l_carry + l_size);
+        size_t l_pos = 0;
+        m_client.cork();
+        while (l_pos < l_data.size()) {
+            size_t l_end = l_data.find('\n', l_pos);
+            if (l_end == string_view::npos) {
+                if (!l_eof) { break; }
+                l_end = l_data.size();
+            }
+            command_line(l_data.substr(l_pos, l_end - l_pos));
+            l_lines++;
+            l_pos = l_end + 1;
+        }
+        m_client.uncork();
+
+        l_pos = min(l_pos, l_data.size());
+        l_carry = l_data.size() - l_pos;
+        memmove(l_block.data(), l_block.data() + l_pos, l_carry);
+
+        // Line longer than the block
+        if (l_carry == l_block.size()) {
+            l_block.resize(l_block.size() * 2);
+        }
+    }
+
+    // Throughput counts until everything queued is written to the server
+    while ((m_client.connected() || m_client.reconnecting()) && m_client.outbound_state().messages > 0) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    double l_seconds = chrono::duration<double>(chrono::steady_clock::now() - l_start).count();
+    MetricsSnapshot l_after = m_client.stats();
+    uint64_t l_published = l_after.counters[CNT_PUBLISH] - l_before.counters[CNT_PUBLISH];
+    uint64_t l_errors = l_after.counters[CNT_ERRORS] - l_before.counters[CNT_ERRORS];
+
+    // Summary goes to stderr, stdout carries only received messages
+    m_sink.flush();
+    ostringstream l_out;
+    l_out << fixed << setprecision(3) << "Batch: " << l_lines << " lines, " << l_bytes << " bytes in "
+        << l_seconds << " s, " << l_published << " published (" << setprecision(0)
+        << l_published / max(l_seconds, 1e-9) << " msg/s, " << setprecision(1)
+        << l_bytes / max(l_seconds, 1e-9) / 1e6 << " MB/s), " << l_errors << " errors\n";
+    cerr << l_out.str();
+}
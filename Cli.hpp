@@ -0,0 +1,98 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Cli.hpp
+// Product : PubSubx
+// Brief   : Command line interface built on top of the pubsubx library
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_CLI_H
+#define PUBSUBX_CLI_H
+
+#include "Client.hpp"
+#include "OutputSink.hpp"
+
+#include <unistd.h>
+#include <sstream>
+#include <iomanip>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define PROMPT "Enter command or (-h): "
+#define BATCH_BLOCK_SIZE ((1) << (20))  // Bytes read at once in batch mode
+
+const vector<string> commands = { "-H", "CONNECT", "DISCONNECT", "PUBLISH", "SUBSCRIBE", "UNSUBSCRIBE", "STATS" };
+
+// Helper functions
+vector<string> split(const string& s, const string& delim, const bool keep_empty = false);
+void toUpper(string* input);
+
+
+/******************************************************************************/
+/************************          CLI CLASS           ************************/
+/******************************************************************************/
+class Cli {
+
+public:
+    // Creator
+    // Non interactive output (pipe, file) skips prompts and flushes only every interval
+    Cli(Client& client, bool interactive = true, chrono::milliseconds flush_interval = chrono::milliseconds(SINK_FLUSH_MS));
+    ~Cli();                         // Disconnects, handlers of the client point into this object
+
+    // Main command loop
+    void command_loop(void);
+
+    // Batch mode, commands are read from fd in large blocks until end of input, then a
+    // throughput summary is printed to stderr
+    void command_batch(int fd);
+
+    // Parse one input line into command and arguments, false if command is unknown
+    bool command_parse(string_view input);
+
+private:
+
+    Client& m_client;
+    string  m_endpoint;             // Endpoint of the client when created, CONNECT <port> goes there
+
+    // Command data
+    string m_command;               // Input command
+    string m_arg1;                  // Input argument 1
+    string m_arg2;                  // Input argument 2
+
+    bool   m_interactive;           // Prompt is redrawn after every batch of messages
+    atomic<bool> m_in_batch = false;// Received messages printed since last prompt
+    OutputSink m_sink;              // All output of both threads, written by the sink thread
+
+    // Print functions
+    void print_help(void);
+    void print_message(string_view topic, span<const byte> payload);
+    void print_prompt(void);
+
+    // Command functions
+    void command_line(string_view input);   // Parse and execute one input line
+    void command_process(void);
+    void command_connect(void);
+    void command_disconnect(void);
+    void command_publish(void);
+    void command_subscribe(void);
+    void command_unsubscribe(void);
+    void command_stats(void);
+};
+
+#endif
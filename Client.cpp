@@ -19,59 +19,16 @@
 #include "Client.hpp"
 
 
-/******************************************************************************/
-/********************          HELPER FUNCTIONS          **********************/
-/******************************************************************************/
-/* Function to split vector by delimiter into a vector of strings*/
-vector<string> split(const string& s, const string& delim, const bool keep_empty = false) {
-    vector<string> result;
-    if (delim.empty()) {
-        result.push_back(s);
-        return result;
-    }
-    string::const_iterator substart = s.begin(), subend;
-    while (true) {
-        subend = search(substart, s.end(), delim.begin(), delim.end());
-        string temp(substart, subend);
-        if (keep_empty || !temp.empty()) {
-            result.push_back(temp);
-        }
-        if (subend == s.end()) {
-            break;
-        }
-        substart = subend + delim.size();
-    }
-    return result;
-}
-string toUpper(string* input) {
-    std::for_each(input->begin(), input->end(), [](char& c) {
-        c = ::toupper(c);
-        });
-}
-
-inline bool ends_with(std::string const& value, std::string const& ending)
-{
-    if (ending.size() > value.size()) return false;
-    return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
-}
-
-
-
 /******************************************************************************/
 /*********************          ERROR FUNCTIONS          **********************/
 /******************************************************************************/
-enum errors_enum {
-    INIT_FAIL, WRONG_PORT, WRONG_NAME, NAME_TAKEN, CONN_FAIL, SEL_FAIL,
-    MSG_TOO_LONG, CONN_LOST, CONN_DOWN, NOT_CONN, WRONG_TOPIC,
-    EMPTY_TOPIC, WRONG_CMD, NO_RSP, UNKNOWN_RSP, EXCEPTION, MAX_ERRORS
-};
-
 static string errors[] = {
     [INIT_FAIL] = "Initialization of local sockets has failed",
     [WRONG_PORT] = "Server port number is wrong, must be integer in range 1024 < port < 32000",
     [WRONG_NAME] = "Client name is empty/too long, must be between 1 and 64 characters",
     [NAME_TAKEN] = "Client name is alreaday taken, please enter other name",
     [CONN_FAIL] = "Connection to the server has failed, please check port and try again",
+    [WRONG_HOST] = "Server host name can not be resolved: ",
     [SEL_FAIL] = "Select function has failed",
     [MSG_TOO_LONG] = "Received/(trying to send) message that is too long",
     [CONN_LOST] = "Client lost connection to the server try to reconnect ",
@@ -79,14 +36,13 @@ static string errors[] = {
     [NOT_CONN] = "Client is not connected, only CONNECT command is accepted ",
     [WRONG_TOPIC] = "Client received message on a topic he is not subscribed to ",
     [EMPTY_TOPIC] = "Trying to publish/subscribe/unsubscribe to an empty topic",
+    [BAD_TOPIC] = "Wildcards + and # must fill a whole topic level and # must be the last level: ",
     [WRONG_CMD] = "Wrong command is entered, to see help enter -h",
     [NO_RSP] = "No response from server: ",
     [UNKNOWN_RSP] = "Unknown response from server: ",
-    [EXCEPTION] = "Exception occured: "
-};
-
-enum infos_enum {
-    CONN_ACC, ALR_CONN, ALR_SUB, NOT_SUB, CONN_RESTORED, MAX_INFOS
+    [EXCEPTION] = "Exception occured: ",
+    [RECONN_FAIL] = "Reconnect attempts are exhausted, connect again",
+    [CONN_TIMEOUT] = "Connection to the server timed out in phase: "
 };
 
 static string infos[] = {
@@ -95,19 +51,26 @@ static string infos[] = {
     [ALR_SUB] = "Already subscribed to topic:",
     [NOT_SUB] = "Was not subscribed to topic:",
     [CONN_RESTORED] = "Connection restored",
+    [NO_REACTOR] = "Requested event loop backend is unavailable, using select",
+    [SEND_STATS] = "Sent",
+    [RECONNECTING] = "Connection lost, reconnecting in",
+    [NO_LINK] = "Server did not take the shared memory link, using its socket",
 };
 
-void Client::print_help(void) {
-    cout << "client - list of possible client commands:\n";
-    cout << "CONNECT <port> <client_name>    : connect to PubSubX server at specified port with client name\n";
-    cout << "DISCONNECT                      : disconect from to PubSubX server, all subscriptions will be removed\n";
-    cout << "PUBLISH <topic_name> <message>  : publish message to topic on PubSubX server\n";
-    cout << "SUBSCRIBE <topic>               : subscribe client to a topic on a PubSubX server\n";
-    cout << "UNSUBSCRIBE <topic_name>        : remove subscription from a topic on PubSubX server\n";
-}
-
 void Client::print_error(uint16_t errnum, string msg) {
     assert(errnum < MAX_ERRORS&& errors[errnum] != "");
+
+    m_metrics.add(CNT_ERRORS);
+    if (errnum == WRONG_TOPIC) {
+        m_metrics.add(CNT_WRONG_TOPIC);
+    }
+    else if (errnum == UNKNOWN_RSP || errnum == MSG_TOO_LONG) {
+        m_metrics.add(CNT_FRAMING_ERRORS);
+    }
+    if (m_log_handler) {
+        m_log_handler(true, "ERROR: " + errors[errnum] + msg);
+        return;
+    }
     cout << "ERROR: " + errors[errnum] + msg + "\n";
     cout.flush();
 }
@@ -115,6 +78,10 @@ void Client::print_error(uint16_t errnum, string msg) {
 
 void Client::print_info(uint16_t infonum, string msg) {
     assert(infonum < MAX_INFOS&& infos[infonum] != "");
+    if (m_log_handler) {
+        m_log_handler(false, "INFO: " + infos[infonum] + msg);
+        return;
+    }
     cout << "INFO: " + infos[infonum] + msg + "\n";
     cout.flush();
 }
@@ -123,13 +90,37 @@ void Client::print_info(uint16_t infonum, string msg) {
 /******************************************************************************/
 /*************************          CREATOR          **************************/
 /******************************************************************************/
-Client::Client(string server_name)
-    :m_server_name(server_name)
+Client::Client(string server_name, reactor_type_enum reactor)
+    :m_cmd_queue(CMD_QUEUE_SIZE)
 {
-    /* Initialize all the local sockets */
-    //socket_server_init();
-    socket_listen_init();
-    socket_inter_init();
+    /* Malformed endpoint is reported, connect then fails on the empty host */
+    if (!m_endpoint.parse(server_name)) {
+        print_error(WRONG_HOST, server_name);
+    }
+
+    /* Inter-thread channel needs only the eventfd */
+    if (m_notifier.fd() < 0) {
+        print_error(INIT_FAIL);
+        exit(0);
+    }
+
+    /* Event loop backend, fall back to select if requested one is unavailable */
+    m_reactor = Reactor::create(reactor);
+    if (!m_reactor) {
+        print_info(NO_REACTOR);
+        m_reactor = Reactor::create(REACTOR_SELECT);
+    }
+}
+
+Client::~Client() {
+
+    disconnect();
+    if (m_socket_thread.joinable()) {
+        m_socket_thread.join();
+    }
+
+    // Workers finish what is queued while the rest of the client is still alive
+    m_dispatcher.reset();
 }
 
 
@@ -137,23 +128,60 @@ Client::Client(string server_name)
 /******************************************************************************/
 /********************          CONNECT FUNCTIONS          *********************/
 /******************************************************************************/
-bool Client::connect_args_check() {
+bool Client::connect(int port, const string& name) {
+    return connect_async(port, name).get();
+}
 
-    // Check if first argument-> port is adequate number
-    if (!(m_arg1.find_first_not_of("0123456789") == string::npos)) {
-        print_error(WRONG_PORT);
+future<bool> Client::connect_async(int port, const string& name) {
+
+    auto l_promise = make_shared<promise<bool>>();
+    future<bool> l_future = l_promise->get_future();
+    connect_async(port, name, [l_promise](bool connected) {
+        l_promise->set_value(connected);
+    });
+    return l_future;
+}
+
+void Client::connect_async(int port, const string& name, ConnectHandler handler) {
+
+    bool l_started = false;
+    {
+        auto l_lock = api_lock();
+
+        // Socket thread can not wait for itself, not even from the connect handler
+        if (m_connected || m_reconnecting || m_connecting || on_socket_thread()) {
+            print_info(ALR_CONN);
+        }
+        else {
+            // Socket thread of previous connection has already released everything
+            if (m_socket_thread.joinable()) {
+                m_socket_thread.join();
+            }
+            l_started = connect_server(port, name, handler);
+        }
+    }
+
+    // Refused before the socket thread started, handler runs on the caller
+    if (!l_started && handler) {
+        handler(false);
+    }
+}
+
+bool Client::connect_args_check(int port, const string& name) {
+
+    if (m_endpoint.type() == ENDPOINT_TCP && m_endpoint.host() == "") {
+        print_error(WRONG_HOST);
         return false;
     }
 
-    // Check if port is in adequater range
-    int l_port = stoi(m_arg1);
-    if (l_port < 1024 || l_port > 65535) {
+    // Check if port is in adequater range, unix sockets have none
+    if (m_endpoint.type() == ENDPOINT_TCP && (port < 1024 || port > 65535)) {
         print_error(WRONG_PORT);
         return false;
     }
 
-    // Check if second argument-> name is adequate
-    if (m_arg2 == "" || (m_arg2.length() > MAX_NAME_LEN)) {
+    // Check if name is adequate
+    if (name == "" || (name.length() > MAX_NAME_LEN)) {
         print_error(WRONG_NAME);
         return false;
     }
@@ -161,655 +189,1763 @@ bool Client::connect_args_check() {
     return true;
 }
 
-void Client::connect_server() {
+bool Client::connect_server(int port, const string& name, ConnectHandler& handler) {
 
     // Before any other steps check input arguments
-    if (!connect_args_check()) { return; }
+    port = m_endpoint.port() ? m_endpoint.port() : port;
+    if (!connect_args_check(port, name)) { return false; }
+
+    m_server_port = port;
+    m_name = name;
+
+    // Batch left open by a lost connection may use IDs of that connection
+    {
+        lock_guard<mutex> l_lock(m_producer_mutex);
+        m_batch.reset();
+        m_batch_deadline = 0;
+        m_batch_due = false;
+        m_batch_bytes = 0;
+    }
+
+    // Address, connect and handshake are done by the socket thread within its deadlines
+    m_connecting = true;
+    m_connect_handler = std::move(handler);
+    m_socket_thread = thread(&Client::socket_loop, this);
+    return true;
+}
+
+bool Client::connect_open(bool reconnect) {
 
+    // Name resolution blocks the socket thread, it is timed as a phase of its own and
+    // done once, the addresses are kept until all of them failed
+    if (!m_endpoint.resolved()) {
+        uint64_t l_start = Metrics::now_ns();
+        if (!m_endpoint.resolve(m_server_port)) {
+            if (!reconnect) { print_error(WRONG_HOST, m_endpoint.uri()); }
+            return false;
+        }
+        m_metrics.record(HIST_RESOLVE_NS, Metrics::now_ns() - l_start);
+    }
     socket_server_init();
 
-    // Update connection address structure
-    m_server_addr.sin_port = htons(stoi(m_arg1));
+    // Nonblocking connect completes when the socket becomes writable, a unix socket may refuse at once
+    const EndpointAddress& l_address = m_endpoint.address();
+    if (::connect(m_server_socket, (const struct sockaddr*)&l_address.addr, l_address.len) < 0 && errno != EINPROGRESS) {
+        if (!reconnect) { print_error(CONN_FAIL); }
+        close(m_server_socket);
+        return false;
+    }
+    return true;
+}
 
-    // Try to establish connection
-    if (connect(m_server_socket, (struct sockaddr*)&m_server_addr, sizeof(m_server_addr)) < 0) {
-        print_error(CONN_FAIL);
-        return;
+int Client::connect_setup(uint64_t deadline, bool reconnect) {
+
+    uint64_t l_start = Metrics::now_ns();
+    uint64_t l_connect_ns = chrono::duration_cast<chrono::nanoseconds>(m_timeouts.connect).count();
+    uint64_t l_handshake_ns = chrono::duration_cast<chrono::nanoseconds>(m_timeouts.handshake).count();
+    uint16_t l_error = CONN_TIMEOUT;
+    string   l_phase = "connect";
+
+    // Connect phase ends when the socket is writable
+    m_reactor->add(m_server_socket, true);
+    int l_result = setup_wait(m_server_socket, min(deadline, l_start + l_connect_ns));
+
+    int l_so_error = 0;
+    socklen_t l_len = sizeof(l_so_error);
+    if (l_result > 0 && (getsockopt(m_server_socket, SOL_SOCKET, SO_ERROR, &l_so_error, &l_len) != 0 || l_so_error != 0)) {
+        l_result = 0;
+        l_error = CONN_FAIL;
     }
 
-    // Send and receive message
-    int l_valread;
-    char l_buffer[BUFFER_SIZE] = { 0 };
-    static string l_conn_msg;
-    l_conn_msg = "CONNECT " + m_arg2 + EOM;
+    // Handshake phase, CONNECT fits the empty socket buffer
+    if (l_result > 0) {
+        uint64_t l_now = Metrics::now_ns();
+        m_metrics.record(HIST_CONNECT_NS, l_now - l_start);
+        l_start = l_now;
+        l_phase = "handshake";
 
-    // Send connection message
-    if (send(m_server_socket, l_conn_msg.c_str(), l_conn_msg.length(), 0) != l_conn_msg.length()) {
-        print_error(CONN_FAIL);
-        shutdown(m_server_socket, SHUT_RDWR);
-        close(m_server_socket);
-        return;
+        // Shared memory link goes along with CONNECT, the reply tells if the server took it
+        if (m_endpoint.type() == ENDPOINT_SHM) {
+            m_link = ShmLink::create();
+        }
+        string l_conn_msg = connect_request(m_name);
+        bool l_sent = m_link ? m_link->offer(m_server_socket, l_conn_msg)
+            : send(m_server_socket, l_conn_msg.c_str(), l_conn_msg.length(), MSG_NOSIGNAL) == (ssize_t)l_conn_msg.length();
+        if (!l_sent) {
+            l_result = 0;
+            l_error = CONN_FAIL;
+        }
+        m_reactor->modify(m_server_socket, false);
+    }
+
+    // Reply is read as it arrives, RESTORED is followed by the topic list
+    string l_reply;
+    char l_buffer[BUFFER_SIZE];
+    while (l_result > 0 && !connect_reply_complete(l_reply)) {
+        ssize_t l_size = recv(m_server_socket, l_buffer, BUFFER_SIZE, 0);
+        if (l_size > 0) {
+            l_reply.append(l_buffer, l_size);
+        }
+        else if (l_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            l_result = setup_wait(m_server_socket, min(deadline, l_start + l_handshake_ns));
+        }
+        else {
+            l_result = 0;
+            l_error = CONN_FAIL;
+        }
+    }
+    if (l_result > 0) {
+        m_metrics.record(HIST_HANDSHAKE_NS, Metrics::now_ns() - l_start);
     }
 
-    // Blocking read of response message
-    l_valread = read(m_server_socket, l_buffer, BUFFER_SIZE);
-    if (l_valread == 0 || l_valread == -1) {
-        print_error(CONN_FAIL);
+    // Refusal is reported by the handshake. On reconnect the name is still taken while the
+    // server has not noticed the lost connection, next attempt retries.
+    if (l_result > 0 && !connect_handshake(l_reply, reconnect)) {
+        l_result = 0;
+        l_error = MAX_ERRORS;
+    }
+    if (l_result <= 0) {
+        if (l_result == 0 && !reconnect && l_error != MAX_ERRORS) {
+            print_error(l_error, l_error == CONN_TIMEOUT ? l_phase : "");
+        }
+        m_link.reset();
+        m_reactor->remove(m_server_socket);
         shutdown(m_server_socket, SHUT_RDWR);
         close(m_server_socket);
-        return;
+        return l_result;
+    }
+
+    // Registered again like a new connection, so data already buffered is reported
+    m_reactor->remove(m_server_socket);
+    m_reactor->add(m_server_socket, false);
+
+    // Frames the server sent before the link was watched are read on the first wakeup
+    if (m_link) {
+        m_reactor->add(m_link->fd(), false);
+        m_link->kick();
+    }
+    m_writable = true;
+    m_want_write = false;
+    m_read_paused = false;
+    m_sender.rewind();
+    if (reconnect) {
+        reconnect_burst(l_reply.starts_with("RESTORED"));
+    }
+    return 1;
+}
+
+string Client::connect_request(const string& name) {
+
+    string l_conn_msg = "CONNECT " + name;
+
+    // Binary framing is only requested, server confirms it in the reply
+    if (m_framing_request == FRAMING_BINARY) {
+        l_conn_msg += " " BINARY_TAG " " TOPIC_IDS_TAG;
+        if (m_compress_request && compression_available()) {
+            l_conn_msg += " " COMPRESS_TAG;
+        }
+        if (m_batch_request.linger.count() > 0) {
+            l_conn_msg += " " BATCH_TAG;
+        }
+        l_conn_msg += " " SEQ_TAG;
+    }
+    if (m_link) {
+        l_conn_msg += " " SHM_TAG;
     }
+    l_conn_msg += EOM;
+    return l_conn_msg;
+}
+
+bool Client::connect_reply_complete(string_view reply) {
+
+    // Reply that can not end is complete as well, it is rejected as unknown
+    size_t l_end = reply.find(EOM);
+    if (l_end == string_view::npos) { return reply.size() > MAX_FRAME_SIZE; }
+    if (!reply.starts_with("RESTORED")) { return true; }
+    return reply.find(EOM, l_end + strlen(EOM)) != string_view::npos || reply.size() > MAX_FRAME_SIZE;
+}
+
+bool Client::connect_handshake(string_view reply, bool reconnect) {
+
+    // Options are confirmed on the first line of the reply
+    string_view l_options = reply.substr(0, reply.find(EOM));
 
     // Connection established
-    if (strncmp(l_buffer, "OK", strlen("OK")) == 0) {
+    if (l_options.starts_with("OK")) {
+        connect_framing(l_options.starts_with("OK " BINARY_TAG) ? FRAMING_BINARY : FRAMING_TEXT, l_options, reconnect);
+        m_last_seq.clear();
         connect_accept();
-        return;
+        return true;
     }
 
     // Connection reestablished
-    if (strncmp(l_buffer, "RESTORED", strlen("RESTORED")) == 0) {
-        connect_restore(l_buffer);
-        return;
+    if (l_options.starts_with("RESTORED")) {
+        connect_framing(l_options.starts_with("RESTORED " BINARY_TAG) ? FRAMING_BINARY : FRAMING_TEXT, l_options, reconnect);
+
+        // Server holds the session history until it knows what was already seen
+        if (m_seq && !resume_send()) {
+            print_error(CONN_FAIL);
+            return false;
+        }
+        connect_restore(reply.data(), reply.size());
+        return true;
     }
 
     // Name already taken
-    if (strncmp(l_buffer, "ERROR", strlen("ERROR")) == 0) {
+    if (l_options.starts_with("ERROR")) {
         print_error(NAME_TAKEN);
-        shutdown(m_server_socket, SHUT_RDWR);
-        close(m_server_socket);
-        return;
     }
     // Unknown error
     else {
         print_error(UNKNOWN_RSP);
-        shutdown(m_server_socket, SHUT_RDWR);
-        close(m_server_socket);
-        return;
+    }
+    return false;
+}
+
+void Client::connect_framing(framing_enum framing, string_view options, bool keep_ids) {
+
+    m_framing = framing;
+    bool l_binary = framing == FRAMING_BINARY;
+    m_topic_ids = l_binary && options.find(" " TOPIC_IDS_TAG) != string_view::npos;
+    m_compress = l_binary && options.find(" " COMPRESS_TAG) != string_view::npos;
+    m_seq = l_binary && options.find(" " SEQ_TAG) != string_view::npos;
+
+    // Server without the link keeps using its socket
+    if (m_link && options.find(" " SHM_TAG) == string_view::npos) {
+        print_info(NO_LINK);
+        m_link.reset();
+    }
+
+    // Bindings of a previous connection are gone, IDs are bound again on use. A reconnect
+    // proposes them again before anything queued, see reconnect_burst.
+    if (!keep_ids || !m_topic_ids) {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        m_topic_table.unbind_all();
+    }
+
+    m_batching = l_binary && options.find(" " BATCH_TAG) != string_view::npos;
+    m_linger_ns = chrono::duration_cast<chrono::nanoseconds>(m_batch_request.linger).count();
+    m_batch_max_bytes = m_batch_request.max_bytes;
+    m_batch_max_messages = max<size_t>(m_batch_request.max_messages, 1);
+
+    // Binary frames carry their length, so they are neither fragmented nor terminated
+    if (framing == FRAMING_BINARY) {
+        m_sender.configure("", 0);
+    }
+    else {
+        m_sender.configure(EOM, BUFFER_SIZE - strlen(EOM));
     }
 }
 
+bool Client::resume_send(void) {
+
+    // Last seen sequence of every topic, an empty topic ends the list
+    string l_resume;
+    char l_seq[SEQ_SIZE];
+    for (const auto& [l_topic, l_last] : m_last_seq) {
+        encode_seq(l_seq, l_last);
+        l_resume += encode(OP_RESUME, l_topic, string_view(l_seq, SEQ_SIZE)).view();
+    }
+    l_resume += encode(OP_RESUME, "", "").view();
+
+    // Fits the empty socket buffer (or ring), like the CONNECT message
+    if (m_link) {
+        struct iovec l_iov = { l_resume.data(), l_resume.size() };
+        return m_link->sendmsg(&l_iov, 1) == (ssize_t)l_resume.size();
+    }
+    return send(m_server_socket, l_resume.data(), l_resume.size(), MSG_NOSIGNAL) == (ssize_t)l_resume.size();
+}
+
 void Client::connect_accept(void) {
 
     print_info(CONN_ACC);
 
     // Update atributes
-    m_server_port = stoi(m_arg1);
-    m_name = m_arg2;
     m_connected = true;
 
     // Initi receive stream
-    m_receive_stream = "";
-
-    // Start the socket thread    
-    m_socket_thread = thread(&Client::socket_loop, this);
-    m_socket_thread.detach();
+    m_framer.reset();
+    m_framer.set_framing(m_framing);
 }
 
-void Client::connect_restore(char* str) {
+void Client::connect_restore(const char* str, size_t size) {
 
     print_info(CONN_RESTORED);
 
     // Update atributes
-    m_server_port = stoi(m_arg1);
-    m_name = m_arg2;
     m_connected = true;
 
-    // Initi receive stream
-    m_receive_stream = "";
-
-    string l_message = str;
-
-    vector<string> l_msg_list = split(l_message, EOM);
-    // Second message has subscribed topics
-    if (l_msg_list.size() > 1) {
-        vector<string> l_topics_list = split(l_msg_list[1], " ");
-        int i;
-        for (i = 0; i < l_topics_list.size(); i++) {
-            m_topics.insert(l_topics_list[i]);
+    // Initi receive stream with the whole reply
+    m_framer.reset();
+    m_framer.append(str, size);
+
+    string_view l_frame;
+
+    // First message is the RESTORED reply, second has subscribed topics
+    if (m_framer.next(l_frame) && m_framer.next(l_frame)) {
+        size_t l_start = 0, l_end;
+        while (l_start < l_frame.size()) {
+            l_end = l_frame.find(' ', l_start);
+            if (l_end == string_view::npos) { l_end = l_frame.size(); }
+            if (l_end > l_start) {
+                m_topics.insert(l_frame.substr(l_start, l_end - l_start), m_default_handler);
+                m_topics_epoch++;
+            }
+            l_start = l_end + 1;
         }
+        m_metrics.set(GAUGE_SUBSCRIPTIONS, m_topics.size());
     }
 
     // All the other messages are missed messages on subscribed topics
-    if (l_msg_list.size() > 2) {
-        int l_prev_msg_size;
-        // Remove first 2 messages from string l_message
-        l_prev_msg_size = l_msg_list[0].length() + l_msg_list[1].length() + 2 * strlen(EOM);
-        l_message.erase(0, l_prev_msg_size);
-        // Send rest as normal message stream
-        process_message_chunk((char*)l_message.c_str(), l_message.size(), true);
-    }
-
-
-    // Start the socket thread
-    m_socket_thread = thread(&Client::socket_loop, this);
-    m_socket_thread.detach();
+    m_framer.set_framing(m_framing);
+    process_frames(true);
 }
 
 /******************************************************************************/
 /********************          SOCKET FUNCTIONS          **********************/
 /******************************************************************************/
-void Client::socket_server_init(void) {
+bool Client::socket_server_init(void) {
 
-    // Server socket and address setup
-    if ((m_server_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    // Family follows the resolved address, framing is the same over tcp and unix sockets
+    if ((m_server_socket = socket(m_endpoint.address().family, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
         print_error(INIT_FAIL);
         exit(0);
     }
-
-    // Currently only localhost support
-    if (inet_pton(AF_INET, "127.0.0.1", &m_server_addr.sin_addr) <= 0) {
-        print_error(INIT_FAIL);
-        exit(0);
-    }
-    m_server_addr.sin_family = AF_INET;
+    return true;
 }
 
 
-void Client::socket_listen_init(void) {
-
-    // Setup listening port for inter thread communication
-    struct sockaddr_in l_listen_addr;
+// Set for the lifetime of socket_loop, lets handlers bypass the ring
+static thread_local Client* t_socket_client = nullptr;
 
-    l_listen_addr.sin_family = AF_INET;
-    l_listen_addr.sin_addr.s_addr = INADDR_ANY;
-
-    int i, l_optval = 1;
+bool Client::on_socket_thread(void) const {
+    return t_socket_client == this;
+}
 
-    // Search for empty port and try to bind socket to it
-    for (i = 1024; i < 65535; i++) {
+unique_lock<recursive_mutex> Client::api_lock(void) {
+    uint64_t l_start = Metrics::now_ns();
+    unique_lock<recursive_mutex> l_lock(m_mutex);
+    m_metrics.record(HIST_LOCK_WAIT_NS, Metrics::now_ns() - l_start);
+    return l_lock;
+}
 
-        if ((m_listen_sock = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-            print_error(INIT_FAIL);
-            exit(0);
-        }
+void Client::command_send(OutMessage&& msg) {
 
-        if (setsockopt(m_listen_sock, SOL_SOCKET, SO_REUSEADDR, &l_optval, sizeof(l_optval)) == -1) {
-            print_error(INIT_FAIL);
-            exit(0);
+    // Handlers run on the socket thread, which cannot wait for its own ring
+    if (on_socket_thread()) {
+        if (msg.type == OUT_DISCONNECT) {
+            m_close_pending = true;
         }
-        l_listen_addr.sin_port = htons(i);
-
-        if (bind(m_listen_sock, (struct sockaddr*)&l_listen_addr, sizeof(l_listen_addr)) == 0) {
-            m_listen_port = i;
-            break; // Success
+        else {
+            m_sender.push(std::move(msg.buf), msg.droppable);
         }
-
-        // Failed to bind port, try again
-        close(m_listen_sock);
+        return;
     }
 
-    if (i == 65535) {
-        print_error(INIT_FAIL);
-        exit(0);
+    // Ring has a single producer, publishes lingering in the open batch go first
+    {
+        lock_guard<mutex> l_lock(m_producer_mutex);
+        if (m_batch) {
+            batch_close(true);
+        }
+        command_push(msg, true);
+        // Disconnect waits for the socket thread, it is never held back
+        if (!m_corked || msg.type == OUT_DISCONNECT) {
+            m_notifier.notify();
+        }
     }
-
-    // Start listening
-    listen(m_listen_sock, 5);
+    outbound_check();
 }
 
-void Client::socket_inter_init(void) {
+bool Client::command_push(OutMessage& msg, bool wait) {
 
-    struct sockaddr_in l_conn_addr;
-    struct sockaddr_storage l_claddr;
-    int addrlen = sizeof(struct sockaddr_storage);
+    // Accounted before the push, socket loop subtracts when it pops
+    size_t l_bytes = msg.buf.size();
+    m_ring_messages.fetch_add(1, memory_order_relaxed);
+    m_ring_bytes.fetch_add(l_bytes, memory_order_relaxed);
 
-    // Create output sockets
-    if ((m_msg_out_sock = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        print_error(INIT_FAIL);
-        exit(0);
-    }
-    if ((m_close_out_sock = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        print_error(INIT_FAIL);
-        exit(0);
+    // Wait for the socket loop while the ring is full, push leaves msg alone on failure
+    while (!m_cmd_queue.push(std::move(msg))) {
+        m_metrics.add(CNT_RING_FULL);
+        if (!wait) {
+            m_ring_messages.fetch_sub(1, memory_order_relaxed);
+            m_ring_bytes.fetch_sub(l_bytes, memory_order_relaxed);
+            return false;
+        }
+        m_notifier.force();
+        this_thread::yield();
     }
+    return true;
+}
 
-    // Local address setup
-    l_conn_addr.sin_family = AF_INET;
-    l_conn_addr.sin_port = htons(m_listen_port);
-    if (inet_pton(AF_INET, "127.0.0.1", &l_conn_addr.sin_addr) <= 0) {
-        print_error(INIT_FAIL);
-        exit(0);
+bool Client::batch_publish(uint16_t topic_id, string_view topic, string_view payload) {
+
+    size_t l_size = topic_id ? command_id_size(payload) : command_size(FRAMING_BINARY, OP_PUBLISH, topic, payload);
+    if (l_size > m_batch_max_bytes / 2) {
+        return false;
     }
 
-    // Set ouput sockets as nonblocking
-    fcntl(m_msg_out_sock, F_SETFL,  fcntl(m_listen_sock, F_GETFL, 0) | O_NONBLOCK);
-    fcntl(m_close_out_sock, F_SETFL, fcntl(m_listen_sock, F_GETFL, 0) | O_NONBLOCK);
+    {
+        lock_guard<mutex> l_lock(m_producer_mutex);
+        if (m_batch && (m_batch.size() + l_size > m_batch.capacity() || m_batch_records >= m_batch_max_messages
+            || m_batch_due.load(memory_order_relaxed))) {
+            batch_close(true);
+        }
 
-    // Creating connections
-    connect(m_msg_out_sock, (struct sockaddr*)&l_conn_addr, sizeof(l_conn_addr));
-    if ((m_msg_in_sock = accept(m_listen_sock, NULL, NULL)) == 0) {
-        print_error(INIT_FAIL);
-        exit(0);
-    }
+        // Header is reserved, the batch is framed when it is closed
+        bool l_opened = !m_batch;
+        if (l_opened) {
+            m_batch = m_pool.get(FRAME_HEADER_SIZE + m_batch_max_bytes);
+            m_batch.set_size(FRAME_HEADER_SIZE);
+            m_batch_records = 0;
+        }
 
-    connect(m_close_out_sock, (struct sockaddr*)&l_conn_addr, sizeof(l_conn_addr));
-    if ((m_close_in_sock = accept(m_listen_sock, NULL, NULL)) == 0) {
-        print_error(INIT_FAIL);
-        exit(0);
+        char* l_out = m_batch.data() + m_batch.size();
+        if (topic_id) {
+            encode_command_id(OP_PUBLISH, topic_id, payload, l_out);
+        }
+        else {
+            encode_command(FRAMING_BINARY, OP_PUBLISH, topic, payload, l_out);
+        }
+        m_batch.set_size(m_batch.size() + l_size);
+        m_batch_records++;
+        m_batch_bytes = m_batch.size();
+
+        // Socket loop learns the deadline of a new batch (and sees a closed one in the ring)
+        if (l_opened) {
+            m_batch_deadline = Metrics::now_ns() + m_linger_ns;
+            if (!m_corked) {
+                m_notifier.notify();
+            }
+        }
     }
-
-    // Close listening sockets
-    close(m_listen_sock);
+    outbound_check();
+    return true;
 }
 
-void Client::socket_command_msg(void) {
+bool Client::batch_close(bool wait) {
 
-    static char l_buffer[MAX_MESSAGE_SIZE] = { 0 };
-    int l_recvcount;
-    l_recvcount = recv(m_msg_out_sock, l_buffer, MAX_MESSAGE_SIZE, 0);
-    l_buffer[l_recvcount] = '\0';
+    FrameHeader l_header;
+    l_header.length = m_batch.size() - FRAME_HEADER_SIZE;
+    l_header.opcode = OP_PUBLISH_BATCH;
+    l_header.flags = 0;
+    l_header.topic_len = 0;
+    encode_header(m_batch.data(), l_header);
 
-    m_out_messages.push_back(l_buffer);
+    OutMessage l_message;
+    l_message.droppable = true;
+    l_message.buf = std::move(m_batch);
+    if (!command_push(l_message, wait)) {
+        m_batch = std::move(l_message.buf);
+        return false;
+    }
+    m_batch_deadline = 0;
+    m_batch_bytes = 0;
+    m_batch_due = false;
+    return true;
 }
 
-void Client::socket_close_msg(void) {
+BufRef Client::encode_compressed(uint16_t topic_id, string_view topic, string_view payload) {
 
-    // First read input message to clear up the buffer
-    static char l_buffer[BUFFER_SIZE];
-    recv(m_close_out_sock, l_buffer, BUFFER_SIZE, 0);
+    // Frame on a bound topic carries only the ID
+    size_t l_topic_size = topic_id ? 0 : topic.size();
+    BufRef l_buf = m_pool.get(FRAME_HEADER_SIZE + l_topic_size + compress_bound(payload.size()));
+    size_t l_packed = compress_payload(payload, m_compress_level, l_buf.data() + FRAME_HEADER_SIZE + l_topic_size);
+    if (l_packed == 0) {
+        return BufRef();
+    }
 
-    // Then send the reply message to notify server of disconnect
-    strcpy(l_buffer, "DISCONNECT");
-    strcat(l_buffer, EOM);
-    send(m_server_socket, l_buffer, strlen(l_buffer), 0);
+    FrameHeader l_header;
+    l_header.length = l_topic_size + l_packed;
+    l_header.opcode = OP_PUBLISH;
+    l_header.flags = FLAG_COMPRESSED | (topic_id ? FLAG_TOPIC_ID : 0);
+    l_header.topic_len = topic_id ? topic_id : topic.size();
+    encode_header(l_buf.data(), l_header);
+    memcpy(l_buf.data() + FRAME_HEADER_SIZE, topic.data(), l_topic_size);
+    l_buf.set_size(FRAME_HEADER_SIZE + l_header.length);
+
+    m_metrics.add(CNT_COMPRESSED);
+    m_metrics.add(CNT_COMPRESS_IN, payload.size());
+    m_metrics.add(CNT_COMPRESS_OUT, l_packed);
+    return l_buf;
+}
 
-    // Then shutdown the socket
-    shutdown(m_server_socket, SHUT_RDWR);
-    close(m_server_socket);
+bool Client::topic_compressed(string_view topic) {
+    if (!m_plain_any) { return true; }
+    shared_lock<shared_mutex> l_lock(m_plain_mutex);
+    return m_plain_topics.find(topic) == m_plain_topics.end();
 }
 
-void Client::socket_server_msg(void) {
+BufRef Client::encode(opcode_enum opcode, string_view topic, string_view payload) {
+    size_t l_size = command_size(m_framing, opcode, topic, payload);
+    BufRef l_buf = m_pool.get(l_size);
+    encode_command(m_framing, opcode, topic, payload, l_buf.data());
+    l_buf.set_size(l_size);
+    return l_buf;
+}
 
-    // Read messge from socket
-    static char l_buffer[BUFFER_SIZE];
-    int l_size;
-    l_size = recv(m_server_socket, l_buffer, BUFFER_SIZE, 0);
-    l_buffer[l_size] = 0;
+bool Client::socket_command_msg(void) {
 
-    // If buffer is empty connection is down
-    if (l_buffer[0] == '\0') {
-        cout << "\n";
-        print_error(CONN_DOWN);
-        shutdown(m_server_socket, SHUT_RDWR);
-        close(m_server_socket);
-    }
-    else {
-        process_message_chunk(l_buffer, l_size, false);
+    OutMessage l_msg;
+    size_t l_messages = 0, l_bytes = 0;
+    bool l_close = false;
+
+    // Move every pending message from the ring into the outgoing queue
+    while (m_cmd_queue.pop(l_msg)) {
+        l_messages++;
+        l_bytes += l_msg.buf.size();
+        if (l_msg.type == OUT_DISCONNECT) {
+            l_close = true;
+            break;
+        }
+        m_sender.push(std::move(l_msg.buf), l_msg.droppable);
     }
+    m_ring_messages.fetch_sub(l_messages, memory_order_relaxed);
+    m_ring_bytes.fetch_sub(l_bytes, memory_order_relaxed);
+    return l_close || m_close_pending;
 }
 
 
-bool Client::socket_write(void) {
-
-    static bool l_last;
-    static string l_chunk;
+/******************************************************************************/
+/*******************          OUTBOUND BACKPRESSURE          ******************/
+/******************************************************************************/
+bool Client::outbound_admit(overflow_enum policy) {
 
-    l_chunk = get_send_chunk(&l_last);
+    switch (policy) {
+    case OVERFLOW_DROP_OLDEST:
+        return true;
 
-    send(m_server_socket, l_chunk.c_str(), strlen(l_chunk.c_str()), 0);
+    case OVERFLOW_DROP_NEWEST:
+        m_metrics.add(CNT_DROPPED);
+        return false;
 
-    return l_last;
+    case OVERFLOW_BLOCK:
+        // Socket thread would wait for itself
+        if (!on_socket_thread()) {
+            unique_lock<mutex> l_lock(m_bp_mutex);
+            m_bp_cv.wait(l_lock, [this]() { return !m_congested || !m_connected; });
+            if (m_connected) { return true; }
+        }
+        [[fallthrough]];
 
+    default:
+        m_metrics.add(CNT_REJECTED);
+        return false;
+    }
 }
 
-void Client::socket_loop(void) {
-
-    fd_set l_readfds, l_writefds, l_errorfds;
-    // Maximum file descriptor number
-    int l_nfds = max({ m_server_socket, m_msg_out_sock, m_close_out_sock });
-    int l_ready;
-
-    // Set file descriptors sets
-    FD_ZERO(&l_readfds);
-    FD_ZERO(&l_writefds);
-    FD_ZERO(&l_errorfds);
+void Client::outbound_check(void) {
 
-    FD_SET(m_server_socket,  &l_readfds);
-    FD_SET(m_msg_out_sock,   &l_readfds);
-    FD_SET(m_close_out_sock, &l_readfds);
+    if (m_congested) { return; }
 
-    FD_SET(m_server_socket, &l_errorfds);
+    size_t l_messages = m_ring_messages.load(memory_order_relaxed) + m_sender_messages.load(memory_order_relaxed);
+    size_t l_bytes = m_ring_bytes.load(memory_order_relaxed) + m_sender_bytes.load(memory_order_relaxed);
+    if (l_messages > m_high_messages || l_bytes > m_high_bytes) {
+        {
+            lock_guard<mutex> l_lock(m_bp_mutex);
+            if (m_congested.exchange(true)) { return; }
+            m_metrics.add(CNT_CONGESTED);
+        }
+        // Counters may be stale, socket loop must re-evaluate even if it has nothing to send
+        if (!on_socket_thread()) {
+            m_notifier.force();
+        }
+    }
+}
 
+void Client::outbound_relieve(void) {
 
-    while (1) {
+    size_t l_messages = m_ring_messages.load(memory_order_relaxed) + m_sender_messages.load(memory_order_relaxed);
+    size_t l_bytes = m_ring_bytes.load(memory_order_relaxed) + m_sender_bytes.load(memory_order_relaxed);
+    if (m_congested && l_messages <= m_limits.low_messages && l_bytes <= m_limits.low_bytes) {
+        m_congested = false;
+        m_bp_cv.notify_all();
+    }
+}
 
-        // Blocking wait untill some fd becomes available
-        m_mutex.unlock();
-        l_ready = select(l_nfds + 1, &l_readfds, &l_writefds, &l_errorfds, NULL);
-        m_mutex.lock();
+void Client::outbound_update(void) {
 
-        // Connection down
-        if (l_ready == -1) {
-            m_connected = false;
-            
-            cout << "Enter command or (-h):";
-            cout.flush();
-            m_mutex.unlock();
-            return;
-        }
+    // Oldest publishes that did not start going out make room for new ones
+    if (m_congested && m_policy == OVERFLOW_DROP_OLDEST) {
+        size_t l_dropped = m_sender.drop_oldest(m_high_messages, m_high_bytes);
+        if (l_dropped) { m_metrics.add(CNT_DROPPED, l_dropped); }
+    }
 
-        // Error on server socket
-        if (FD_ISSET(m_server_socket, &l_errorfds)) {
-            print_error(CONN_LOST);
-            close(m_server_socket);
-            m_connected = false;
-            m_mutex.unlock();       // Don't forget to unlock the mutex
-            return;
-        }
+    m_sender_messages.store(m_sender.size(), memory_order_relaxed);
+    m_sender_bytes.store(m_sender.queued_bytes(), memory_order_relaxed);
+    m_metrics.set(GAUGE_OUT_BYTES, m_ring_bytes.load(memory_order_relaxed) + m_sender.queued_bytes());
 
-        // Input message from server
-        if (FD_ISSET(m_server_socket, &l_readfds)) {
-            socket_server_msg();
-        }
+    // Handlers queue directly into the send engine, so congestion is checked here as well
+    outbound_check();
+    if (m_congested) {
+        lock_guard<mutex> l_lock(m_bp_mutex);
+        outbound_relieve();
+    }
+}
 
-        // Input message from command loop
-        if (FD_ISSET(m_msg_out_sock, &l_readfds)) {
-            // Read the message and set the send set
-            socket_command_msg();
-            // Arm write fd set
-            FD_SET(m_server_socket, &l_writefds);
-        }
+void Client::set_outbound_limits(const OutboundLimits& limits) {
 
-        // Close (disconnect commands) message from command loop
-        if (FD_ISSET(m_close_out_sock, &l_readfds)) {
-            socket_close_msg();
-            m_connected = false;
-            m_mutex.unlock();
-            return;            
-        }
+    lock_guard<mutex> l_lock(m_bp_mutex);
+    m_limits = limits;
+    m_limits.low_messages = min(m_limits.low_messages, m_limits.high_messages);
+    m_limits.low_bytes = min(m_limits.low_bytes, m_limits.high_bytes);
+    m_high_messages = m_limits.high_messages;
+    m_high_bytes = m_limits.high_bytes;
+    m_policy = m_limits.policy;
 
-        // Server ready to receive message
-        if (FD_ISSET(m_server_socket, &l_writefds)) {
-            // Returns true if last written, disarm write set if last
-            if (socket_write()) {
-                FD_ZERO(&l_writefds);
-            }
-        }
+    // Blocked publishers re-evaluate under the new policy
+    outbound_relieve();
+    m_bp_cv.notify_all();
+}
 
-        // Reset basic fd sets
-        FD_SET(m_server_socket, &l_readfds);
-        FD_SET(m_msg_out_sock, &l_readfds);
-        FD_SET(m_close_out_sock, &l_readfds);
-        FD_SET(m_server_socket, &l_errorfds);
-    }
+OutboundLimits Client::outbound_limits(void) {
+    lock_guard<mutex> l_lock(m_bp_mutex);
+    return m_limits;
 }
 
+OutboundState Client::outbound_state(void) const {
 
-/******************************************************************************/
-/****************           I/O PROCESSING FUNCTIONS          *****************/
-/******************************************************************************/
-void Client::process_message_chunk(char* msg_chunk, int size, bool from_restore) {
+    OutboundState l_state;
+    l_state.messages = m_ring_messages.load(memory_order_relaxed) + m_sender_messages.load(memory_order_relaxed);
+    l_state.bytes = m_ring_bytes.load(memory_order_relaxed) + m_sender_bytes.load(memory_order_relaxed);
 
+    // Open batch counts as one message until it is closed
+    size_t l_batch = m_batch_bytes.load(memory_order_relaxed);
+    l_state.messages += l_batch != 0;
+    l_state.bytes += l_batch;
 
-    static string l_msg_chunk;
-    l_msg_chunk = msg_chunk;
-    m_receive_stream += string(msg_chunk);
+    // So does the spool
+    uint64_t l_spool = m_spool_on ? m_spool.pending_bytes() : 0;
+    l_state.messages += l_spool != 0;
+    l_state.bytes += l_spool;
 
+    // Pooled buffers (free ones included), a slot per queued message and the preallocated ring
+    l_state.memory = m_pool.heap_bytes() + (l_state.messages + m_cmd_queue.capacity()) * sizeof(OutMessage);
+    l_state.congested = m_congested;
+    return l_state;
+}
 
 
-    if (m_receive_stream.find(EOM)) {
+void Client::socket_close_msg(void) {
 
-        //cout << m_receive_stream;
-        // Split the stream into a list of messages
-        vector<string> l_msg_list;
-        l_msg_list = split(m_receive_stream, EOM);
-        int l_last_msg = l_msg_list.size() - 1;
+    // Notify server of disconnect after messages that were queued before it
+    m_sender.push(encode(OP_DISCONNECT, "", ""));
+    socket_flush();
+    if (m_sender.empty()) {
+        m_spool.consume(m_spool_inflight);
+        m_spool_inflight = 0;
+    }
+    print_info(SEND_STATS, " " + to_string(m_sender.messages()) + " messages, " + to_string(m_sender.bytes())
+        + " bytes in " + to_string(m_sender.syscalls()) + " writes (" + to_string((uint64_t)m_sender.bytes_per_syscall()) + " bytes/write)");
 
-        // If stream ends with EOM only entire messages are in list
-        if (ends_with(m_receive_stream, EOM)) {
-            // << "Skinuo sve";
-            m_receive_stream = "";
-        }
-        // If not it contains parts of future messages
-        else {
-            m_receive_stream = l_msg_list[l_last_msg];
-            l_msg_list.pop_back();
-            l_last_msg--;
+    // Then shutdown the socket
+    shutdown(m_server_socket, SHUT_RDWR);
+    close(m_server_socket);
+}
+
+bool Client::socket_server_msg(void) {
+
+    // Read messages from socket (or link) straight into the framer until it is drained
+    int l_size;
+
+    while (1) {
+        char* l_buffer = m_framer.prepare(RECV_BUFFER_SIZE);
+        l_size = m_link ? m_link->recv(l_buffer, RECV_BUFFER_SIZE) : recv(m_server_socket, l_buffer, RECV_BUFFER_SIZE, 0);
+        m_metrics.add(CNT_READ_CALLS);
+
+        if (l_size < 0) {
+            if (errno == EINTR) { continue; }
+            // Empty ring is read again if the server committed something while the wakeup was armed
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (m_link && !m_link->sleep()) { continue; }
+                return true;
+            }
         }
 
-        // If not called from restore print new line
-        if (!from_restore) {
+        // Empty read or error means connection is down
+        if (l_size <= 0) {
             cout << "\n";
+            print_error(CONN_DOWN);
+            shutdown(m_server_socket, SHUT_RDWR);
+            close(m_server_socket);
+            return false;
         }
 
-        // Print all the messages
-        int i;
-        for (i = 0; i <= l_last_msg; i++) {
-            if (l_msg_list[i] == "") { continue; };
-            print_received_message(l_msg_list[i]);
+        m_framer.commit(l_size);
+        m_metrics.add(CNT_BYTES_IN, l_size);
+        process_frames(false);
+
+        // Full dispatch queue leaves the rest in the kernel buffer, the socket loop resumes reading
+        if (m_dispatcher && m_dispatcher->throttled()) {
+            m_read_paused = true;
+            socket_interest();
+            m_metrics.add(CNT_READ_PAUSES);
+            return true;
         }
 
-        // Print prompt
-        if (!from_restore) {
-            cout << "Enter command or (-h): ";
-            cout.flush();
+        // Binary frame that can not be valid, stream is out of sync
+        if (m_framer.error()) {
+            print_error(MSG_TOO_LONG);
+            shutdown(m_server_socket, SHUT_RDWR);
+            close(m_server_socket);
+            return false;
         }
     }
+}
+
+
+bool Client::socket_write(void) {
 
+    // Every call gathers as many queued messages as fit into one sendmsg
+    while (m_writable && !m_sender.empty()) {
+        uint64_t l_messages = m_sender.messages();
+        ssize_t l_sent = m_link ? m_sender.write(m_link->out()) : m_sender.write(m_server_socket);
+        m_metrics.add(CNT_WRITE_CALLS);
+        if (l_sent < 0) {
+            if (errno == EINTR) { continue; }
+            // Ring that got room while the wakeup was armed is written again
+            if (m_link && errno == EAGAIN && !m_link->wait_space()) { continue; }
+            // Socket buffer is full (or broken), wait for next write event
+            m_writable = false;
+            continue;
+        }
+        m_metrics.add(CNT_BYTES_OUT, l_sent);
+        m_metrics.add(CNT_MSGS_OUT, m_sender.messages() - l_messages);
+    }
+
+    return m_sender.empty();
 }
 
-void Client::print_received_message(string msg) {
-    // Split message into words
-    vector<string> word_list;
-    static string topic, data;
-    data = "";
+void Client::socket_flush(void) {
 
-    word_list = split(msg, " ");
-    topic = word_list[0];
+    // Switch to blocking mode so everything queued goes out
+    fcntl(m_server_socket, F_SETFL, fcntl(m_server_socket, F_GETFL, 0) & ~O_NONBLOCK);
+    m_writable = true;
+    socket_write();
 
-    // Parse topic and data 
-    if (word_list.size() > 1) {
-        data = word_list[1];
+    // Ring does not block, wait for the server to make room unless it is gone
+    while (m_link && !m_sender.empty() && (!m_link->wait_space() || m_link->block(m_server_socket, SHM_FLUSH_MS))) {
+        m_writable = true;
+        socket_write();
     }
-    //cout << "Topic:";
-    //cout << topic + "\n";
-    // If topic in list of subscribed topics print topic name and data
-    if (m_topics.find(topic) != m_topics.end()) {
-        cout << "Topic: " + topic + " Data: " + data + "\n";
-        cout.flush();
+}
+
+void Client::socket_interest(void) {
+
+    // Link wakes the loop through its eventfd, the socket only reports that the server is gone
+    if (!m_link) {
+        m_reactor->modify(m_server_socket, m_want_write, !m_read_paused);
     }
-    else {
-        print_error(WRONG_TOPIC);
+}
+
+void Client::link_close(void) {
+
+    if (m_link) {
+        m_reactor->remove(m_link->fd());
+        m_link.reset();
+    }
+}
+
+void Client::socket_loop(void) {
+
+    ReactorEvent l_events[REACTOR_MAX_EVENTS];
+    int l_ready;
+    int l_timeout;
+    bool l_conn_down = false;
+
+    m_mutex.lock();
+    t_socket_client = this;
+    m_close_pending = false;
+    m_reactor->add(m_notifier.fd(), false);
+
+    // Connection is set up with the waits of the loop, so a disconnect ends it early.
+    // Addresses of a name are tried in turn until one of them connects.
+    int l_setup;
+    do {
+        l_setup = connect_open(false) ? connect_setup(UINT64_MAX, false) : 0;
+    } while (l_setup == 0 && m_endpoint.next());
+    bool l_up = l_setup > 0;
+    m_connecting = false;
+    ConnectHandler l_done = std::move(m_connect_handler);
+    m_connect_handler = nullptr;
+    if (l_done) {
+        l_done(l_up);
+    }
+    uint64_t l_locked = Metrics::now_ns();
+
+    while (l_up) {
+
+        // Arm the notifier, if something slipped into the ring meanwhile just poll
+        m_notifier.arm();
+        l_timeout = m_cmd_queue.empty() && !(m_spool_on && m_writable && !m_spool.empty())
+            && !(m_read_paused && !m_dispatcher->throttled()) ? -1 : 0;
+
+        // Open publish batch is due when its linger is over, read after arming like the ring
+        uint64_t l_deadline = m_batch_deadline;
+        if (l_timeout < 0 && l_deadline) {
+            uint64_t l_now = Metrics::now_ns();
+            l_timeout = l_deadline > l_now ? (l_deadline - l_now + 999999) / 1000000 : m_batch_due ? 1 : 0;
+        }
+
+        // Blocking wait untill some fd becomes available, all events are
+        // then handled under a single lock
+        uint64_t l_unlocked = Metrics::now_ns();
+        m_metrics.record(HIST_LOCK_HOLD_NS, l_unlocked - l_locked);
+        m_mutex.unlock();
+        l_ready = m_reactor->wait(l_events, REACTOR_MAX_EVENTS, l_timeout);
+        uint64_t l_woken = Metrics::now_ns();
+        m_mutex.lock();
+        l_locked = Metrics::now_ns();
+        m_notifier.disarm();
+        m_metrics.add(CNT_WAKEUPS);
+        m_metrics.record(HIST_WAIT_NS, l_woken - l_unlocked);
+
+        if (l_ready == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // Connection down
+        if (l_ready == -1) {
+            print_error(SEL_FAIL);
+            close(m_server_socket);
+            l_conn_down = true;
+        }
+
+        for (int i = 0; i < l_ready; i++) {
+            ReactorEvent& l_ev = l_events[i];
+
+            // Wakeup from API threads, clear the eventfd counter
+            if (l_ev.fd == m_notifier.fd()) {
+                m_notifier.drain();
+                continue;
+            }
+
+            // Server committed to the link or made room in it
+            if (m_link && l_ev.fd == m_link->fd()) {
+                m_link->drain();
+                m_writable = true;
+                if (!m_read_paused && !socket_server_msg()) {
+                    l_conn_down = true;
+                    break;
+                }
+                continue;
+            }
+
+            // Server socket of a link carries nothing after the handshake, any event means it is gone
+            if (m_link && l_ev.fd == m_server_socket) {
+                if (socket_server_msg()) {
+                    print_error(CONN_DOWN);
+                    shutdown(m_server_socket, SHUT_RDWR);
+                    close(m_server_socket);
+                }
+                l_conn_down = true;
+                break;
+            }
+
+            // Input message from server, left in the socket while reads are paused
+            if (l_ev.readable && !m_read_paused && !socket_server_msg()) {
+                l_conn_down = true;
+                break;
+            }
+
+            // Error on server socket
+            if (l_ev.error) {
+                print_error(CONN_LOST);
+                close(m_server_socket);
+                l_conn_down = true;
+                break;
+            }
+
+            // Server ready to receive message
+            if (l_ev.writable) {
+                m_writable = true;
+            }
+        }
+
+        // Dispatch workers caught up, read what the socket kept meanwhile
+        if (!l_conn_down && m_read_paused && !m_dispatcher->throttled()) {
+            m_read_paused = false;
+            socket_interest();
+            l_conn_down = !socket_server_msg();
+        }
+
+        if (l_conn_down) {
+            m_connected = false;
+            if (m_batch_handler) { m_batch_handler(); }
+
+            // Reconnect keeps the thread, everything queued goes out on the new connection below
+            if (!m_reconnect.enabled || !socket_reconnect()) {
+                break;
+            }
+            l_conn_down = false;
+        }
+
+        // Messages from API threads, close (disconnect command) ends the loop
+        if (socket_command_msg()) {
+            socket_close_msg();
+            m_connected = false;
+            break;
+        }
+
+        // Batch goes through the ring behind everything pushed before it, it is popped on the
+        // next iteration. A busy producer is asked to close it with its next publish, without
+        // one it is retried a millisecond later.
+        l_deadline = m_batch_deadline;
+        if (l_deadline && Metrics::now_ns() >= l_deadline) {
+            if (m_producer_mutex.try_lock()) {
+                if (m_batch) {
+                    batch_close(false);
+                }
+                m_producer_mutex.unlock();
+            }
+            else {
+                m_batch_due = true;
+            }
+        }
+
+        m_metrics.set(GAUGE_SEND_QUEUE, m_sender.size());
+        if (m_dispatcher) {
+            m_metrics.set(GAUGE_DISPATCH_BYTES, m_dispatcher->pending_bytes());
+        }
+        m_metrics.record(HIST_SEND_QUEUE, m_sender.size());
+
+        // Write as much as socket accepts, spooled publishes follow everything queued before them
+        bool l_pending = !socket_write();
+        if (!l_pending && m_spool_on && spool_drain()) {
+            l_pending = !socket_write();
+        }
+        outbound_update();
+
+        // Keep write interest only while something is left to send
+        if (l_pending != m_want_write) {
+            m_want_write = l_pending;
+            socket_interest();
+        }
     }
 
+    link_close();
+    m_reactor->remove(m_server_socket);
+    m_reactor->remove(m_notifier.fd());
+    t_socket_client = nullptr;
+
+    // Publishers blocked on a congested queue give up
+    outbound_update();
+    {
+        lock_guard<mutex> l_lock(m_bp_mutex);
+    }
+    m_bp_cv.notify_all();
+    m_mutex.unlock();       // Don't forget to unlock the mutex
 }
 
-string Client::get_send_chunk(bool* last) {
 
-    int l_maxsz = BUFFER_SIZE - strlen(EOM);
+/******************************************************************************/
+/*********************          RECONNECT FUNCTIONS          ******************/
+/******************************************************************************/
+bool Client::socket_reconnect(void) {
 
-    static string l_chunk;
-    *last = false;
+    uint64_t l_down = Metrics::now_ns();
+    link_close();
+    m_reactor->remove(m_server_socket);
+    m_reconnecting = true;
+    m_framer.reset();
 
-    if (m_out_messages[0].size() > l_maxsz) {
-        l_chunk = m_out_messages[0].substr(0, l_maxsz);
-        m_out_messages[0].erase(0, l_maxsz);
+    // Publishers blocked on a congested queue are refused during the outage
+    {
+        lock_guard<mutex> l_lock(m_bp_mutex);
     }
-    else {
-        l_chunk = m_out_messages[0];
-        m_out_messages.pop_front();
-        if (m_out_messages.size() == 0) {
-            *last = true;
+    m_bp_cv.notify_all();
+
+    uint64_t l_delay = chrono::duration_cast<chrono::nanoseconds>(m_reconnect.initial).count();
+    uint64_t l_max = chrono::duration_cast<chrono::nanoseconds>(m_reconnect.max).count();
+    uint64_t l_timeout = chrono::duration_cast<chrono::nanoseconds>(m_reconnect.timeout).count();
+    for (size_t l_attempt = 1; ; l_attempt++) {
+
+        // Jitter over the upper half of the delay keeps clients of one broker apart
+        uint64_t l_wait = l_delay / 2 + m_jitter() % (l_delay / 2 + 1);
+        print_info(RECONNECTING, " " + to_string(l_wait / 1000000) + " ms");
+
+        int l_result = setup_wait(-1, Metrics::now_ns() + l_wait);
+        if (l_result == 0) {
+            l_result = connect_open(true) ? connect_setup(Metrics::now_ns() + l_timeout, true) : 0;
+        }
+        if (l_result > 0) {
+            m_metrics.add(CNT_RECONNECTS);
+            m_metrics.record(HIST_RECOVER_NS, Metrics::now_ns() - l_down);
+            m_reconnecting = false;
+            return true;
+        }
+
+        // Disconnect requested meanwhile
+        if (l_result < 0) { break; }
+
+        // Next address is tried by the next attempt, the name is resolved again once all failed
+        if (!m_endpoint.next()) {
+            m_endpoint.forget();
+        }
+
+        m_metrics.add(CNT_RECONNECT_FAILS);
+        if (m_reconnect.max_attempts && l_attempt >= m_reconnect.max_attempts) {
+            print_error(RECONN_FAIL);
+            break;
         }
+        l_delay = min(l_delay * 2, max(l_max, (uint64_t)1));
     }
-    l_chunk += EOM;
 
-    return l_chunk;
+    m_reconnecting = false;
+    return false;
 }
 
+int Client::setup_wait(int fd, uint64_t deadline) {
 
+    ReactorEvent l_events[REACTOR_MAX_EVENTS];
 
+    while (1) {
+        uint64_t l_now = Metrics::now_ns();
+        if (l_now >= deadline) { return 0; }
 
-/******************************************************************************/
-/*******************          COMMANDS FUNCTIONS          ********************/
-/******************************************************************************/
-bool Client::command_parse(string input) {
-    assert(input != "");
+        // Same wait as the socket loop, API threads get the lock meanwhile
+        m_notifier.arm();
+        int l_timeout = m_cmd_queue.empty() ? (deadline - l_now + 999999) / 1000000 : 0;
+        m_mutex.unlock();
+        int l_ready = m_reactor->wait(l_events, REACTOR_MAX_EVENTS, l_timeout);
+        m_mutex.lock();
+        m_notifier.disarm();
+        m_metrics.add(CNT_WAKEUPS);
 
-    vector<string> list;
+        bool l_fd_ready = false;
+        for (int i = 0; i < l_ready; i++) {
+            if (l_events[i].fd == m_notifier.fd()) {
+                m_notifier.drain();
+            }
+            else if (l_events[i].fd == fd) {
+                l_fd_ready = true;
+            }
+        }
 
-    list = split(input, " ");
-    m_command = list[0];
-    toUpper(&m_command);
+        // Commands wait in the send engine for the new connection
+        if (socket_command_msg()) { return -1; }
+        outbound_update();
+        if (l_fd_ready) { return 1; }
+    }
+}
 
-    // Check if command is in commands vector
-    if (find(commands.begin(), commands.end(), m_command) == commands.end()) {
-        return false;
+void Client::reconnect_burst(bool restored) {
+
+    vector<BufRef> l_burst;
+
+    // Bindings proposed on the lost connection are proposed again with the same IDs,
+    // so frames queued with them stay valid
+    if (m_topic_ids) {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        for (size_t i = 1; i <= m_topic_table.size(); i++) {
+            TopicEntry* l_entry = m_topic_table.get(i);
+            if (!l_entry->bind_sent) { continue; }
+            BufRef l_buf = m_pool.get(bind_size(l_entry->name));
+            encode_bind(l_entry->id, l_entry->name, l_buf.data());
+            l_buf.set_size(bind_size(l_entry->name));
+            l_burst.push_back(std::move(l_buf));
+        }
     }
 
-    // Parse arguments if they exist
-    if (list.size() >= 2) {
-        m_arg1 = list[1];
+    // New session knows no subscriptions
+    if (!restored) {
+        m_topics.for_each([&](const string& filter, MessageHandler&) {
+            l_burst.push_back(encode(OP_SUBSCRIBE, filter, ""));
+        });
     }
-    else {
-        m_arg1 = "";
+
+    // Burst goes out before everything queued during the outage, with one write
+    for (auto l_it = l_burst.rbegin(); l_it != l_burst.rend(); l_it++) {
+        m_sender.push_front(std::move(*l_it));
     }
+}
+
+
+/******************************************************************************/
+/**********************          OFFLINE SPOOL          ***********************/
+/******************************************************************************/
+bool Client::spool_publish(string_view topic, string_view payload) {
+
+    if (!m_spool_on) { return false; }
 
-    if (list.size() >= 3) {
-        m_arg2 = list[2];
+    // Publishes lingering in the open batch were made before this one
+    if (on_socket_thread()) {
+        if (!m_spool.append(topic, payload)) { return false; }
     }
     else {
-        m_arg2 = "";
+        lock_guard<mutex> l_lock(m_producer_mutex);
+        if (m_batch && m_connected) {
+            batch_close(true);
+        }
+        if (!m_spool.append(topic, payload)) { return false; }
+        if (m_connected && !m_corked) {
+            m_notifier.notify();
+        }
+    }
+    m_metrics.add(CNT_PUBLISH);
+    m_metrics.add(CNT_SPOOLED);
+    return true;
+}
+
+bool Client::spool_drain(void) {
+
+    // Send engine is empty, so the records handed over before are written
+    m_spool.consume(m_spool_inflight);
+    m_spool_inflight = 0;
+    m_metrics.set(GAUGE_SPOOL_BYTES, m_spool.pending_bytes());
+
+    // Commands in the ring may be older than the spooled records, they go first
+    string_view l_records = m_spool.peek(SPOOL_DRAIN_BYTES);
+    if (l_records.empty() || !m_cmd_queue.empty()) { return false; }
+
+    // Records are binary PUBLISH frames, copied as they are in pool sized chunks or
+    // encoded again for text framing
+    size_t l_count = 0;
+    size_t l_chunk = 0, l_pos = 0;
+    while (l_pos < l_records.size()) {
+        FrameHeader l_header;
+        decode_header(l_records.data() + l_pos, l_header);
+        size_t l_size = FRAME_HEADER_SIZE + l_header.length;
+
+        if (m_framing == FRAMING_TEXT) {
+            string_view l_frame = l_records.substr(l_pos, l_size);
+            string_view l_topic = l_frame.substr(FRAME_HEADER_SIZE, l_header.topic_len);
+            m_sender.push(encode(OP_PUBLISH, l_topic, l_frame.substr(FRAME_HEADER_SIZE + l_header.topic_len)));
+        }
+        else if (l_pos + l_size - l_chunk > PUBLISH_BATCH_BYTES && l_pos > l_chunk) {
+            BufRef l_buf = m_pool.get(l_pos - l_chunk);
+            memcpy(l_buf.data(), l_records.data() + l_chunk, l_pos - l_chunk);
+            l_buf.set_size(l_pos - l_chunk);
+            m_sender.push(std::move(l_buf));
+            l_chunk = l_pos;
+        }
+        l_pos += l_size;
+        l_count++;
+    }
+    if (m_framing == FRAMING_BINARY) {
+        BufRef l_buf = m_pool.get(l_pos - l_chunk);
+        memcpy(l_buf.data(), l_records.data() + l_chunk, l_pos - l_chunk);
+        l_buf.set_size(l_pos - l_chunk);
+        m_sender.push(std::move(l_buf));
     }
 
+    m_spool_inflight = l_records.size();
+    m_metrics.add(CNT_UNSPOOLED, l_count);
     return true;
+}
+
 
+/******************************************************************************/
+/****************           I/O PROCESSING FUNCTIONS          *****************/
+/******************************************************************************/
+void Client::process_message_chunk(const char* msg_chunk, size_t size, bool from_restore) {
+
+    m_framer.append(msg_chunk, size);
+    process_frames(from_restore);
 }
 
-void Client::command_process(void) {
+void Client::process_frames(bool from_restore) {
+
+    string_view l_frame;
+    bool l_dispatched = false;
 
-    if (m_command == "DISCONNECT") {
-        command_disconnect();
+    // Dispatch every complete frame, partial one stays in the framer
+    while (m_framer.next(l_frame)) {
+        if (l_frame.empty()) { continue; }
+        m_metrics.add(CNT_MSGS_IN);
+        l_dispatched = true;
+        dispatch_message(l_frame);
     }
-    else if (m_command == "PUBLISH") {
-        command_publish();
+
+    // Let the application know that the batch is over (CLI reprints prompt), workers do it when drained
+    if (!from_restore && l_dispatched && m_batch_handler && !m_dispatcher) {
+        m_batch_handler();
     }
-    else if (m_command == "SUBSCRIBE") {
-        command_subscribe();
+}
+
+void Client::dispatch_message(string_view msg) {
+
+    // Text message is "<topic> <data>", binary one has topic length in header
+    string_view l_topic, l_data;
+    uint8_t l_opcode;
+    uint16_t l_topic_id;
+
+    if (!decode_message(m_framing, msg, l_opcode, l_topic_id, l_topic, l_data) ||
+        (l_opcode != OP_MESSAGE && l_opcode != OP_BOUND)) {
+        print_error(UNKNOWN_RSP, string(msg.substr(0, min<size_t>(msg.size(), 32))));
+        return;
     }
-    else if (m_command == "UNSUBSCRIBE") {
-        command_unsubscribe();
+
+    // Server confirmed a topic binding
+    if (l_opcode == OP_BOUND) {
+        topic_bound(l_topic, l_data);
+        return;
     }
-    else {
-        cout << "Error in command process";
-        assert(0);
+
+    // Compressed payload is expanded into a pooled buffer that lives until handlers return
+    BufRef l_plain;
+    if (frame_flags(m_framing, msg) & FLAG_COMPRESSED) {
+        size_t l_size = decompressed_size(l_data);
+        if (l_size == 0 || l_size > MAX_FRAME_SIZE) {
+            print_error(UNKNOWN_RSP, "compressed payload");
+            return;
+        }
+        l_plain = m_pool.get(l_size);
+        if (!decompress_payload(l_data, l_plain.data(), l_size)) {
+            print_error(UNKNOWN_RSP, "compressed payload");
+            return;
+        }
+        l_plain.set_size(l_size);
+        l_data = l_plain.view();
+        m_metrics.add(CNT_DECOMPRESSED);
     }
-}
 
-void Client::command_disconnect(void) {
+    span<const byte> l_payload = as_bytes(span<const char>(l_data.data(), l_data.size()));
+    uint64_t l_seq = frame_seq(m_framing, msg);
+
+    // Message on a bound topic, no name to look up
+    if (l_topic_id != 0) {
+        TopicEntry* l_entry;
+        {
+            lock_guard<mutex> l_lock(m_ids_mutex);
+            l_entry = m_topic_table.get(l_topic_id);
+        }
+        if (!l_entry) {
+            print_error(UNKNOWN_RSP, "topic ID " + to_string(l_topic_id));
+            return;
+        }
+        if (l_seq && !sequence_check(l_entry->name, l_seq, frame_flags(m_framing, msg) & FLAG_REPLAY)) {
+            return;
+        }
+        if (m_dispatcher) {
+            dispatch_pooled(l_entry->name, l_payload, std::move(l_plain));
+            return;
+        }
+        dispatch_bound(l_entry->name, l_payload, l_entry);
+        return;
+    }
 
-    // Send message to socket loop
-    static string l_message;
-    l_message = "DISCONNECT";
+    if (l_seq && !sequence_check(l_topic, l_seq, frame_flags(m_framing, msg) & FLAG_REPLAY)) {
+        return;
+    }
 
-    int snt = send(m_close_in_sock, l_message.c_str(), l_message.size(), 0);
+    // Handlers run on the dispatch workers, the socket thread only queues
+    if (m_dispatcher) {
+        dispatch_pooled(l_topic, l_payload, std::move(l_plain));
+        return;
+    }
 
-    // Delete subscribed topics
-    m_topics.clear();
+    // Pass data to handler of every subscribed filter matching the topic
+    m_dispatching = true;
+    size_t l_matched = m_topics.match(l_topic, [&](MessageHandler& handler) {
+        MessageHandler& l_handler = handler ? handler : m_default_handler;
+        if (l_handler) {
+            l_handler(l_topic, l_payload);
+        }
+    });
+    m_dispatching = false;
 
+    if (l_matched == 0) {
+        print_error(WRONG_TOPIC);
+    }
+    apply_topic_changes();
 }
 
-void Client::command_publish(void) {
+bool Client::sequence_check(string_view topic, uint64_t seq, bool replayed) {
 
-    if (m_arg1 == "") {
-        print_error(EMPTY_TOPIC);
-        return;
+    if (replayed) { m_metrics.add(CNT_REPLAYED); }
+
+    auto l_it = m_last_seq.find(topic);
+    if (l_it == m_last_seq.end()) {
+        m_last_seq.emplace(string(topic), seq);
+        return true;
+    }
+
+    // Replay already delivered before the resume, a live one is only behind another publisher
+    if (seq <= l_it->second) {
+        if (!replayed) { return true; }
+        m_metrics.add(CNT_DUPLICATES);
+        return false;
+    }
+    if (seq > l_it->second + 1) {
+        m_metrics.add(CNT_GAPS, seq - l_it->second - 1);
     }
+    l_it->second = seq;
+    return true;
+}
+
+void Client::dispatch_bound(string_view topic, span<const byte> payload, TopicEntry* entry) {
 
-    static string l_message;
-    l_message = "PUBLISH " + m_arg1 + " " + m_arg2;
+    // Matching subscriptions are cached per topic until subscriptions change
+    if (entry->epoch != m_topics_epoch) {
+        entry->handlers.clear();
+        m_topics.match(topic, [&](MessageHandler& handler) {
+            entry->handlers.push_back(&handler);
+        });
+        entry->epoch = m_topics_epoch;
+    }
 
-    send(m_msg_in_sock, l_message.c_str(), l_message.size(), 0);
+    if (entry->handlers.empty()) {
+        print_error(WRONG_TOPIC);
+        return;
+    }
 
+    // Handlers' subscription changes are deferred, cached pointers stay valid
+    m_dispatching = true;
+    for (MessageHandler* l_handler : entry->handlers) {
+        MessageHandler& l_call = *l_handler ? *l_handler : m_default_handler;
+        if (l_call) {
+            l_call(topic, payload);
+        }
+    }
+    m_dispatching = false;
+    apply_topic_changes();
 }
 
-void Client::command_subscribe(void) {
+void Client::dispatch_pooled(string_view topic, span<const byte> payload, BufRef&& plain) {
 
-    if (m_arg1 == "") {
-        print_error(EMPTY_TOPIC);
+    // Handlers are matched once per topic until subscriptions change, queued messages keep their list
+    DispatchTopic* l_topic = m_dispatcher->topic(topic);
+    if (l_topic->epoch != m_topics_epoch) {
+        auto l_handlers = make_shared<vector<DispatchHandler>>();
+        size_t l_matched = m_topics.match(topic, [&](MessageHandler& handler) {
+            MessageHandler& l_handler = handler ? handler : m_default_handler;
+            if (l_handler) {
+                l_handlers->push_back(l_handler);
+            }
+        });
+        l_topic->handlers = l_matched ? std::move(l_handlers) : nullptr;
+        l_topic->epoch = m_topics_epoch;
+    }
+
+    if (!l_topic->handlers) {
+        print_error(WRONG_TOPIC);
+        return;
+    }
+    if (l_topic->handlers->empty()) {
         return;
     }
-    static string l_message;
 
-    // Check that not already subscribed
-    if (m_topics.find(m_arg1) == m_topics.end()) {
+    // Framer data is overwritten by the next read, an expanded payload is handed over as it is
+    if (!plain) {
+        plain = m_pool.get(payload.size());
+        memcpy(plain.data(), payload.data(), payload.size());
+        plain.set_size(payload.size());
+    }
+    m_dispatcher->submit(l_topic, std::move(plain));
+}
 
-        m_topics.insert(m_arg1);
+void Client::topic_bound(string_view topic, string_view payload) {
 
-        l_message = "SUBSCRIBE " + m_arg1;
-        send(m_msg_in_sock, l_message.c_str(), l_message.size(), 0);
+    uint16_t l_id;
+    bool l_valid = false;
+
+    // Confirmation must repeat the proposed name and ID
+    if (decode_bind(payload, l_id)) {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        TopicEntry* l_entry = m_topic_table.get(l_id);
+        if (l_entry && l_entry->bind_sent && l_entry->name == topic) {
+            l_entry->bound = true;
+            l_valid = true;
+        }
     }
-    else {
-        print_info(ALR_SUB, m_arg1);
+    if (!l_valid) {
+        print_error(UNKNOWN_RSP, "bound " + string(topic));
     }
+}
+
+void Client::apply_topic_changes(void) {
 
+    if (m_topic_changes.empty()) { return; }
+    m_topics_epoch++;
 
+    // Index can not change under a running match, handlers' changes are applied here
+    for (auto& l_change : m_topic_changes) {
+        if (l_change.subscribe) {
+            m_topics.insert(l_change.topic, std::move(l_change.handler));
+        }
+        else if (l_change.topic.empty()) {
+            m_topics.clear();
+        }
+        else {
+            m_topics.erase(l_change.topic);
+        }
+    }
+    m_topic_changes.clear();
+    m_metrics.set(GAUGE_SUBSCRIPTIONS, m_topics.size());
 }
 
-void Client::command_unsubscribe(void) {
-    if (m_arg1 == "") {
-        print_error(EMPTY_TOPIC);
-        return;
+
+/******************************************************************************/
+/*********************          API FUNCTIONS          ************************/
+/******************************************************************************/
+void Client::disconnect(void) {
+
+    shared_ptr<Dispatcher> l_dispatcher;
+    {
+        auto l_lock = api_lock();
+        if (!m_connected && !m_reconnecting && !m_connecting) { return; }
+        l_dispatcher = m_dispatcher;
+
+        // Delete subscribed topics
+        if (m_dispatching) {
+            m_topic_changes.push_back({ "", false, nullptr });
+        }
+        else {
+            m_topics.clear();
+            m_topics_epoch++;
+        }
+        m_metrics.set(GAUGE_SUBSCRIPTIONS, 0);
     }
-    static string l_message;
 
-    // Check that already subscribed
-    if (m_topics.find(m_arg1) != m_topics.end()) {
-        m_topics.erase(m_arg1);
-        l_message = "UNSUBSCRIBE " + m_arg1;
-        send(m_msg_in_sock, l_message.c_str(), l_message.size(), 0);
+    // Send close message to socket loop
+    OutMessage l_message;
+    l_message.type = OUT_DISCONNECT;
+    command_send(std::move(l_message));
+
+    // Wait for the socket loop to flush and close, unless called from it
+    if (!on_socket_thread() && m_socket_thread.joinable()) {
+        m_socket_thread.join();
     }
-    else {
-        print_info(NOT_SUB, m_arg1);
+
+    // No handler of this connection runs once disconnect returns, unless called from one
+    if (l_dispatcher && !on_socket_thread()) {
+        l_dispatcher->wait_idle();
     }
 }
 
+bool Client::publish(string_view topic, span<const byte> payload) {
 
+    if (topic.empty()) {
+        print_error(EMPTY_TOPIC);
+        return false;
+    }
+    if (!m_connected) {
+        // Spool keeps publishes of an outage, without it they are queued while reconnecting
+        if (spool_publish(topic, string_view((const char*)payload.data(), payload.size()))) { return true; }
+        if (!m_reconnecting) {
+            print_error(NOT_CONN);
+            return false;
+        }
+    }
 
-void Client::command_loop(void) {
+    // Topic gets an ID on first publish, it is bound only if server supports IDs
+    TopicEntry* l_entry = nullptr;
+    if (m_topic_ids) {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        l_entry = m_topic_table.get(m_topic_table.intern(topic));
+    }
+    return publish_entry(l_entry, topic, payload);
+}
 
-    string input;
-    string response;
+bool Client::publish(uint16_t topic_id, span<const byte> payload) {
 
-    // The main loop
-    while (1) {
+    TopicEntry* l_entry;
+    {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        l_entry = m_topic_table.get(topic_id);
+    }
+    if (!l_entry) {
+        print_error(EMPTY_TOPIC);
+        return false;
+    }
+    if (!m_connected) {
+        if (spool_publish(l_entry->name, string_view((const char*)payload.data(), payload.size()))) { return true; }
+        if (!m_reconnecting) {
+            print_error(NOT_CONN);
+            return false;
+        }
+    }
+    return publish_entry(l_entry, l_entry->name, payload);
+}
 
-        cout << "Enter command or (-h): ";
+uint16_t Client::topic_id(string_view topic) {
 
-        // Waiting for user input so mutex is locked
-        m_mutex.unlock();
-        getline(std::cin, input);
-        m_mutex.lock();
+    if (topic.empty()) {
+        print_error(EMPTY_TOPIC);
+        return NO_TOPIC_ID;
+    }
+    lock_guard<mutex> l_lock(m_ids_mutex);
+    return m_topic_table.intern(topic);
+}
 
-        if (input == "\n") {
-            continue;
+bool Client::publish_entry(TopicEntry* entry, string_view topic, span<const byte> payload) {
+
+    string_view l_payload((const char*)payload.data(), payload.size());
+    OutMessage l_message;
+
+    // Once something is spooled, later publishes queue behind it
+    if (m_spool_on && (m_congested || !m_spool.empty()) && spool_publish(topic, l_payload)) {
+        return true;
+    }
+    m_metrics.add(CNT_PUBLISH);
+
+    // Congested queue applies the overflow policy before anything is encoded
+    if (m_congested) {
+        overflow_enum l_policy = m_policy;
+        if (!outbound_admit(l_policy)) {
+            // Dropped newest message is not a failure of the call
+            return l_policy == OVERFLOW_DROP_NEWEST;
         }
+    }
+    l_message.droppable = true;
 
-        if (!command_parse(input)) {
-            print_error(WRONG_CMD);
-            continue;
+    // Bound topic travels as ID, otherwise by name while binding is in flight
+    uint16_t l_id = entry && !bind_topic(entry) ? entry->id : 0;
+
+    // Small publish lingers in the open batch, payloads worth compressing are sent alone
+    bool l_compress = m_compress && l_payload.size() >= m_compress_threshold;
+    if (m_batching && !l_compress && !on_socket_thread() && batch_publish(l_id, topic, l_payload)) {
+        return true;
+    }
+
+    // Large payload is compressed on the calling thread if the server accepts it
+    if (l_compress && topic_compressed(topic)) {
+        l_message.buf = encode_compressed(l_id, topic, l_payload);
+    }
+
+    // Sent as it is when compression is off or does not pay off
+    if (!l_message.buf && l_id) {
+        l_message.buf = m_pool.get(command_id_size(l_payload));
+        encode_command_id(OP_PUBLISH, l_id, l_payload, l_message.buf.data());
+        l_message.buf.set_size(command_id_size(l_payload));
+    }
+    else if (!l_message.buf) {
+        l_message.buf = encode(OP_PUBLISH, topic, l_payload);
+    }
+
+    command_send(std::move(l_message));
+    return true;
+}
+
+bool Client::bind_topic(TopicEntry* entry) {
+
+    // Returns false once the server confirmed the binding
+    {
+        lock_guard<mutex> l_lock(m_ids_mutex);
+        if (!m_topic_ids || entry->bound) { return !entry->bound; }
+        if (entry->bind_sent) { return true; }
+        entry->bind_sent = true;
+    }
+
+    // Propose the binding, server answers with OP_BOUND
+    OutMessage l_message;
+    l_message.buf = m_pool.get(bind_size(entry->name));
+    encode_bind(entry->id, entry->name, l_message.buf.data());
+    l_message.buf.set_size(bind_size(entry->name));
+    command_send(std::move(l_message));
+    return true;
+}
+
+bool Client::subscribe(const string& topic, MessageHandler handler) {
+
+    if (topic == "") {
+        print_error(EMPTY_TOPIC);
+        return false;
+    }
+    if (!TopicIndex<MessageHandler>::valid(topic)) {
+        print_error(BAD_TOPIC, topic);
+        return false;
+    }
+    if (!m_connected && !m_reconnecting) {
+        print_error(NOT_CONN);
+        return false;
+    }
+
+    {
+        auto l_lock = api_lock();
+
+        // Check that not already subscribed
+        if (m_topics.find(topic) != nullptr) {
+            print_info(ALR_SUB, topic);
+            return false;
+        }
+        if (m_dispatching) {
+            m_topic_changes.push_back({ topic, true, std::move(handler) });
         }
+        else {
+            m_topics.insert(topic, std::move(handler));
+            m_topics_epoch++;
+        }
+        m_metrics.set(GAUGE_SUBSCRIPTIONS, m_topics.size() + m_topic_changes.size());
+    }
 
-        if (m_command == "-H") {
-            print_help();
-            continue;
+    OutMessage l_message;
+    l_message.buf = encode(OP_SUBSCRIBE, topic, "");
+    command_send(std::move(l_message));
+
+    // Exact topics are bound right away, so the server can deliver by ID
+    if (m_topic_ids && topic.find_first_of(TOPIC_SINGLE TOPIC_MULTI) == string::npos) {
+        TopicEntry* l_entry;
+        {
+            lock_guard<mutex> l_lock(m_ids_mutex);
+            l_entry = m_topic_table.get(m_topic_table.intern(topic));
         }
+        if (l_entry) { bind_topic(l_entry); }
+    }
+    return true;
+}
 
-        if (!m_connected) {
-            if (m_command == "CONNECT") {
-                connect_server();
-            }
-            else {
-                print_error(NOT_CONN);
-            }
+bool Client::unsubscribe(const string& topic) {
+
+    if (topic == "") {
+        print_error(EMPTY_TOPIC);
+        return false;
+    }
+    if (!m_connected && !m_reconnecting) {
+        print_error(NOT_CONN);
+        return false;
+    }
+
+    {
+        auto l_lock = api_lock();
+
+        // Check that already subscribed
+        if (m_topics.find(topic) == nullptr) {
+            print_info(NOT_SUB, topic);
+            return false;
+        }
+        if (m_dispatching) {
+            m_topic_changes.push_back({ topic, false, nullptr });
         }
         else {
-            if (m_command == "CONNECT") {
-                print_info(ALR_CONN);
-            }
-            else {
-                command_process();
-            }
+            m_topics.erase(topic);
+            m_topics_epoch++;
+        }
+        m_metrics.set(GAUGE_SUBSCRIPTIONS, m_topics.size());
+    }
+
+    OutMessage l_message;
+    l_message.buf = encode(OP_UNSUBSCRIBE, topic, "");
+    command_send(std::move(l_message));
+    return true;
+}
+
+void Client::set_framing(framing_enum framing) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_framing_request = framing;
+}
+
+void Client::set_compression(const CompressionSettings& settings) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_compress_request = settings.enabled;
+    m_compress_threshold = settings.threshold;
+    m_compress_level = clamp(settings.level, 1, 9);
+}
+
+void Client::set_publish_batching(const PublishBatching& settings) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_batch_request = settings;
+    m_batch_request.max_bytes = clamp<size_t>(settings.max_bytes, BUFFER_SIZE, MAX_FRAME_SIZE - FRAME_HEADER_SIZE);
+}
+
+void Client::set_reconnect(const ReconnectSettings& settings) {
+    auto l_lock = api_lock();
+    m_reconnect = settings;
+}
+
+void Client::set_connect_timeouts(const ConnectTimeouts& timeouts) {
+    auto l_lock = api_lock();
+    m_timeouts = timeouts;
+}
+
+bool Client::set_endpoint(const string& uri) {
+
+    auto l_lock = api_lock();
+    if (m_connected || m_reconnecting || m_connecting) {
+        print_info(ALR_CONN);
+        return false;
+    }
+    if (!m_endpoint.parse(uri)) {
+        print_error(WRONG_HOST, uri);
+        return false;
+    }
+    return true;
+}
+
+string Client::endpoint(void) {
+    auto l_lock = api_lock();
+    return m_endpoint.uri();
+}
+
+bool Client::set_spool(const SpoolSettings& settings) {
+
+    auto l_lock = api_lock();
+
+    // Records in flight stay in the files and are sent again by the next spool
+    m_spool_on = false;
+    m_spool_inflight = 0;
+    m_spool.close();
+    if (settings.dir == "") { return true; }
+
+    if (!m_spool.open(settings)) {
+        m_spool.close();
+        return false;
+    }
+    m_spool_on = true;
+    m_metrics.set(GAUGE_SPOOL_BYTES, m_spool.pending_bytes());
+    if (m_connected && !m_spool.empty()) {
+        m_notifier.force();
+    }
+    return true;
+}
+
+bool Client::set_dispatch(const DispatchSettings& settings) {
+
+    shared_ptr<Dispatcher> l_old;
+    {
+        auto l_lock = api_lock();
+        if (m_connected || m_reconnecting) {
+            print_info(ALR_CONN);
+            return false;
+        }
+
+        // Workers wake the socket loop when reads may resume and report the end of a batch
+        l_old = std::move(m_dispatcher);
+        if (settings.workers > 0) {
+            m_dispatcher = make_shared<Dispatcher>(settings, m_metrics,
+                [this]() { m_notifier.notify(); },
+                [this]() {
+                    lock_guard<recursive_mutex> l_lock(m_mutex);
+                    if (m_batch_handler) { m_batch_handler(); }
+                });
         }
+        m_topics_epoch++;
+    }
+
+    // Old workers may still run handlers that call back into the client
+    l_old.reset();
+    return true;
+}
+
+size_t Client::dispatch_workers(void) {
+    auto l_lock = api_lock();
+    return m_dispatcher ? m_dispatcher->workers() : 0;
+}
+
+void Client::set_topic_compression(const string& topic, bool enabled) {
+    unique_lock<shared_mutex> l_lock(m_plain_mutex);
+    if (enabled) {
+        m_plain_topics.erase(topic);
+    }
+    else {
+        m_plain_topics.emplace(topic, true);
     }
-}
\ No newline at end of file
+    m_plain_any = !m_plain_topics.empty();
+}
+
+void Client::set_default_handler(MessageHandler handler) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_default_handler = std::move(handler);
+    m_topics_epoch++;
+}
+
+void Client::set_batch_handler(BatchHandler handler) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_batch_handler = std::move(handler);
+}
+
+void Client::set_log_handler(LogHandler handler) {
+    lock_guard<recursive_mutex> l_lock(m_mutex);
+    m_log_handler = std::move(handler);
+}
@@ -8,7 +8,8 @@
 //******************************************************************************//
 // File    : client.h
 // Product : PubSubx
-// Brief   : CLient implementation of publish subscribe protocol in PubSubX
+// Brief   : CLient implementation of publish subscribe protocol in PubSubX,
+//           programmatic API of the pubsubx library
 // Ingroup : PubSubx
 // Version : 0.1
 // Updated : February 15 2022
@@ -29,6 +30,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
@@ -36,10 +38,35 @@
 #include <algorithm>
 #include <thread>
 #include <mutex> 
+#include <condition_variable>
 #include <chrono>
 #include <fcntl.h>
+#include <errno.h>
 #include <set>
 #include <deque>
+#include "SpscQueue.hpp"
+#include "Reactor.hpp"
+#include "Protocol.hpp"
+#include "Framer.hpp"
+#include "SendEngine.hpp"
+#include "BufferPool.hpp"
+#include "TopicIndex.hpp"
+#include "TopicTable.hpp"
+#include "Metrics.hpp"
+#include "Compression.hpp"
+#include "Spool.hpp"
+#include "Dispatcher.hpp"
+#include "Endpoint.hpp"
+#include "ShmRing.hpp"
+#include <string_view>
+#include <span>
+#include <functional>
+#include <map>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include <random>
+#include <future>
 
 using namespace std;
 
@@ -49,22 +76,219 @@ using namespace std;
 #define MAX_NAME_LEN 64         // Maximum length of client name
 #define BUFFER_SIZE 1024        // Size of the single receive / send buffer
 #define MAX_MESSAGE_SIZE ((10)*(BUFFER_SIZE))
-#define EOM "\n\nx"             // End of message string
+#define RECV_BUFFER_SIZE ((64)*(BUFFER_SIZE)) // Size of one socket read when draining the server socket
+#define CMD_QUEUE_SIZE 4096     // Capacity of the command loop -> socket loop ring
+#define OUT_HIGH_MESSAGES 65536 // Default outbound high water mark in messages
+#define OUT_HIGH_BYTES ((64) << (20)) // Default outbound high water mark in bytes
+#define PUBLISH_BATCH_BYTES (16384 - FRAME_HEADER_SIZE) // Default batch body, fits the largest pooled buffer
+#define PUBLISH_BATCH_MESSAGES 1024 // Default publishes per batch
+#define RECONNECT_INITIAL_MS 100    // Default first reconnect delay, doubled after every failed attempt
+#define RECONNECT_MAX_MS 10000      // Default longest reconnect delay
+#define RECONNECT_TIMEOUT_MS 5000   // Default time for connect and handshake of one attempt
+#define CONNECT_TIMEOUT_MS 5000     // Default time for the TCP connect
+#define HANDSHAKE_TIMEOUT_MS 5000   // Default time from CONNECT sent to the whole reply
+
+// Types of messages passed from API threads to socket loop
+enum out_type_enum {
+    OUT_MESSAGE,                // Protocol message that is queued for the server
+    OUT_DISCONNECT              // Flush queued messages and close the connection
+};
+
+// Owned message object carried by the inter-thread ring
+struct OutMessage {
+    out_type_enum type = OUT_MESSAGE;
+    bool          droppable = false;    // Publish that the overflow policy may evict
+    BufRef        buf;                  // Encoded message, pooled
+};
+
+// What publish does while the outbound queue is congested
+enum overflow_enum {
+    OVERFLOW_BLOCK,             // Wait until queue drains below low water marks (fails on socket thread)
+    OVERFLOW_FAIL,              // Return false, message is not queued
+    OVERFLOW_DROP_OLDEST,       // Queue message, oldest queued publishes are evicted
+    OVERFLOW_DROP_NEWEST        // Return true, message is silently dropped
+};
+
+// Queue is congested above either high water mark and relieved below both low ones
+struct OutboundLimits {
+    size_t high_messages = OUT_HIGH_MESSAGES;
+    size_t high_bytes = OUT_HIGH_BYTES;
+    size_t low_messages = OUT_HIGH_MESSAGES / 2;
+    size_t low_bytes = OUT_HIGH_BYTES / 2;
+    overflow_enum policy = OVERFLOW_BLOCK;
+};
+
+// Messages waiting for the server, in the ring and in the send engine
+struct OutboundState {
+    size_t messages;
+    size_t bytes;               // Encoded message bytes
+    size_t memory;              // Estimated heap use of the queue, fixed ring included
+    bool   congested;
+};
+
+// Payload compression requested in the next CONNECT, binary framing only
+struct CompressionSettings {
+    bool   enabled = false;
+    size_t threshold = COMPRESS_THRESHOLD;  // Smaller payloads are sent as they are
+    int    level = COMPRESS_LEVEL;          // zlib level 1 (fast) .. 9 (small)
+};
+
+// Publishes packed into OP_PUBLISH_BATCH frames, requested in the next CONNECT (binary framing only).
+// A batch is sent when full or linger after its first publish, zero linger sends every publish alone.
+struct PublishBatching {
+    chrono::microseconds linger{ 0 };
+    size_t max_bytes = PUBLISH_BATCH_BYTES;     // Publishes larger than half of it are sent alone
+    size_t max_messages = PUBLISH_BATCH_MESSAGES;
+};
+
+// Lost connection is reestablished by the socket loop, delays are jittered over their upper half
+struct ReconnectSettings {
+    bool   enabled = false;
+    chrono::milliseconds initial{ RECONNECT_INITIAL_MS };
+    chrono::milliseconds max{ RECONNECT_MAX_MS };
+    chrono::milliseconds timeout{ RECONNECT_TIMEOUT_MS };
+    size_t max_attempts = 0;                    // 0 retries until DISCONNECT
+};
+
+// Deadlines of the connection setup phases, run by the socket loop for connects and reconnects
+struct ConnectTimeouts {
+    chrono::milliseconds connect{ CONNECT_TIMEOUT_MS };
+    chrono::milliseconds handshake{ HANDSHAKE_TIMEOUT_MS };
+};
+
+// Error and info codes reported through print_error / print_info
+enum errors_enum {
+    INIT_FAIL, WRONG_PORT, WRONG_NAME, NAME_TAKEN, CONN_FAIL, WRONG_HOST, SEL_FAIL,
+    MSG_TOO_LONG, CONN_LOST, CONN_DOWN, NOT_CONN, WRONG_TOPIC,
+    EMPTY_TOPIC, BAD_TOPIC, WRONG_CMD, NO_RSP, UNKNOWN_RSP, EXCEPTION, RECONN_FAIL, CONN_TIMEOUT, MAX_ERRORS
+};
+
+enum infos_enum {
+    CONN_ACC, ALR_CONN, ALR_SUB, NOT_SUB, CONN_RESTORED, NO_REACTOR, SEND_STATS, RECONNECTING, NO_LINK, MAX_INFOS
+};
+
+// Called on the socket thread, or a dispatch worker, for every received message, once per
+// matching subscription
+using MessageHandler = function<void(string_view topic, span<const byte> payload)>;
 
-const vector<string> commands = { "-H", "CONNECT", "DISCONNECT", "PUBLISH", "SUBSCRIBE", "UNSUBSCRIBE" };
+// Called on the socket thread after a batch of received messages is dispatched, with dispatch
+// workers on the worker that handled the last queued message
+using BatchHandler = function<void(void)>;
+
+// Called once when a connect_async is done, on the socket thread unless refused at once
+using ConnectHandler = function<void(bool connected)>;
+
+// Receives error / info lines, default is printing them to cout
+using LogHandler = function<void(bool is_error, const string& text)>;
+
+
+// Subscription change requested by a handler while topics are being matched
+struct TopicChange {
+    string         topic;           // Empty topic on unsubscribe removes all topics
+    bool           subscribe;
+    MessageHandler handler;
+};
 
 
 /******************************************************************************/
 /**********************          CLIENT CLASS           ***********************/
 /******************************************************************************/
+// Programmatic API is thread safe. Handlers run on the socket thread, or on
+// the dispatch workers if set, and may call back into the client.
 class Client {
 
 public:
-    // Creator 
-    Client(string server_name);
+    // Creator, server_name is a host name or address, "tcp://host:port" or "unix:///path.sock"
+    Client(string server_name, reactor_type_enum reactor = REACTOR_EPOLL);
+    ~Client();
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // Connection, connect blocks until handshake is done or failed. connect_async returns at once,
+    // the socket thread resolves, connects and does the handshake within the connect timeouts.
+    // Its handler must not start another connect. disconnect also aborts a connect in progress.
+    // Port of the endpoint wins over the port argument, which may then be 0, unix ignores both.
+    bool connect(int port, const string& name);
+    bool connect(const string& name) { return connect(0, name); }
+    void connect_async(int port, const string& name, ConnectHandler handler);
+    future<bool> connect_async(int port, const string& name);
+    void disconnect(void);
+    bool connected(void) const { return m_connected; }
+    bool connecting(void) const { return m_connecting; }
+    void set_connect_timeouts(const ConnectTimeouts& timeouts);
+
+    // Server endpoint, false if uri is malformed or a connection is up or being set up
+    bool set_endpoint(const string& uri);
+    string endpoint(void);
+
+    // Automatic reconnect of a lost connection. Meanwhile publish, subscribe and unsubscribe
+    // are queued for the new connection, subscriptions are sent again if the session is gone.
+    void set_reconnect(const ReconnectSettings& settings);
+    bool reconnecting(void) const { return m_reconnecting; }
+
+    // Messaging
+    bool publish(string_view topic, span<const byte> payload);
+    bool publish(string_view topic, string_view payload) {
+        return publish(topic, as_bytes(span<const char>(payload.data(), payload.size())));
+    }
+
+    // Interned topics, publishing by ID skips the topic name lookup
+    uint16_t topic_id(string_view topic);  // NO_TOPIC_ID if table is full
+    bool publish(uint16_t topic_id, span<const byte> payload);
+    bool publish(uint16_t topic_id, string_view payload) {
+        return publish(topic_id, as_bytes(span<const char>(payload.data(), payload.size())));
+    }
+    bool subscribe(const string& topic, MessageHandler handler);
+    bool unsubscribe(const string& topic);
+
+    // Framing requested in the next CONNECT, text is used if server does not confirm binary
+    void set_framing(framing_enum framing);
+    framing_enum framing(void) const { return m_framing; }
+
+    // Compression requested in the next CONNECT, used only if the server confirms it.
+    // Every topic is compressed unless switched off by its exact name.
+    void set_compression(const CompressionSettings& settings);
+    void set_topic_compression(const string& topic, bool enabled);
+    bool compressing(void) const { return m_compress; }
+
+    // Publish batching requested in the next CONNECT, used only if the server confirms it
+    void set_publish_batching(const PublishBatching& settings);
+    bool batching(void) const { return m_batching; }
+
+    // Publishes made while disconnected or congested go to a file spool in settings.dir and are
+    // sent once the queue is written again, records left by an earlier run included. Empty dir
+    // closes the spool. False if the directory can not be used.
+    bool set_spool(const SpoolSettings& settings);
+    bool spooling(void) const { return m_spool_on; }
+
+    // Handlers run on settings.workers threads, messages of one topic one at a time and in order,
+    // different topics in parallel. Socket reads pause while queued payloads exceed the high mark.
+    // Zero workers runs handlers on the socket thread. False while connected.
+    bool   set_dispatch(const DispatchSettings& settings);
+    size_t dispatch_workers(void);
+
+    // Handlers
+    void set_default_handler(MessageHandler handler);   // Used for topics restored by the server
+    void set_batch_handler(BatchHandler handler);
+    void set_log_handler(LogHandler handler);
+
+    // Commands queued while corked wake the socket loop once, on uncork (or when the ring fills)
+    void cork(void) { m_corked = true; }
+    void uncork(void) { m_corked = false; m_notifier.notify(); }
+
+    // Outbound budget and backpressure state, limits apply to publishes only
+    void set_outbound_limits(const OutboundLimits& limits);
+    OutboundLimits outbound_limits(void);
+    OutboundState outbound_state(void) const;
+    bool congested(void) const { return m_congested; }
+
+    // Counters and histograms of the socket loop, cheap enough to scrape periodically
+    MetricsSnapshot stats(void) const { return m_metrics.snapshot(); }
 
-    // Main command loop 
-    void command_loop(void);
+    // Print functions
+    void print_error(uint16_t errnum, string msg = "");
+    void print_info(uint16_t infonum, string msg = "");
 
 
     /******************************************************************************/
@@ -73,81 +297,174 @@ public:
 private:
 
     // Basic server data 
-    string m_server_name;           // Server host to connet to
-    int    m_server_port;           // Server port number to connect to
+    Endpoint m_endpoint;            // Server to connect to, its addresses are resolved once
+    int    m_server_port;           // Server port number to connect to, unused for unix endpoints
     int    m_server_socket;         // Server socket file descriptor
-    struct sockaddr_in m_server_addr;// Server address strucutre 
-
-    // Command data
-    string m_command;               // Input command
-    string m_arg1;                  // Input argument 1  
-    string m_arg2;                  // Input argument 2
-
-    // Inter-thread communication sockets
-    int    m_listen_sock;           // Listening socket for communication establishment
-    int    m_listen_port;           // Local listening port number
-
-    int    m_msg_in_sock;           // Input end of the message sockets, on command loop side
-    int    m_close_in_sock;         // Input end of close signal socket, on command loop side
-
-    int    m_msg_out_sock;          // Output end of the message sockets, on socket loop side
-    int    m_close_out_sock;        // Output end of close signal socket, on socket loop side
+    unique_ptr<ShmLink> m_link;     // Shared memory link, frames bypass the socket while set
+
+    // Reconnect settings are read by the socket loop under m_mutex
+    ReconnectSettings m_reconnect;
+    ConnectTimeouts   m_timeouts;
+    atomic<bool> m_reconnecting{ false };
+    minstd_rand  m_jitter{ random_device{}() };
+
+    // Outgoing messages are encoded into pooled buffers, the pool outlives every queue
+    BufferPool m_pool;
+
+    // Inter-thread communication, API threads produce and socket loop consumes
+    SpscQueue<OutMessage> m_cmd_queue;  // Ring of messages for the socket loop
+    EventNotifier m_notifier;           // Wakes the socket loop when ring is filled
+    mutex  m_producer_mutex;            // Serializes producers of the single producer ring
+    atomic<bool> m_corked{ false };     // Producers skip the wakeup
+
+    // Open publish batch, protected by m_producer_mutex, so it reaches the ring in publish order
+    BufRef   m_batch;                   // Header is written when the batch is closed
+    size_t   m_batch_records = 0;
+    atomic<uint64_t> m_batch_deadline{ 0 }; // Steady ns when the open batch is due, 0 if none
+    atomic<size_t>   m_batch_bytes{ 0 };    // Size of the open batch
+    atomic<bool>     m_batch_due{ false };  // Linger is over but the socket loop found the ring busy
+    PublishBatching  m_batch_request;   // Protected by m_mutex
+    atomic<bool>     m_batching{ false };
+    atomic<uint64_t> m_linger_ns{ 0 };
+    atomic<size_t>   m_batch_max_bytes{ PUBLISH_BATCH_BYTES };
+    atomic<size_t>   m_batch_max_messages{ PUBLISH_BATCH_MESSAGES };
+
+    // Offline spool, records handed to the send engine are consumed once it is written (socket thread)
+    Spool        m_spool;
+    atomic<bool> m_spool_on{ false };
+    size_t       m_spool_inflight = 0;
+
+    // Outbound accounting, ring counters are changed by both sides, sender ones by socket loop
+    atomic<size_t> m_ring_messages{ 0 };
+    atomic<size_t> m_ring_bytes{ 0 };
+    atomic<size_t> m_sender_messages{ 0 };
+    atomic<size_t> m_sender_bytes{ 0 };
+    atomic<bool>   m_congested{ false };
+    atomic<size_t> m_high_messages{ OUT_HIGH_MESSAGES };   // Copies of m_limits read without lock
+    atomic<size_t> m_high_bytes{ OUT_HIGH_BYTES };
+    atomic<overflow_enum> m_policy{ OVERFLOW_BLOCK };
+    OutboundLimits m_limits;            // Protected by m_bp_mutex
+    mutex  m_bp_mutex;
+    condition_variable m_bp_cv;         // Blocked publishers wait for relief or disconnect
 
     // Socket thread data
     thread m_socket_thread;         // Thread class          
-    mutex  m_mutex;                 // Mutex to avoid race conditions between socket and command loop
-
-    // Connection flag
-    bool   m_connected;
+    unique_ptr<Reactor> m_reactor;  // Event loop backend used by socket thread
+    bool   m_want_write = false;    // Write interest registered in reactor
+    bool   m_writable = false;      // Server socket accepts more data (until EAGAIN)
+    bool   m_close_pending = false; // Disconnect requested from a handler
+    bool   m_read_paused = false;   // Reads wait for the dispatch workers to catch up
+    recursive_mutex m_mutex;        // Protects topics and handlers, held by socket loop while dispatching
+
+    // Connection flags, the handler of a connect in progress is taken by the socket thread
+    atomic<bool> m_connected{ false };
+    atomic<bool> m_connecting{ false };
+    ConnectHandler m_connect_handler;
+
+    // Framing requested by application and negotiated with server
+    framing_enum m_framing_request = FRAMING_TEXT;
+    atomic<framing_enum> m_framing{ FRAMING_TEXT };
+    atomic<bool> m_topic_ids{ false };  // Server accepts topic ID bindings (binary framing only)
+
+    // Compression requested by application and negotiated with server, settings are read without lock
+    bool           m_compress_request = false;
+    atomic<bool>   m_compress{ false };
+    atomic<size_t> m_compress_threshold{ COMPRESS_THRESHOLD };
+    atomic<int>    m_compress_level{ COMPRESS_LEVEL };
+    shared_mutex   m_plain_mutex;       // Protects m_plain_topics
+    unordered_map<string, bool, TopicHash, equal_to<>> m_plain_topics; // Topics never compressed
+    atomic<bool>   m_plain_any{ false };// m_plain_topics is not empty
+
+    // Sequence numbers negotiated with server, last seen per topic is kept over reconnects
+    // for the resume of a restored session (socket thread only)
+    bool m_seq = false;
+    unordered_map<string, uint64_t, TopicHash, equal_to<>> m_last_seq;
+
+    // Interned topics, entries are protected by m_ids_mutex except the handler cache (m_mutex)
+    using TopicEntry = TopicTable<MessageHandler>::Entry;
+    TopicTable<MessageHandler> m_topic_table;
+    mutex    m_ids_mutex;
+    uint64_t m_topics_epoch = 1;        // Bumped on every change of m_topics, invalidates handler caches
 
     // Client name and topics/messages attributes
     string        m_name;            // Name of the client
-    set<string>   m_topics;          // Set of subscribed topics
-    deque<string> m_out_messages;    // Queue of ooutgoing messages
-    string        m_receive_stream;  // Input receive stream
+    TopicIndex<MessageHandler> m_topics; // Subscribed topic filters, wildcards + and # allowed
+    bool          m_dispatching = false; // Socket loop is walking m_topics
+    vector<TopicChange> m_topic_changes; // Subscriptions changed by handlers during dispatch
+    MessageHandler m_default_handler;
+    BatchHandler  m_batch_handler;
+    LogHandler    m_log_handler;
+    SendEngine    m_sender{ EOM, BUFFER_SIZE - strlen(EOM) }; // Queue of ooutgoing messages
+    Framer        m_framer{ EOM };   // Input receive stream split into frames
+    Metrics       m_metrics;
+
+    // Dispatch workers, replaced only while disconnected and stopped outside m_mutex
+    shared_ptr<Dispatcher> m_dispatcher;
 
 
 /******************************************************************************/
 /********************          CLIENT OPERATIONS          *********************/
 /******************************************************************************/
 
-    // Print functions
-    void print_help(void);
-    void print_error(uint16_t errnum, string msg = "");
-    void print_info(uint16_t infonum, string msg = "");
-
-    // Command functions    
-    bool command_parse(string input);
-    void command_process(void);
-    void command_disconnect(void);
-    void command_publish(void);
-    void command_subscribe(void);
-    void command_unsubscribe(void);
-
-
     // Connection establishment functions
-    bool connect_args_check(void);
-    void connect_server(void);
+    bool connect_args_check(int port, const string& name);
+    bool connect_server(int port, const string& name, ConnectHandler& handler); // Starts the socket thread
+    bool connect_open(bool reconnect);                          // Resolve and start a nonblocking connect
+    int  connect_setup(uint64_t deadline, bool reconnect);      // Socket thread: connect and handshake phases
+    string connect_request(const string& name);                 // CONNECT message with requested options
+    bool connect_reply_complete(string_view reply);             // Whole reply received, topic list included
+    bool connect_handshake(string_view reply, bool reconnect);  // Apply the reply, false if refused
+    void connect_framing(framing_enum framing, string_view options, bool keep_ids);   // Options are the tags of the reply
     void connect_accept(void);
-    void connect_restore(char* str);
+    void connect_restore(const char* str, size_t size);
 
-    // Socket functions 
-    void socket_server_init(void);      // Initialize main server socket
-    void socket_listen_init(void);      // Initialize listening socket for inter thread communication
-    void socket_inter_init(void);       // Initialize inter thread sockets 
+    unique_lock<recursive_mutex> api_lock(void);   // Lock m_mutex from API call, time spent waiting is recorded
 
-    void socket_command_msg(void);      // Message sent from command loop to socket loop
-    void socket_close_msg(void);        // Close message sent from command loop to socket loop
-    void socket_server_msg(void);       // Message sent from server
-    bool socket_write(void);            // Write message to server, returns true if last message is sent
+    // Socket functions 
+    bool socket_server_init(void);      // Socket for the current endpoint address
+
+    // Setup on the socket thread, waits and setup return 1 when ready, 0 at the deadline and -1 on DISCONNECT
+    bool socket_reconnect(void);        // False if given up or disconnected
+    int  setup_wait(int fd, uint64_t deadline);
+    void reconnect_burst(bool restored);// Bindings and subscriptions ahead of the queue
+
+    void command_send(OutMessage&& msg);// Hand a message from API thread to socket loop
+    bool command_push(OutMessage& msg, bool wait); // Push into the ring, m_producer_mutex held, false if full
+    bool batch_publish(uint16_t topic_id, string_view topic, string_view payload); // False if sent alone
+    bool batch_close(bool wait);        // Open batch into the ring, m_producer_mutex held
+    bool spool_publish(string_view topic, string_view payload);    // False if not spooled
+    bool spool_drain(void);             // Next spooled records into the send engine, false if none
+    BufRef encode(opcode_enum opcode, string_view topic, string_view payload); // Command in negotiated framing
+    BufRef encode_compressed(uint16_t topic_id, string_view topic, string_view payload); // Empty if payload does not shrink
+    bool   topic_compressed(string_view topic);
+    bool outbound_admit(overflow_enum policy); // Apply policy to a publish on congested queue, false if not queued
+    void outbound_check(void);          // Enter congested state above a high water mark
+    void outbound_update(void);         // Socket loop: evict, publish sender counters, relieve
+    void outbound_relieve(void);        // Leave congested state below low water marks, m_bp_mutex held
+    bool on_socket_thread(void) const;  // True when called from a handler
+    bool socket_command_msg(void);      // Drain messages sent from API threads, returns true on close
+    void socket_close_msg(void);        // Close message sent from API thread to socket loop
+    bool socket_server_msg(void);       // Drain messages sent from server, returns false if connection is down
+    bool socket_write(void);            // Write messages to server until EAGAIN, returns true if last message is sent
+    void socket_flush(void);            // Blocking write of everything that is queued
+    void socket_interest(void);         // Reactor interest of the server socket, none with a link
+    void link_close(void);              // Drops the shared memory link of a connection that is gone
 
     void socket_loop(void);             // Main socket loop function
 
     // IO messages functions
-    void process_message_chunk(char* msg_chunk, int size, bool from_restore);
-    void print_received_message(string msg);
-    string get_send_chunk(bool* last);
+    void process_message_chunk(const char* msg_chunk, size_t size, bool from_restore);
+    void process_frames(bool from_restore);
+    void dispatch_message(string_view msg);
+    void dispatch_bound(string_view topic, span<const byte> payload, TopicEntry* entry);
+    void dispatch_pooled(string_view topic, span<const byte> payload, BufRef&& plain);
+    void apply_topic_changes(void);
+    void topic_bound(string_view topic, string_view payload);
+    bool sequence_check(string_view topic, uint64_t seq, bool replayed);  // False for a duplicate
+    bool resume_send(void);
+    bool publish_entry(TopicEntry* entry, string_view topic, span<const byte> payload);
+    bool bind_topic(TopicEntry* entry);   // True while topic must still be sent by name
 
 };
 
-#endif
\ No newline at end of file
+#endif
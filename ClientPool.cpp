@@ -0,0 +1,277 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : ClientPool.cpp
+// Product : PubSubx
+// Brief   : Connections to several brokers with topics routed by consistent hashing
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "ClientPool.hpp"
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+ClientPool::ClientPool(const vector<BrokerAddress>& brokers, reactor_type_enum reactor)
+    :m_brokers(brokers)
+{
+    for (size_t i = 0; i < m_brokers.size(); i++) {
+        m_clients.push_back(make_unique<Client>(m_brokers[i].host, reactor));
+
+        // Points depend only on the address and how often it repeats before
+        m_repeats.push_back(count_if(m_brokers.begin(), m_brokers.begin() + i, [&](const BrokerAddress& broker) {
+            return broker.host == m_brokers[i].host && broker.port == m_brokers[i].port;
+        }));
+        string l_key = m_brokers[i].host + ":" + to_string(m_brokers[i].port) + "#" + to_string(m_repeats[i]) + "/";
+        for (int v = 0; v < POOL_VNODES; v++) {
+            m_ring.push_back({ hash(l_key + to_string(v)), i });
+        }
+    }
+    sort(m_ring.begin(), m_ring.end());
+}
+
+ClientPool::~ClientPool() {
+    disconnect();
+}
+
+
+/******************************************************************************/
+/*********************          ROUTING FUNCTIONS          ********************/
+/******************************************************************************/
+uint64_t ClientPool::hash(string_view key) {
+
+    // FNV-1a, then a finalizer that spreads short similar keys over the ring
+    uint64_t l_hash = 14695981039346656037ULL;
+    for (char c : key) {
+        l_hash = (l_hash ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    l_hash ^= l_hash >> 33;
+    l_hash *= 0xff51afd7ed558ccdULL;
+    l_hash ^= l_hash >> 33;
+    l_hash *= 0xc4ceb9fe1a85ec53ULL;
+    l_hash ^= l_hash >> 33;
+    return l_hash;
+}
+
+size_t ClientPool::hashed_route(string_view topic) const {
+
+    if (m_ring.empty()) { return 0; }
+
+    // First point clockwise from the topic
+    auto l_it = lower_bound(m_ring.begin(), m_ring.end(), make_pair(hash(topic), (size_t)0));
+    if (l_it == m_ring.end()) { l_it = m_ring.begin(); }
+    return l_it->second;
+}
+
+size_t ClientPool::route(string_view topic) const {
+    {
+        shared_lock<shared_mutex> l_lock(m_routes_lock);
+        auto l_it = m_routes.find(topic);
+        if (l_it != m_routes.end()) { return l_it->second; }
+    }
+    return hashed_route(topic);
+}
+
+void ClientPool::set_route(const string& topic, size_t connection) {
+
+    if (connection >= m_clients.size()) { return; }
+    {
+        unique_lock<shared_mutex> l_lock(m_routes_lock);
+        m_routes[topic] = connection;
+    }
+    move_subscription(topic, connection);
+}
+
+void ClientPool::clear_route(const string& topic) {
+    {
+        unique_lock<shared_mutex> l_lock(m_routes_lock);
+        if (!m_routes.erase(topic)) { return; }
+    }
+    move_subscription(topic, hashed_route(topic));
+}
+
+void ClientPool::move_subscription(const string& topic, size_t connection) {
+
+    // Clients are called without m_subs_lock, handlers may use the pool as well
+    size_t l_previous;
+    MessageHandler l_handler;
+    {
+        lock_guard<mutex> l_lock(m_subs_lock);
+        auto l_it = m_subscriptions.find(topic);
+        if (l_it == m_subscriptions.end() || l_it->second.connection == SIZE_MAX
+            || l_it->second.connection == connection) {
+            return;
+        }
+        l_previous = l_it->second.connection;
+        l_handler = l_it->second.handler;
+        l_it->second.connection = connection;
+    }
+
+    // Messages in flight during the move may be lost
+    m_clients[l_previous]->unsubscribe(topic);
+    m_clients[connection]->subscribe(topic, std::move(l_handler));
+}
+
+
+/******************************************************************************/
+/*******************          CONNECTION FUNCTIONS          *******************/
+/******************************************************************************/
+bool ClientPool::connect(const string& name) {
+
+    // Brokers are connected in parallel, each by its own socket thread
+    vector<future<bool>> l_pending;
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        string l_name = m_repeats[i] ? name + "-" + to_string(m_repeats[i]) : name;
+        if (!m_clients[i]->connected() && !m_clients[i]->reconnecting()) {
+            l_pending.push_back(m_clients[i]->connect_async(m_brokers[i].port, l_name));
+        }
+    }
+
+    bool l_all = true;
+    for (future<bool>& l_connected : l_pending) {
+        l_all = l_connected.get() && l_all;
+    }
+    return l_all;
+}
+
+void ClientPool::disconnect(void) {
+    for (auto& l_client : m_clients) {
+        l_client->disconnect();
+    }
+    lock_guard<mutex> l_lock(m_subs_lock);
+    m_subscriptions.clear();
+}
+
+size_t ClientPool::connected(void) const {
+    return count_if(m_clients.begin(), m_clients.end(), [](const unique_ptr<Client>& client) {
+        return client->connected();
+    });
+}
+
+
+/******************************************************************************/
+/*********************          API FUNCTIONS          ************************/
+/******************************************************************************/
+bool ClientPool::publish(string_view topic, span<const byte> payload) {
+    if (m_clients.empty()) { return false; }
+    return m_clients[route(topic)]->publish(topic, payload);
+}
+
+bool ClientPool::subscribe(const string& topic, MessageHandler handler) {
+
+    if (m_clients.empty()) { return false; }
+
+    // Wildcard filter may match topics routed to any connection
+    bool l_wildcard = topic.find_first_of(TOPIC_SINGLE TOPIC_MULTI) != string::npos;
+    size_t l_connection = l_wildcard ? SIZE_MAX : route(topic);
+    {
+        lock_guard<mutex> l_lock(m_subs_lock);
+        if (!m_subscriptions.emplace(topic, PoolSubscription{ l_connection, handler }).second) {
+            m_clients[0]->print_info(ALR_SUB, topic);
+            return false;
+        }
+    }
+
+    bool l_all = true;
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        if (l_wildcard ? m_repeats[i] == 0 : i == l_connection) {
+            l_all = m_clients[i]->subscribe(topic, handler) && l_all;
+        }
+    }
+
+    // Failed exact subscription is forgotten, a wildcard one stays where it succeeded
+    if (!l_all && !l_wildcard) {
+        lock_guard<mutex> l_lock(m_subs_lock);
+        m_subscriptions.erase(topic);
+    }
+    return l_all;
+}
+
+bool ClientPool::unsubscribe(const string& topic) {
+
+    if (m_clients.empty()) { return false; }
+
+    size_t l_connection;
+    {
+        lock_guard<mutex> l_lock(m_subs_lock);
+        auto l_it = m_subscriptions.find(topic);
+        if (l_it == m_subscriptions.end()) {
+            m_clients[0]->print_info(NOT_SUB, topic);
+            return false;
+        }
+        l_connection = l_it->second.connection;
+        m_subscriptions.erase(l_it);
+    }
+
+    bool l_all = true;
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        if (l_connection == SIZE_MAX ? m_repeats[i] == 0 : i == l_connection) {
+            l_all = m_clients[i]->unsubscribe(topic) && l_all;
+        }
+    }
+    return l_all;
+}
+
+void ClientPool::set_framing(framing_enum framing) {
+    for (auto& l_client : m_clients) { l_client->set_framing(framing); }
+}
+
+void ClientPool::set_default_handler(MessageHandler handler) {
+    for (auto& l_client : m_clients) { l_client->set_default_handler(handler); }
+}
+
+void ClientPool::set_batch_handler(BatchHandler handler) {
+    for (auto& l_client : m_clients) { l_client->set_batch_handler(handler); }
+}
+
+void ClientPool::set_log_handler(LogHandler handler) {
+    for (auto& l_client : m_clients) { l_client->set_log_handler(handler); }
+}
+
+void ClientPool::set_outbound_limits(const OutboundLimits& limits) {
+    for (auto& l_client : m_clients) { l_client->set_outbound_limits(limits); }
+}
+
+void ClientPool::set_reconnect(const ReconnectSettings& settings) {
+    for (auto& l_client : m_clients) { l_client->set_reconnect(settings); }
+}
+
+void ClientPool::set_connect_timeouts(const ConnectTimeouts& timeouts) {
+    for (auto& l_client : m_clients) { l_client->set_connect_timeouts(timeouts); }
+}
+
+bool ClientPool::set_dispatch(const DispatchSettings& settings) {
+    bool l_all = true;
+    for (auto& l_client : m_clients) { l_all = l_client->set_dispatch(settings) && l_all; }
+    return l_all;
+}
+
+vector<ConnectionHealth> ClientPool::health(void) const {
+
+    vector<ConnectionHealth> l_health(m_clients.size());
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        l_health[i].broker = m_brokers[i];
+        l_health[i].connected = m_clients[i]->connected();
+        l_health[i].topics = 0;
+        l_health[i].outbound = m_clients[i]->outbound_state();
+        l_health[i].metrics = m_clients[i]->stats();
+    }
+
+    lock_guard<mutex> l_lock(m_subs_lock);
+    for (const auto& [l_topic, l_sub] : m_subscriptions) {
+        if (l_sub.connection != SIZE_MAX) {
+            l_health[l_sub.connection].topics++;
+        }
+    }
+    return l_health;
+}
@@ -0,0 +1,128 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : ClientPool.hpp
+// Product : PubSubx
+// Brief   : Connections to several brokers with topics routed by consistent hashing
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_CLIENT_POOL_H
+#define PUBSUBX_CLIENT_POOL_H
+
+#include "Client.hpp"
+
+#include <shared_mutex>
+#include <unordered_map>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define POOL_VNODES 128         // Points of every connection on the hash ring
+
+// Host may be an endpoint uri, port is then ignored if the uri has one (or is unix)
+struct BrokerAddress {
+    string host;
+    int    port;
+};
+
+// State of one pooled connection, used to decide on rebalancing
+struct ConnectionHealth {
+    BrokerAddress   broker;
+    bool            connected;
+    size_t          topics;         // Exact topic subscriptions routed to this connection
+    OutboundState   outbound;
+    MetricsSnapshot metrics;
+};
+
+
+/******************************************************************************/
+/********************          CLIENT POOL CLASS           ********************/
+/******************************************************************************/
+// One Client, with its own socket thread, per broker address. Every exact
+// topic lives on one connection, chosen by an explicit route or by a hash
+// ring that only depends on the broker list, so processes configured with
+// the same brokers agree on it. Wildcard filters may match topics of every
+// connection and are subscribed once on every distinct broker. Handlers run on the socket
+// thread, or the dispatch workers, of the connection that received the message.
+class ClientPool {
+
+public:
+    ClientPool(const vector<BrokerAddress>& brokers, reactor_type_enum reactor = REACTOR_EPOLL);
+    ~ClientPool();
+
+    ClientPool(const ClientPool&) = delete;
+    ClientPool& operator=(const ClientPool&) = delete;
+
+    // Connects every broker in parallel, second connection to the same broker gets name-1 and
+    // so on. Returns true if all connections are up.
+    bool   connect(const string& name);
+    void   disconnect(void);
+    size_t connected(void) const;
+
+    // Messaging, routed by topic
+    bool publish(string_view topic, span<const byte> payload);
+    bool publish(string_view topic, string_view payload) {
+        return publish(topic, as_bytes(span<const char>(payload.data(), payload.size())));
+    }
+    bool subscribe(const string& topic, MessageHandler handler);
+    bool unsubscribe(const string& topic);
+
+    // Routing, an explicit route moves a live subscription to the new connection
+    size_t route(string_view topic) const;
+    void   set_route(const string& topic, size_t connection);
+    void   clear_route(const string& topic);
+
+    // Settings applied to every connection
+    void set_framing(framing_enum framing);
+    void set_default_handler(MessageHandler handler);
+    void set_batch_handler(BatchHandler handler);
+    void set_log_handler(LogHandler handler);
+    void set_outbound_limits(const OutboundLimits& limits);
+    void set_reconnect(const ReconnectSettings& settings);
+    void set_connect_timeouts(const ConnectTimeouts& timeouts);
+    bool set_dispatch(const DispatchSettings& settings);   // Workers of every connection, false while connected
+
+    size_t  size(void) const { return m_clients.size(); }
+    Client& connection(size_t index) { return *m_clients[index]; }
+    vector<ConnectionHealth> health(void) const;
+
+    // Stable 64 bit hash of ring points and topics
+    static uint64_t hash(string_view key);
+
+private:
+    struct PoolSubscription {
+        size_t         connection;      // SIZE_MAX for wildcard filters subscribed on every broker
+        MessageHandler handler;
+    };
+
+    vector<BrokerAddress>       m_brokers;
+    vector<unique_ptr<Client>>  m_clients;
+    vector<size_t>              m_repeats;  // Earlier connections to the same broker
+    vector<pair<uint64_t, size_t>> m_ring;  // Sorted hash points and their connection
+
+    mutable shared_mutex m_routes_lock;     // Protects m_routes, read on every publish
+    unordered_map<string, size_t, TopicHash, equal_to<>> m_routes;
+
+    mutable mutex m_subs_lock;              // Protects m_subscriptions
+    unordered_map<string, PoolSubscription> m_subscriptions;
+
+    size_t hashed_route(string_view topic) const;
+    void   move_subscription(const string& topic, size_t connection);
+};
+
+#endif
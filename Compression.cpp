@@ -0,0 +1,133 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Compression.cpp
+// Product : PubSubx
+// Brief   : Payload compression of binary frames
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Compression.hpp"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#ifdef PUBSUBX_HAVE_ZLIB
+#include <zlib.h>
+
+// Streams of one thread, reset between payloads instead of reallocated
+struct ZlibStreams {
+    z_stream deflate_stream = {};
+    z_stream inflate_stream = {};
+    int      level = -1;            // Level of deflate_stream, -1 before first use
+    bool     inflate_ready = false;
+
+    ~ZlibStreams() {
+        if (level >= 0) { deflateEnd(&deflate_stream); }
+        if (inflate_ready) { inflateEnd(&inflate_stream); }
+    }
+};
+
+static thread_local ZlibStreams t_streams;
+#endif
+
+
+/******************************************************************************/
+/*****************          COMPRESSION FUNCTIONS          ********************/
+/******************************************************************************/
+bool compression_available(void) {
+#ifdef PUBSUBX_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t compress_bound(size_t size) {
+#ifdef PUBSUBX_HAVE_ZLIB
+    return COMPRESS_HEADER_SIZE + deflateBound(nullptr, size);
+#else
+    return COMPRESS_HEADER_SIZE + size;
+#endif
+}
+
+size_t compress_payload(std::string_view payload, int level, char* out) {
+#ifdef PUBSUBX_HAVE_ZLIB
+    ZlibStreams& l_streams = t_streams;
+    z_stream& l_stream = l_streams.deflate_stream;
+
+    // Raw deflate, the frame already carries length and the transport checksums
+    if (l_streams.level != level) {
+        if (l_streams.level >= 0) { deflateEnd(&l_stream); }
+        l_stream = {};
+        if (deflateInit2(&l_stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            l_streams.level = -1;
+            return 0;
+        }
+        l_streams.level = level;
+    }
+    else {
+        deflateReset(&l_stream);
+    }
+
+    uint32_t l_size = htonl((uint32_t)payload.size());
+    memcpy(out, &l_size, COMPRESS_HEADER_SIZE);
+
+    l_stream.next_in = (Bytef*)payload.data();
+    l_stream.avail_in = payload.size();
+    l_stream.next_out = (Bytef*)out + COMPRESS_HEADER_SIZE;
+    l_stream.avail_out = deflateBound(&l_stream, payload.size());
+    if (deflate(&l_stream, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+
+    size_t l_packed = COMPRESS_HEADER_SIZE + l_stream.total_out;
+    return l_packed < payload.size() ? l_packed : 0;
+#else
+    (void)payload; (void)level; (void)out;
+    return 0;
+#endif
+}
+
+size_t decompressed_size(std::string_view packed) {
+    uint32_t l_size;
+    if (packed.size() <= COMPRESS_HEADER_SIZE) { return 0; }
+    memcpy(&l_size, packed.data(), COMPRESS_HEADER_SIZE);
+    return ntohl(l_size);
+}
+
+bool decompress_payload(std::string_view packed, char* out, size_t size) {
+#ifdef PUBSUBX_HAVE_ZLIB
+    ZlibStreams& l_streams = t_streams;
+    z_stream& l_stream = l_streams.inflate_stream;
+
+    if (!l_streams.inflate_ready) {
+        if (inflateInit2(&l_stream, -15) != Z_OK) { return false; }
+        l_streams.inflate_ready = true;
+    }
+    else {
+        inflateReset(&l_stream);
+    }
+
+    l_stream.next_in = (Bytef*)packed.data() + COMPRESS_HEADER_SIZE;
+    l_stream.avail_in = packed.size() - COMPRESS_HEADER_SIZE;
+    l_stream.next_out = (Bytef*)out;
+    l_stream.avail_out = size;
+
+    // Stream must end exactly at the announced size
+    return inflate(&l_stream, Z_FINISH) == Z_STREAM_END && l_stream.total_out == size
+        && l_stream.avail_in == 0;
+#else
+    (void)packed; (void)out; (void)size;
+    return false;
+#endif
+}
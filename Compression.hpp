@@ -0,0 +1,62 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Compression.hpp
+// Product : PubSubx
+// Brief   : Payload compression of binary frames
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_COMPRESSION_H
+#define PUBSUBX_COMPRESSION_H
+
+#include <string_view>
+#include <cstddef>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define COMPRESS_HEADER_SIZE 4  // Big endian size of the original payload
+#define COMPRESS_THRESHOLD 1024 // Default smallest payload that is compressed
+#define COMPRESS_LEVEL 1        // Default zlib level, fastest
+
+
+/******************************************************************************/
+/*****************          COMPRESSION FUNCTIONS          ********************/
+/******************************************************************************/
+// Compressed payload is the original size followed by a raw deflate stream.
+// Every thread keeps its own zlib streams, so calls never allocate once warm.
+// Without zlib (PUBSUBX_HAVE_ZLIB undefined) nothing is compressed and
+// compression is never negotiated.
+
+// True if payload compression is built in
+bool compression_available(void);
+
+// Largest compressed size of a payload of size bytes, header included
+size_t compress_bound(size_t size);
+
+// Compress payload into out (compress_bound bytes), returns the compressed size
+// or 0 if it would not be smaller than the payload
+size_t compress_payload(std::string_view payload, int level, char* out);
+
+// Original size stored in a compressed payload, 0 if it is malformed
+size_t decompressed_size(std::string_view packed);
+
+// Decompress into out of decompressed_size bytes, false if packed is malformed
+bool decompress_payload(std::string_view packed, char* out, size_t size);
+
+#endif
@@ -0,0 +1,248 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Dispatcher.cpp
+// Product : PubSubx
+// Brief   : Work stealing pool running message handlers in order per topic
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Dispatcher.hpp"
+
+#include <algorithm>
+
+static thread_local const Dispatcher* t_worker_of = nullptr;
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+Dispatcher::Dispatcher(const DispatchSettings& settings, Metrics& metrics,
+    std::function<void(void)> relief, std::function<void(void)> idle)
+    :m_settings(settings),
+    m_metrics(metrics),
+    m_relief(std::move(relief)),
+    m_idle(std::move(idle))
+{
+    m_settings.workers = std::max<size_t>(m_settings.workers, 1);
+    m_settings.low_bytes = std::min(m_settings.low_bytes, m_settings.high_bytes);
+
+    for (size_t i = 0; i < m_settings.workers; i++) {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (size_t i = 0; i < m_settings.workers; i++) {
+        m_threads.emplace_back(&Dispatcher::loop, this, i);
+    }
+}
+
+Dispatcher::~Dispatcher() {
+    {
+        std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& l_thread : m_threads) {
+        l_thread.join();
+    }
+}
+
+
+/******************************************************************************/
+/**********************          SOCKET THREAD SIDE          ******************/
+/******************************************************************************/
+DispatchTopic* Dispatcher::topic(std::string_view name) {
+
+    auto l_it = m_topics.find(name);
+    if (l_it != m_topics.end()) {
+        return l_it->second.get();
+    }
+
+    if (m_topics.size() >= DISPATCH_TOPICS) {
+        prune();
+    }
+    auto l_topic = std::make_unique<DispatchTopic>();
+    l_topic->name = name;
+    l_topic->home = TopicHash{}(name) % m_queues.size();
+    return m_topics.emplace(l_topic->name, std::move(l_topic)).first->second.get();
+}
+
+void Dispatcher::prune(void) {
+
+    // Only a topic no worker holds may go, cached handlers are matched again when it returns
+    for (auto l_it = m_topics.begin(); l_it != m_topics.end(); ) {
+        DispatchTopic& l_topic = *l_it->second;
+        bool l_idle;
+        {
+            std::lock_guard<std::mutex> l_lock(l_topic.lock);
+            l_idle = !l_topic.scheduled;
+        }
+        l_it = l_idle ? m_topics.erase(l_it) : std::next(l_it);
+    }
+}
+
+void Dispatcher::submit(DispatchTopic* topic, BufRef&& payload) {
+
+    m_pending_bytes.fetch_add(payload.size());
+    m_pending_messages.fetch_add(1);
+
+    // A topic already scheduled is picked up by the worker holding it
+    bool l_schedule;
+    {
+        std::lock_guard<std::mutex> l_lock(topic->lock);
+        topic->items.push_back({ topic->handlers, std::move(payload), Metrics::now_ns() });
+        l_schedule = !std::exchange(topic->scheduled, true);
+    }
+    if (l_schedule) {
+        schedule(topic->home, topic);
+    }
+}
+
+bool Dispatcher::throttled(void) {
+
+    // Pause is published before the bytes are checked, a worker draining meanwhile sees one or the other
+    if (!m_paused && m_pending_bytes >= m_settings.high_bytes) {
+        m_paused = true;
+    }
+    if (m_paused && m_pending_bytes < m_settings.low_bytes) {
+        m_paused = false;
+    }
+    return m_paused;
+}
+
+void Dispatcher::wait_idle(void) {
+
+    if (on_worker()) { return; }
+    std::unique_lock<std::mutex> l_lock(m_wake_lock);
+    m_drained.wait(l_lock, [this]() { return m_pending_messages == 0; });
+}
+
+bool Dispatcher::on_worker(void) const {
+    return t_worker_of == this;
+}
+
+
+/******************************************************************************/
+/***********************          WORKER SIDE          ************************/
+/******************************************************************************/
+void Dispatcher::schedule(size_t index, DispatchTopic* topic) {
+
+    {
+        std::lock_guard<std::mutex> l_lock(m_queues[index]->lock);
+        m_queues[index]->topics.push_back(topic);
+    }
+
+    // Counted after the push, a worker that sees the count also finds the topic
+    m_queued.fetch_add(1);
+    if (m_sleepers > 0) {
+        std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        m_wake.notify_one();
+    }
+}
+
+void Dispatcher::loop(size_t index) {
+
+    t_worker_of = this;
+    std::vector<DispatchTopic::Item> l_batch;
+    l_batch.reserve(DISPATCH_RUN);
+
+    while (DispatchTopic* l_topic = next(index)) {
+        run(index, l_topic, l_batch);
+    }
+    t_worker_of = nullptr;
+}
+
+DispatchTopic* Dispatcher::next(size_t index) {
+
+    size_t l_count = m_queues.size();
+
+    while (1) {
+        // Own deque from the front
+        {
+            WorkerQueue& l_own = *m_queues[index];
+            std::lock_guard<std::mutex> l_lock(l_own.lock);
+            if (!l_own.topics.empty()) {
+                DispatchTopic* l_topic = l_own.topics.front();
+                l_own.topics.pop_front();
+                m_queued.fetch_sub(1);
+                return l_topic;
+            }
+        }
+
+        // Other deques from the back, starting with the next worker
+        for (size_t i = 1; i < l_count && m_queued > 0; i++) {
+            WorkerQueue& l_other = *m_queues[(index + i) % l_count];
+            std::lock_guard<std::mutex> l_lock(l_other.lock);
+            if (!l_other.topics.empty()) {
+                DispatchTopic* l_topic = l_other.topics.back();
+                l_other.topics.pop_back();
+                m_queued.fetch_sub(1);
+                m_metrics.add(CNT_STEALS);
+                return l_topic;
+            }
+        }
+
+        // Sleeper is counted before the check, schedule() notifies whenever it sees one
+        std::unique_lock<std::mutex> l_lock(m_wake_lock);
+        m_sleepers.fetch_add(1);
+        m_wake.wait(l_lock, [this]() { return m_queued > 0 || m_stop; });
+        m_sleepers.fetch_sub(1);
+        if (m_queued == 0 && m_stop) {
+            return nullptr;
+        }
+    }
+}
+
+void Dispatcher::run(size_t index, DispatchTopic* topic, std::vector<DispatchTopic::Item>& batch) {
+
+    // Taken in one go, the socket thread keeps appending meanwhile
+    {
+        std::lock_guard<std::mutex> l_lock(topic->lock);
+        size_t l_take = std::min<size_t>(topic->items.size(), DISPATCH_RUN);
+        std::move(topic->items.begin(), topic->items.begin() + l_take, std::back_inserter(batch));
+        topic->items.erase(topic->items.begin(), topic->items.begin() + l_take);
+    }
+
+    uint64_t l_bytes = 0;
+    uint64_t l_now = Metrics::now_ns();
+    for (DispatchTopic::Item& l_item : batch) {
+        m_metrics.record(HIST_DISPATCH_NS, l_now - std::min(l_now, l_item.queued_ns));
+        std::span<const std::byte> l_payload = std::as_bytes(std::span<const char>(l_item.payload.data(), l_item.payload.size()));
+        for (const DispatchHandler& l_handler : *l_item.handlers) {
+            l_handler(topic->name, l_payload);
+        }
+        l_bytes += l_item.payload.size();
+    }
+    size_t l_handled = batch.size();
+    batch.clear();
+    m_metrics.add(CNT_DISPATCHED, l_handled);
+
+    // Topic with more messages goes behind the others of this worker, the socket thread may prune it once released
+    bool l_more;
+    {
+        std::lock_guard<std::mutex> l_lock(topic->lock);
+        l_more = !topic->items.empty();
+        topic->scheduled = l_more;
+    }
+    if (l_more) {
+        schedule(index, topic);
+    }
+
+    // Reads resume below the low mark, unless the socket thread saw it first
+    if (m_pending_bytes.fetch_sub(l_bytes) - l_bytes < m_settings.low_bytes && m_paused && m_paused.exchange(false)) {
+        m_relief();
+    }
+    if (m_pending_messages.fetch_sub(l_handled) == l_handled) {
+        m_idle();
+        std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        m_drained.notify_all();
+    }
+}
@@ -0,0 +1,156 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Dispatcher.hpp
+// Product : PubSubx
+// Brief   : Work stealing pool running message handlers in order per topic
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_DISPATCHER_H
+#define PUBSUBX_DISPATCHER_H
+
+#include "BufferPool.hpp"
+#include "Metrics.hpp"
+#include "TopicIndex.hpp"
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define DISPATCH_HIGH_BYTES ((64) << (20))  // Default queued payload bytes that pause socket reads
+#define DISPATCH_RUN 64                     // Messages of one topic handled before other topics get a turn
+#define DISPATCH_TOPICS 65536               // Idle topics are forgotten above this many
+
+using DispatchHandler = std::function<void(std::string_view topic, std::span<const std::byte> payload)>;
+using DispatchHandlers = std::shared_ptr<const std::vector<DispatchHandler>>;
+
+// Handlers run on a worker pool instead of the socket thread, set before connect
+struct DispatchSettings {
+    size_t workers = 0;                     // 0 runs handlers on the socket thread
+    size_t high_bytes = DISPATCH_HIGH_BYTES;
+    size_t low_bytes = DISPATCH_HIGH_BYTES / 2;
+};
+
+// Messages of one topic waiting for their handlers, run by one worker at a time
+class DispatchTopic {
+
+public:
+    // Socket thread only, handlers matched while subscriptions had this epoch
+    DispatchHandlers handlers;
+    uint64_t epoch = 0;
+
+private:
+    friend class Dispatcher;
+
+    struct Item {
+        DispatchHandlers handlers;          // Subscriptions as they were when the message arrived
+        BufRef   payload;
+        uint64_t queued_ns;
+    };
+
+    std::string name;
+    size_t      home;                       // Worker whose deque takes the topic first
+    std::mutex  lock;                       // Protects items and scheduled
+    std::deque<Item> items;
+    bool        scheduled = false;          // In a worker deque or running
+};
+
+
+/******************************************************************************/
+/**********************          DISPATCHER CLASS          ********************/
+/******************************************************************************/
+// The socket thread queues every message on its topic. A topic with queued
+// messages sits in the deque of one worker, the owner takes topics from the
+// front and idle workers steal from the back of the others. A worker keeps
+// a topic until it has handled DISPATCH_RUN messages and then puts it at
+// the back of its own deque, so one busy topic can not starve the rest and
+// messages of a topic are never handled concurrently or out of order.
+class Dispatcher {
+
+public:
+    // Starts settings.workers threads. relief is called on a worker once queued bytes fall
+    // below the low mark after throttled() returned true, idle after the last queued message.
+    Dispatcher(const DispatchSettings& settings, Metrics& metrics,
+        std::function<void(void)> relief, std::function<void(void)> idle);
+    ~Dispatcher();                          // Handles everything queued, then joins the workers
+
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    // Socket thread: topic of a received message, payload queued behind its earlier ones
+    DispatchTopic* topic(std::string_view name);
+    void submit(DispatchTopic* topic, BufRef&& payload);
+
+    // Socket thread: true while reads should pause, entered above the high mark
+    bool throttled(void);
+
+    // Blocks until every queued message is handled, returns at once on a worker
+    void wait_idle(void);
+    bool on_worker(void) const;
+
+    size_t   workers(void) const { return m_threads.size(); }
+    uint64_t pending_bytes(void) const { return m_pending_bytes.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) WorkerQueue {
+        std::mutex lock;
+        std::deque<DispatchTopic*> topics;
+    };
+
+    DispatchSettings m_settings;
+    Metrics&         m_metrics;
+    std::function<void(void)> m_relief;
+    std::function<void(void)> m_idle;
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::unordered_map<std::string, std::unique_ptr<DispatchTopic>, TopicHash, std::equal_to<>> m_topics; // Socket thread
+
+    std::atomic<size_t>   m_queued{ 0 };        // Topics waiting in worker deques
+    std::atomic<uint64_t> m_pending_bytes{ 0 }; // Payload bytes queued or running
+    std::atomic<uint64_t> m_pending_messages{ 0 };
+    std::atomic<bool>     m_paused{ false };    // Socket thread was told to stop reading
+
+    std::mutex m_wake_lock;                     // Protects m_sleepers changes and m_stop
+    std::condition_variable m_wake;             // Idle workers wait for queued topics
+    std::condition_variable m_drained;          // wait_idle waits for no pending messages
+    std::atomic<size_t> m_sleepers{ 0 };
+    bool m_stop = false;
+
+    void loop(size_t index);
+    DispatchTopic* next(size_t index);          // Own topic, stolen one, or null once stopped
+    void run(size_t index, DispatchTopic* topic, std::vector<DispatchTopic::Item>& batch);
+    void schedule(size_t index, DispatchTopic* topic);
+    void prune(void);
+};
+
+#endif
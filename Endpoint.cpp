@@ -0,0 +1,147 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Endpoint.cpp
+// Product : PubSubx
+// Brief   : Broker endpoints, tcp://host:port, unix:///path.sock and shm:///path.sock
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Endpoint.hpp"
+
+#include <cstring>
+#include <netdb.h>
+#include <sys/un.h>
+
+
+/******************************************************************************/
+/***********************          PARSE FUNCTIONS          ********************/
+/******************************************************************************/
+bool Endpoint::parse(std::string_view uri) {
+
+    // Path must fit sun_path with its terminating zero, a shared memory link is set up over it
+    bool l_shm = uri.starts_with(SHM_SCHEME);
+    if (l_shm || uri.starts_with(UNIX_SCHEME)) {
+        std::string_view l_path = uri.substr(strlen(l_shm ? SHM_SCHEME : UNIX_SCHEME));
+        if (l_path.empty() || l_path.front() != '/' || l_path.size() >= sizeof(sockaddr_un::sun_path)) {
+            return false;
+        }
+        m_type = l_shm ? ENDPOINT_SHM : ENDPOINT_UNIX;
+        m_path = l_path;
+        m_host.clear();
+        m_port = 0;
+        forget();
+        return true;
+    }
+
+    // Bare name is a host without port, any other scheme is unknown
+    std::string_view l_host = uri;
+    int l_port = 0;
+    if (uri.starts_with(TCP_SCHEME)) {
+        std::string_view l_rest = uri.substr(strlen(TCP_SCHEME));
+        size_t l_colon;
+
+        // IPv6 address is bracketed, its port follows the bracket
+        if (l_rest.starts_with("[")) {
+            size_t l_close = l_rest.find(']');
+            if (l_close == std::string_view::npos) { return false; }
+            l_host = l_rest.substr(1, l_close - 1);
+            l_colon = l_close + 1 < l_rest.size() ? l_close + 1 : std::string_view::npos;
+            if (l_colon != std::string_view::npos && l_rest[l_colon] != ':') { return false; }
+        }
+        else {
+            l_colon = l_rest.rfind(':');
+            l_host = l_rest.substr(0, l_colon);
+        }
+
+        if (l_colon != std::string_view::npos) {
+            std::string_view l_digits = l_rest.substr(l_colon + 1);
+            if (l_digits.empty() || l_digits.size() > 5 || l_digits.find_first_not_of("0123456789") != std::string_view::npos) {
+                return false;
+            }
+            l_port = std::stoi(std::string(l_digits));
+            if (l_port < 1 || l_port > 65535) { return false; }
+        }
+    }
+    else if (uri.find("://") != std::string_view::npos) {
+        return false;
+    }
+
+    if (l_host.empty()) { return false; }
+    m_type = ENDPOINT_TCP;
+    m_host = l_host;
+    m_port = l_port;
+    m_path.clear();
+    forget();
+    return true;
+}
+
+std::string Endpoint::uri(void) const {
+
+    if (m_type != ENDPOINT_TCP) {
+        return (m_type == ENDPOINT_SHM ? SHM_SCHEME : UNIX_SCHEME) + m_path;
+    }
+    std::string l_host = m_host.find(':') != std::string::npos ? "[" + m_host + "]" : m_host;
+    return TCP_SCHEME + l_host + (m_port ? ":" + std::to_string(m_port) : "");
+}
+
+
+/******************************************************************************/
+/**********************          RESOLVE FUNCTIONS          *******************/
+/******************************************************************************/
+bool Endpoint::resolve(int port) {
+
+    int l_port = m_port ? m_port : port;
+    if (resolved() && (m_type != ENDPOINT_TCP || m_resolved_port == l_port)) {
+        return true;
+    }
+    forget();
+
+    if (m_type != ENDPOINT_TCP) {
+        EndpointAddress l_address;
+        struct sockaddr_un* l_addr = reinterpret_cast<struct sockaddr_un*>(&l_address.addr);
+        l_addr->sun_family = AF_UNIX;
+        memcpy(l_addr->sun_path, m_path.c_str(), m_path.size() + 1);
+        l_address.len = sizeof(struct sockaddr_un);
+        l_address.family = AF_UNIX;
+        m_addresses.push_back(l_address);
+        return true;
+    }
+
+    // Addresses of both families in the order of the resolver, numeric hosts are not looked up
+    struct addrinfo l_hints = {};
+    struct addrinfo* l_result = nullptr;
+    l_hints.ai_family = AF_UNSPEC;
+    l_hints.ai_socktype = SOCK_STREAM;
+    l_hints.ai_flags = AI_NUMERICSERV;
+    std::string l_service = std::to_string(l_port);
+    if (getaddrinfo(m_host.c_str(), l_service.c_str(), &l_hints, &l_result) != 0) {
+        return false;
+    }
+    for (struct addrinfo* l_info = l_result; l_info; l_info = l_info->ai_next) {
+        EndpointAddress l_address;
+        memcpy(&l_address.addr, l_info->ai_addr, l_info->ai_addrlen);
+        l_address.len = l_info->ai_addrlen;
+        l_address.family = l_info->ai_family;
+        m_addresses.push_back(l_address);
+    }
+    freeaddrinfo(l_result);
+    m_resolved_port = l_port;
+    return resolved();
+}
+
+bool Endpoint::next(void) {
+
+    if (m_addresses.empty()) { return false; }
+    m_current = (m_current + 1) % m_addresses.size();
+    return m_current != 0;
+}
@@ -0,0 +1,94 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Endpoint.hpp
+// Product : PubSubx
+// Brief   : Broker endpoints, tcp://host:port, unix:///path.sock and shm:///path.sock
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_ENDPOINT_H
+#define PUBSUBX_ENDPOINT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define TCP_SCHEME "tcp://"
+#define UNIX_SCHEME "unix://"
+#define SHM_SCHEME "shm://"
+
+enum endpoint_enum {
+    ENDPOINT_TCP,               // IPv4 or IPv6 stream socket
+    ENDPOINT_UNIX,              // Local stream socket, same framing without the TCP stack
+    ENDPOINT_SHM                // Unix socket of the broker, frames go through shared memory rings
+};
+
+// Socket address an endpoint resolves to
+struct EndpointAddress {
+    struct sockaddr_storage addr = {};
+    socklen_t len = 0;
+    int       family = AF_UNSPEC;
+};
+
+
+/******************************************************************************/
+/**********************          ENDPOINT CLASS           *********************/
+/******************************************************************************/
+// Parsed from "tcp://host:port", "tcp://[v6 address]:port", "unix:///path.sock",
+// "shm:///path.sock" or a bare host name, which is tcp with the port given on
+// connect. Port 0 means not given. Resolved addresses are cached until the port
+// or the endpoint changes or forget() is called, connects go to the current one
+// and move on to the next one when it is refused.
+class Endpoint {
+
+public:
+    Endpoint() = default;
+
+    // False if uri is malformed, the endpoint is then left unchanged
+    bool parse(std::string_view uri);
+
+    // Name resolution blocks, port is used if the endpoint has none
+    bool resolve(int port);
+    void forget(void) { m_addresses.clear(); m_current = 0; }
+    bool resolved(void) const { return !m_addresses.empty(); }
+
+    // Moves to the next resolved address, false after the last one (starts over)
+    bool next(void);
+
+    endpoint_enum type(void) const { return m_type; }
+    const std::string& host(void) const { return m_host; }
+    const std::string& path(void) const { return m_path; }
+    int  port(void) const { return m_port; }
+    const EndpointAddress& address(void) const { return m_addresses[m_current]; }
+    std::string uri(void) const;
+
+private:
+    endpoint_enum m_type = ENDPOINT_TCP;
+    std::string   m_host;
+    int           m_port = 0;
+    std::string   m_path;
+    std::vector<EndpointAddress> m_addresses;
+    size_t        m_current = 0;
+    int           m_resolved_port = 0;  // Port the cached addresses were resolved with
+};
+
+#endif
@@ -0,0 +1,126 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Framer.cpp
+// Product : PubSubx
+// Brief   : Incremental splitter of the receive stream into EOM delimited frames
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Framer.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+Framer::Framer(std::string_view delim)
+    :m_delim(delim)
+{
+}
+
+
+/******************************************************************************/
+/*********************          BUFFER FUNCTIONS          *********************/
+/******************************************************************************/
+char* Framer::prepare(size_t min_size) {
+
+    // Everything consumed, start from the beginning again
+    if (m_begin == m_end) {
+        m_begin = m_scan = m_end = 0;
+    }
+
+    if (m_buffer.size() - m_end < min_size) {
+
+        // Move unconsumed tail to the front, grow only if that is not enough
+        if (m_begin > 0) {
+            memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+            m_scan -= m_begin;
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if (m_buffer.size() - m_end < min_size) {
+            m_buffer.resize(std::max(m_end + min_size, 2 * m_buffer.size()));
+        }
+    }
+
+    return m_buffer.data() + m_end;
+}
+
+void Framer::commit(size_t size) {
+    m_end += size;
+}
+
+void Framer::append(const char* data, size_t size) {
+    memcpy(prepare(size), data, size);
+    commit(size);
+}
+
+void Framer::reset(void) {
+    m_begin = m_scan = m_end = 0;
+    m_framing = FRAMING_TEXT;
+    m_error = false;
+}
+
+
+/******************************************************************************/
+/*********************          FRAME FUNCTIONS          **********************/
+/******************************************************************************/
+bool Framer::next(std::string_view& frame) {
+
+    if (m_framing == FRAMING_BINARY) {
+        return next_binary(frame);
+    }
+
+    std::string_view l_data(m_buffer.data() + m_scan, m_end - m_scan);
+    size_t l_pos = l_data.find(m_delim);
+
+    if (l_pos == std::string_view::npos) {
+        // Keep last delim - 1 bytes for the next scan, delimiter may be split
+        size_t l_keep = m_delim.size() - 1;
+        if (m_end - m_begin > l_keep) {
+            m_scan = std::max(m_scan, m_end - l_keep);
+        }
+        return false;
+    }
+
+    size_t l_frame_end = m_scan + l_pos;
+    frame = std::string_view(m_buffer.data() + m_begin, l_frame_end - m_begin);
+    m_begin = m_scan = l_frame_end + m_delim.size();
+    return true;
+}
+
+bool Framer::next_binary(std::string_view& frame) {
+
+    // Header tells exact frame size, nothing has to be scanned
+    if (m_error || m_end - m_begin < FRAME_HEADER_SIZE) {
+        return false;
+    }
+
+    FrameHeader l_header;
+    decode_header(m_buffer.data() + m_begin, l_header);
+    if (l_header.length > MAX_FRAME_SIZE) {
+        m_error = true;
+        return false;
+    }
+
+    size_t l_size = FRAME_HEADER_SIZE + l_header.length;
+    if (m_end - m_begin < l_size) {
+        return false;
+    }
+
+    frame = std::string_view(m_buffer.data() + m_begin, l_size);
+    m_begin = m_scan = m_begin + l_size;
+    return true;
+}
@@ -0,0 +1,82 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Framer.hpp
+// Product : PubSubx
+// Brief   : Incremental splitter of the receive stream into EOM delimited frames
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_FRAMER_H
+#define PUBSUBX_FRAMER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include "Protocol.hpp"
+
+
+/******************************************************************************/
+/**********************          FRAMER CLASS           ***********************/
+/******************************************************************************/
+// Owns one reusable byte buffer. Data is read straight into it (prepare /
+// commit) and next() hands out frames as views into the buffer, so no
+// allocation happens per message. The scan position is remembered, every
+// received byte is inspected once, also when a delimiter is split between
+// two reads. Binary frames are length prefixed and returned together with
+// their header. Frames stay valid until the next prepare() or append().
+class Framer {
+
+public:
+    explicit Framer(std::string_view delim);
+
+    // Get a writable area of at least min_size bytes, then commit what was written
+    char* prepare(size_t min_size);
+    void  commit(size_t size);
+
+    // Copy data into the buffer, same as prepare + memcpy + commit
+    void  append(const char* data, size_t size);
+
+    // Get next complete frame without the delimiter, false if none is complete
+    bool  next(std::string_view& frame);
+
+    // Drop all buffered data and return to text framing
+    void  reset(void);
+
+    // Switch framing of the data that follows already returned frames
+    void  set_framing(framing_enum framing) { m_framing = framing; m_scan = m_begin; }
+
+    // Set when a binary frame announces a body larger than MAX_FRAME_SIZE
+    bool  error(void) const { return m_error; }
+
+    // Bytes received but not yet returned as a frame
+    size_t pending(void) const { return m_end - m_begin; }
+
+private:
+    std::string       m_delim;
+    std::vector<char> m_buffer;
+    size_t            m_begin = 0;  // Start of first unconsumed frame
+    size_t            m_scan = 0;   // Position where delimiter search continues
+    size_t            m_end = 0;    // End of received data
+    framing_enum      m_framing = FRAMING_TEXT;
+    bool              m_error = false;
+
+    bool  next_binary(std::string_view& frame);
+};
+
+#endif
@@ -0,0 +1,223 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Metrics.cpp
+// Product : PubSubx
+// Brief   : Per-thread counters and log-linear latency histograms
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Metrics.hpp"
+
+#include <sstream>
+#include <iomanip>
+
+
+static const char* counter_names[] = {
+    [CNT_MSGS_IN] = "messages_in",
+    [CNT_BYTES_IN] = "bytes_in",
+    [CNT_MSGS_OUT] = "messages_out",
+    [CNT_BYTES_OUT] = "bytes_out",
+    [CNT_PUBLISH] = "publish_calls",
+    [CNT_WAKEUPS] = "loop_wakeups",
+    [CNT_READ_CALLS] = "read_calls",
+    [CNT_WRITE_CALLS] = "write_calls",
+    [CNT_RING_FULL] = "ring_full",
+    [CNT_WRONG_TOPIC] = "wrong_topic",
+    [CNT_FRAMING_ERRORS] = "framing_errors",
+    [CNT_ERRORS] = "errors",
+    [CNT_CONGESTED] = "outbound_congested",
+    [CNT_DROPPED] = "outbound_dropped",
+    [CNT_REJECTED] = "outbound_rejected",
+    [CNT_COMPRESSED] = "compressed",
+    [CNT_COMPRESS_IN] = "compress_bytes_in",
+    [CNT_COMPRESS_OUT] = "compress_bytes_out",
+    [CNT_DECOMPRESSED] = "decompressed",
+    [CNT_REPLAYED] = "replayed",
+    [CNT_DUPLICATES] = "duplicates",
+    [CNT_GAPS] = "sequence_gaps",
+    [CNT_SPOOLED] = "spooled",
+    [CNT_UNSPOOLED] = "unspooled",
+    [CNT_RECONNECTS] = "reconnects",
+    [CNT_RECONNECT_FAILS] = "reconnect_failures",
+    [CNT_DISPATCHED] = "dispatched",
+    [CNT_STEALS] = "steals",
+    [CNT_READ_PAUSES] = "read_pauses",
+};
+
+static const char* gauge_names[] = {
+    [GAUGE_SEND_QUEUE] = "send_queue",
+    [GAUGE_SUBSCRIPTIONS] = "subscriptions",
+    [GAUGE_OUT_BYTES] = "outbound_bytes",
+    [GAUGE_SPOOL_BYTES] = "spool_bytes",
+    [GAUGE_DISPATCH_BYTES] = "dispatch_bytes",
+};
+
+static const char* histogram_names[] = {
+    [HIST_WAIT_NS] = "loop_wait_ns",
+    [HIST_LOCK_HOLD_NS] = "lock_hold_ns",
+    [HIST_LOCK_WAIT_NS] = "lock_wait_ns",
+    [HIST_SEND_QUEUE] = "send_queue_depth",
+    [HIST_RECOVER_NS] = "recover_ns",
+    [HIST_DISPATCH_NS] = "dispatch_delay_ns",
+    [HIST_RESOLVE_NS] = "resolve_ns",
+    [HIST_CONNECT_NS] = "connect_ns",
+    [HIST_HANDSHAKE_NS] = "handshake_ns",
+};
+
+// Instance ids are never reused, a thread local cache can not point to a dead instance
+static std::atomic<uint64_t> metrics_ids{ 0 };
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+Metrics::Metrics()
+    :m_id(++metrics_ids)
+{
+    for (auto& l_gauge : m_gauges) {
+        l_gauge.store(0);
+    }
+}
+
+
+/******************************************************************************/
+/*********************          RECORD FUNCTIONS          *********************/
+/******************************************************************************/
+Metrics::ThreadMetrics& Metrics::local(void) {
+
+    // Threads usually talk to one client, a short list of instances is enough
+    struct CacheEntry { uint64_t id; ThreadMetrics* metrics; };
+    static thread_local std::vector<CacheEntry> t_cache;
+
+    for (const CacheEntry& l_entry : t_cache) {
+        if (l_entry.id == m_id) { return *l_entry.metrics; }
+    }
+
+    // First use on this thread, value initialization zeroes all cells
+    ThreadMetrics* l_metrics = new ThreadMetrics();
+    {
+        std::lock_guard<std::mutex> l_lock(m_lock);
+        m_threads.emplace_back(l_metrics);
+    }
+    t_cache.push_back({ m_id, l_metrics });
+    return *l_metrics;
+}
+
+size_t Metrics::bucket(uint64_t value) {
+    if (value < HIST_SUB) { return value; }
+    int l_shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (l_shift + 1) * HIST_SUB + (size_t)((value >> l_shift) - HIST_SUB);
+}
+
+uint64_t Metrics::bucket_limit(size_t bucket) {
+    if (bucket < HIST_SUB) { return bucket; }
+    int l_shift = bucket / HIST_SUB - 1;
+    uint64_t l_sub = bucket % HIST_SUB + HIST_SUB;
+    return ((l_sub + 1) << l_shift) - 1;
+}
+
+void Metrics::record(histogram_enum histogram, uint64_t value) {
+
+    Histogram& l_hist = local().histograms[histogram];
+    auto l_bump = [](std::atomic<uint64_t>& cell, uint64_t value) {
+        cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    };
+
+    l_bump(l_hist.buckets[bucket(value)], 1);
+    l_bump(l_hist.count, 1);
+    l_bump(l_hist.sum, value);
+    if (value > l_hist.max.load(std::memory_order_relaxed)) {
+        l_hist.max.store(value, std::memory_order_relaxed);
+    }
+}
+
+
+/******************************************************************************/
+/********************          SNAPSHOT FUNCTIONS          ********************/
+/******************************************************************************/
+MetricsSnapshot Metrics::snapshot(void) const {
+
+    MetricsSnapshot l_snap;
+    for (int h = 0; h < MAX_HISTOGRAMS; h++) {
+        l_snap.histograms[h].buckets.assign(HIST_BUCKETS, 0);
+    }
+
+    std::lock_guard<std::mutex> l_lock(m_lock);
+    for (const auto& l_thread : m_threads) {
+        for (int c = 0; c < MAX_COUNTERS; c++) {
+            l_snap.counters[c] += l_thread->counters[c].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < MAX_HISTOGRAMS; h++) {
+            const Histogram& l_src = l_thread->histograms[h];
+            HistogramSnapshot& l_dst = l_snap.histograms[h];
+            for (size_t b = 0; b < HIST_BUCKETS; b++) {
+                l_dst.buckets[b] += l_src.buckets[b].load(std::memory_order_relaxed);
+            }
+            l_dst.count += l_src.count.load(std::memory_order_relaxed);
+            l_dst.sum += l_src.sum.load(std::memory_order_relaxed);
+            l_dst.max = std::max(l_dst.max, l_src.max.load(std::memory_order_relaxed));
+        }
+    }
+    for (int g = 0; g < MAX_GAUGES; g++) {
+        l_snap.gauges[g] = m_gauges[g].load(std::memory_order_relaxed);
+    }
+    return l_snap;
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+
+    if (count == 0) { return 0; }
+    uint64_t l_rank = (uint64_t)(q * (count - 1)) + 1;
+    uint64_t l_seen = 0;
+    for (size_t b = 0; b < buckets.size(); b++) {
+        l_seen += buckets[b];
+        if (l_seen >= l_rank) {
+            return std::min(Metrics::bucket_limit(b), max);
+        }
+    }
+    return max;
+}
+
+double MetricsSnapshot::syscalls_per_message(void) const {
+    uint64_t l_messages = counters[CNT_MSGS_IN] + counters[CNT_MSGS_OUT];
+    return l_messages ? (double)(counters[CNT_READ_CALLS] + counters[CNT_WRITE_CALLS]) / l_messages : 0;
+}
+
+std::string Metrics::format(const MetricsSnapshot& snapshot) {
+
+    std::ostringstream l_out;
+    l_out << std::fixed << std::setprecision(3);
+
+    for (int c = 0; c < MAX_COUNTERS; c++) {
+        l_out << std::left << std::setw(22) << counter_names[c] << snapshot.counters[c] << "\n";
+    }
+    l_out << std::left << std::setw(22) << "syscalls_per_message" << snapshot.syscalls_per_message() << "\n";
+    for (int g = 0; g < MAX_GAUGES; g++) {
+        l_out << std::left << std::setw(22) << gauge_names[g] << snapshot.gauges[g] << "\n";
+    }
+    for (int h = 0; h < MAX_HISTOGRAMS; h++) {
+        const HistogramSnapshot& l_hist = snapshot.histograms[h];
+        l_out << std::left << std::setw(22) << histogram_names[h]
+            << "count " << l_hist.count
+            << " mean " << (uint64_t)l_hist.mean()
+            << " p50 " << l_hist.percentile(0.5)
+            << " p99 " << l_hist.percentile(0.99)
+            << " p999 " << l_hist.percentile(0.999)
+            << " max " << l_hist.max << "\n";
+    }
+    return l_out.str();
+}
+
+const char* Metrics::counter_name(counter_enum counter) { return counter_names[counter]; }
+const char* Metrics::gauge_name(gauge_enum gauge) { return gauge_names[gauge]; }
+const char* Metrics::histogram_name(histogram_enum histogram) { return histogram_names[histogram]; }
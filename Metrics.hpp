@@ -0,0 +1,180 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Metrics.hpp
+// Product : PubSubx
+// Brief   : Per-thread counters and log-linear latency histograms
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_METRICS_H
+#define PUBSUBX_METRICS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define HIST_SUB_BITS 4         // 16 linear sub-buckets per power of two, ~6% resolution
+#define HIST_SUB ((1) << (HIST_SUB_BITS))
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+enum counter_enum {
+    CNT_MSGS_IN,                // Messages received from server
+    CNT_BYTES_IN,               // Bytes received from server
+    CNT_MSGS_OUT,               // Messages written to server
+    CNT_BYTES_OUT,              // Bytes written to server
+    CNT_PUBLISH,                // Publish calls of the API
+    CNT_WAKEUPS,                // Returns from the reactor wait
+    CNT_READ_CALLS,             // recv system calls
+    CNT_WRITE_CALLS,            // sendmsg system calls
+    CNT_RING_FULL,              // Producer found the command ring full
+    CNT_WRONG_TOPIC,            // Message on a topic without subscription
+    CNT_FRAMING_ERRORS,         // Malformed or oversized frames
+    CNT_ERRORS,                 // All reported errors
+    CNT_CONGESTED,              // Outbound queue crossed a high water mark
+    CNT_DROPPED,                // Publishes dropped by the overflow policy
+    CNT_REJECTED,               // Publishes refused by the overflow policy
+    CNT_COMPRESSED,             // Publishes sent with compressed payload
+    CNT_COMPRESS_IN,            // Payload bytes before compression
+    CNT_COMPRESS_OUT,           // Payload bytes after compression
+    CNT_DECOMPRESSED,           // Received messages with compressed payload
+    CNT_REPLAYED,               // Messages replayed by the server on resume
+    CNT_DUPLICATES,             // Messages dropped as already seen
+    CNT_GAPS,                   // Messages skipped in topic sequences
+    CNT_SPOOLED,                // Publishes written to the offline spool
+    CNT_UNSPOOLED,              // Spooled publishes handed to the send engine
+    CNT_RECONNECTS,             // Lost connections reestablished by the socket loop
+    CNT_RECONNECT_FAILS,        // Failed reconnect attempts
+    CNT_DISPATCHED,             // Messages handled on dispatch workers
+    CNT_STEALS,                 // Topics taken from the deque of another worker
+    CNT_READ_PAUSES,            // Socket reads paused on a full dispatch queue
+    MAX_COUNTERS
+};
+
+enum gauge_enum {
+    GAUGE_SEND_QUEUE,           // Messages waiting in the send engine
+    GAUGE_SUBSCRIPTIONS,        // Subscribed topic filters
+    GAUGE_OUT_BYTES,            // Bytes queued for the server, ring included
+    GAUGE_SPOOL_BYTES,          // Bytes waiting in the offline spool
+    GAUGE_DISPATCH_BYTES,       // Payload bytes waiting for dispatch workers
+    MAX_GAUGES
+};
+
+enum histogram_enum {
+    HIST_WAIT_NS,               // Time blocked in the reactor wait
+    HIST_LOCK_HOLD_NS,          // Time socket loop holds m_mutex per iteration
+    HIST_LOCK_WAIT_NS,          // Time API calls wait for m_mutex
+    HIST_SEND_QUEUE,            // Send queue depth sampled every iteration
+    HIST_RECOVER_NS,            // Time from a lost connection to the reconnected one
+    HIST_DISPATCH_NS,           // Time a message waits for its dispatch worker
+    HIST_RESOLVE_NS,            // Connection setup: server name resolution
+    HIST_CONNECT_NS,            // Connection setup: TCP connect
+    HIST_HANDSHAKE_NS,          // Connection setup: CONNECT sent to whole reply received
+    MAX_HISTOGRAMS
+};
+
+// Merged histogram, values are upper bounds of the bucket holding the rank
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> buckets;
+
+    double   mean(void) const { return count ? (double)sum / count : 0; }
+    uint64_t percentile(double q) const;
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[MAX_COUNTERS] = {};
+    int64_t  gauges[MAX_GAUGES] = {};
+    HistogramSnapshot histograms[MAX_HISTOGRAMS];
+
+    // Derived value, system calls per message in either direction
+    double syscalls_per_message(void) const;
+};
+
+
+/******************************************************************************/
+/**********************          METRICS CLASS           **********************/
+/******************************************************************************/
+// Every thread writes its own cache line aligned block without atomic
+// read-modify-write, snapshot() sums all blocks. Blocks of exited threads
+// are kept so totals never go backwards.
+class Metrics {
+
+public:
+    Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void add(counter_enum counter, uint64_t value = 1) {
+        std::atomic<uint64_t>& l_cell = local().counters[counter];
+        l_cell.store(l_cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    void set(gauge_enum gauge, int64_t value) {
+        m_gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+    void record(histogram_enum histogram, uint64_t value);
+
+    MetricsSnapshot snapshot(void) const;
+
+    // Multi-line human readable form of a snapshot
+    static std::string format(const MetricsSnapshot& snapshot);
+
+    static const char* counter_name(counter_enum counter);
+    static const char* gauge_name(gauge_enum gauge);
+    static const char* histogram_name(histogram_enum histogram);
+
+    // Bucket of a value and the largest value falling into a bucket
+    static size_t   bucket(uint64_t value);
+    static uint64_t bucket_limit(size_t bucket);
+
+    static uint64_t now_ns(void) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    struct Histogram {
+        std::atomic<uint64_t> buckets[HIST_BUCKETS];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    struct alignas(64) ThreadMetrics {
+        std::atomic<uint64_t> counters[MAX_COUNTERS];
+        Histogram histograms[MAX_HISTOGRAMS];
+    };
+
+    uint64_t m_id;                  // Distinguishes instances in thread local caches
+    mutable std::mutex m_lock;      // Protects m_threads
+    std::vector<std::unique_ptr<ThreadMetrics>> m_threads;
+    std::atomic<int64_t> m_gauges[MAX_GAUGES];
+
+    ThreadMetrics& local(void);
+};
+
+#endif
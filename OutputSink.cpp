@@ -0,0 +1,215 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : OutputSink.cpp
+// Product : PubSubx
+// Brief   : Asynchronous batched writer of text records to a file descriptor
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "OutputSink.hpp"
+
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#define SINK_MASK ((SINK_RING_SIZE) - 1)
+
+// Instance ids are never reused, a thread local cache can not point to a dead instance
+static std::atomic<uint64_t> sink_ids{ 0 };
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+OutputSink::OutputSink(int fd, std::chrono::milliseconds interval)
+    :m_fd(fd),
+    m_id(++sink_ids),
+    m_interval_ms(interval.count())
+{
+    m_thread = std::thread(&OutputSink::loop, this);
+}
+
+OutputSink::~OutputSink() {
+    {
+        std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+
+/******************************************************************************/
+/*********************          PRODUCER FUNCTIONS          *******************/
+/******************************************************************************/
+OutputSink::Ring& OutputSink::local(void) {
+
+    struct CacheEntry { uint64_t id; Ring* ring; };
+    static thread_local std::vector<CacheEntry> t_cache;
+
+    for (const CacheEntry& l_entry : t_cache) {
+        if (l_entry.id == m_id) { return *l_entry.ring; }
+    }
+
+    Ring* l_ring = new Ring();
+    {
+        std::lock_guard<std::mutex> l_lock(m_rings_lock);
+        m_rings.emplace_back(l_ring);
+    }
+    t_cache.push_back({ m_id, l_ring });
+    return *l_ring;
+}
+
+void OutputSink::wake(void) {
+    {
+        std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        m_urgent = true;
+    }
+    m_wake.notify_one();
+}
+
+void OutputSink::wait_space(Ring& ring, uint64_t tail, size_t size) {
+    // Writer is behind (slow terminal or pipe), let it run
+    while (SINK_RING_SIZE - (tail - ring.head.load(std::memory_order_acquire)) < size) {
+        wake();
+        std::this_thread::yield();
+    }
+}
+
+void OutputSink::write(std::initializer_list<std::string_view> parts, bool urgent) {
+
+    Ring& l_ring = local();
+    uint64_t l_tail = l_ring.tail.load(std::memory_order_relaxed);
+
+    size_t l_total = 0;
+    for (std::string_view l_part : parts) {
+        l_total += l_part.size();
+    }
+
+    // Whole record becomes visible at once, unless it is larger than the ring
+    wait_space(l_ring, l_tail, std::min<size_t>(l_total, SINK_RING_SIZE));
+
+    for (std::string_view l_part : parts) {
+        size_t l_off = 0;
+        while (l_off < l_part.size()) {
+            size_t l_free = SINK_RING_SIZE - (l_tail - l_ring.head.load(std::memory_order_acquire));
+            if (l_free == 0) {
+                l_ring.tail.store(l_tail, std::memory_order_release);
+                wait_space(l_ring, l_tail, 1);
+                continue;
+            }
+            size_t l_size = std::min({ l_free, l_part.size() - l_off, SINK_RING_SIZE - (size_t)(l_tail & SINK_MASK) });
+            memcpy(l_ring.data.get() + (l_tail & SINK_MASK), l_part.data() + l_off, l_size);
+            l_tail += l_size;
+            l_off += l_size;
+        }
+    }
+    l_ring.tail.store(l_tail, std::memory_order_release);
+
+    // Half full ring is written early so producers rarely wait
+    if (urgent || l_tail - l_ring.head.load(std::memory_order_relaxed) > SINK_RING_SIZE / 2) {
+        wake();
+    }
+}
+
+void OutputSink::flush(void) {
+
+    Ring& l_ring = local();
+    uint64_t l_tail = l_ring.tail.load(std::memory_order_relaxed);
+
+    wake();
+    std::unique_lock<std::mutex> l_lock(m_wake_lock);
+    m_written.wait(l_lock, [&]() {
+        return l_ring.head.load(std::memory_order_acquire) >= l_tail || m_stop;
+    });
+}
+
+
+/******************************************************************************/
+/**********************          WRITER FUNCTIONS          ********************/
+/******************************************************************************/
+bool OutputSink::drain(void) {
+
+    struct iovec l_iov[SINK_IOV_MAX];
+    Ring*    l_rings[SINK_IOV_MAX];
+    uint64_t l_tails[SINK_IOV_MAX];
+    bool     l_any = false;
+
+    std::lock_guard<std::mutex> l_lock(m_rings_lock);
+
+    while (true) {
+        // Buffered bytes of every ring, a wrapped ring gives two entries
+        int l_iovcnt = 0, l_count = 0;
+        for (auto& l_ring : m_rings) {
+            if (l_iovcnt > SINK_IOV_MAX - 2) { break; }
+            uint64_t l_head = l_ring->head.load(std::memory_order_relaxed);
+            uint64_t l_tail = l_ring->tail.load(std::memory_order_acquire);
+            if (l_head == l_tail) { continue; }
+
+            size_t l_start = l_head & SINK_MASK;
+            size_t l_first = std::min<size_t>(l_tail - l_head, SINK_RING_SIZE - l_start);
+            l_iov[l_iovcnt++] = { l_ring->data.get() + l_start, l_first };
+            if (l_first < l_tail - l_head) {
+                l_iov[l_iovcnt++] = { l_ring->data.get(), (size_t)(l_tail - l_head - l_first) };
+            }
+            l_rings[l_count] = l_ring.get();
+            l_tails[l_count] = l_tail;
+            l_count++;
+        }
+        if (l_count == 0) { return l_any; }
+        l_any = true;
+
+        ssize_t l_written = writev(m_fd, l_iov, l_iovcnt);
+        if (l_written < 0) {
+            if (errno == EINTR || errno == EAGAIN) { continue; }
+            // Output is gone (closed pipe), drop what is buffered so producers never block
+            l_written = SIZE_MAX >> 1;
+        }
+        m_writes++;
+
+        // Consume rings in the order they were gathered
+        size_t l_left = l_written;
+        for (int i = 0; i < l_count; i++) {
+            uint64_t l_head = l_rings[i]->head.load(std::memory_order_relaxed);
+            size_t l_size = std::min<size_t>(l_left, l_tails[i] - l_head);
+            l_rings[i]->head.store(l_head + l_size, std::memory_order_release);
+            l_left -= l_size;
+            m_bytes += l_size;
+        }
+    }
+}
+
+void OutputSink::loop(void) {
+
+    while (true) {
+        bool l_stop;
+        {
+            std::unique_lock<std::mutex> l_lock(m_wake_lock);
+            m_wake.wait_for(l_lock, std::chrono::milliseconds(m_interval_ms.load()), [&]() {
+                return m_urgent || m_stop;
+            });
+            m_urgent = false;
+            l_stop = m_stop;
+        }
+
+        drain();
+        {
+            std::lock_guard<std::mutex> l_lock(m_wake_lock);
+        }
+        m_written.notify_all();
+
+        if (l_stop) { break; }
+    }
+}
@@ -0,0 +1,106 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : OutputSink.hpp
+// Product : PubSubx
+// Brief   : Asynchronous batched writer of text records to a file descriptor
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_OUTPUT_SINK_H
+#define PUBSUBX_OUTPUT_SINK_H
+
+#include <string_view>
+#include <initializer_list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define SINK_RING_SIZE ((1) << (20))    // Bytes buffered per producer thread, power of two
+#define SINK_FLUSH_MS 20                // Default time records may wait before written
+#define SINK_IOV_MAX 64                 // Maximum number of iovec entries in one write
+
+
+/******************************************************************************/
+/********************          OUTPUT SINK CLASS           ********************/
+/******************************************************************************/
+// Every producer thread copies whole records into its own single producer
+// byte ring, no lock and no allocation on the producer side. The writer
+// thread wakes every flush interval (or at once for urgent records and
+// half full rings) and hands all buffered bytes of all rings to one writev
+// straight from the rings. A producer only waits when its ring is full.
+class OutputSink {
+
+public:
+    OutputSink(int fd, std::chrono::milliseconds interval = std::chrono::milliseconds(SINK_FLUSH_MS));
+    ~OutputSink();                      // Writes everything buffered
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // Queue one record made of parts, urgent records are written without waiting for the interval
+    void write(std::initializer_list<std::string_view> parts, bool urgent = false);
+
+    // Block until everything queued by this thread so far is written
+    void flush(void);
+
+    void set_interval(std::chrono::milliseconds interval) { m_interval_ms = interval.count(); }
+
+    // Statistics of the writer thread
+    uint64_t bytes(void) const { return m_bytes; }
+    uint64_t writes(void) const { return m_writes; }
+
+private:
+    struct Ring {
+        std::unique_ptr<char[]> data{ new char[SINK_RING_SIZE] };
+        alignas(64) std::atomic<uint64_t> head{ 0 };    // Written to fd, advanced by writer
+        alignas(64) std::atomic<uint64_t> tail{ 0 };    // Queued, advanced by producer
+    };
+
+    int      m_fd;
+    uint64_t m_id;                      // Distinguishes instances in thread local caches
+    std::atomic<int64_t> m_interval_ms;
+
+    std::mutex m_rings_lock;            // Protects m_rings, taken by producers only on first use
+    std::vector<std::unique_ptr<Ring>> m_rings;
+
+    std::mutex m_wake_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_written;  // Signalled after every drain, for flush()
+    bool     m_urgent = false;
+    bool     m_stop = false;
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_bytes{ 0 };
+    std::atomic<uint64_t> m_writes{ 0 };
+
+    Ring& local(void);
+    void  wake(void);
+    void  wait_space(Ring& ring, uint64_t tail, size_t size);
+    bool  drain(void);                  // Write all buffered bytes, false if nothing was buffered
+    void  loop(void);
+};
+
+#endif
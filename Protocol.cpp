@@ -0,0 +1,215 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Protocol.cpp
+// Product : PubSubx
+// Brief   : Wire format of PubSubX frames, text (EOM) and binary (length prefix)
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Protocol.hpp"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+
+/******************************************************************************/
+/********************          HEADER FUNCTIONS          **********************/
+/******************************************************************************/
+void encode_header(char* out, const FrameHeader& header) {
+    uint32_t l_length = htonl(header.length);
+    uint16_t l_topic_len = htons(header.topic_len);
+    memcpy(out, &l_length, 4);
+    out[4] = (char)header.opcode;
+    out[5] = (char)header.flags;
+    memcpy(out + 6, &l_topic_len, 2);
+}
+
+void decode_header(const char* in, FrameHeader& header) {
+    uint32_t l_length;
+    uint16_t l_topic_len;
+    memcpy(&l_length, in, 4);
+    memcpy(&l_topic_len, in + 6, 2);
+    header.length = ntohl(l_length);
+    header.opcode = (uint8_t)in[4];
+    header.flags = (uint8_t)in[5];
+    header.topic_len = ntohs(l_topic_len);
+}
+
+
+void encode_seq(char* out, uint64_t seq) {
+    for (int i = SEQ_SIZE - 1; i >= 0; i--, seq >>= 8) {
+        out[i] = (char)(seq & 0xff);
+    }
+}
+
+uint64_t decode_seq(const char* in) {
+    uint64_t l_seq = 0;
+    for (int i = 0; i < SEQ_SIZE; i++) {
+        l_seq = (l_seq << 8) | (uint8_t)in[i];
+    }
+    return l_seq;
+}
+
+
+/******************************************************************************/
+/*******************          COMMAND FUNCTIONS          **********************/
+/******************************************************************************/
+static const char* text_commands[] = {
+    [0] = "",
+    [OP_PUBLISH] = "PUBLISH",
+    [OP_SUBSCRIBE] = "SUBSCRIBE",
+    [OP_UNSUBSCRIBE] = "UNSUBSCRIBE",
+    [OP_DISCONNECT] = "DISCONNECT",
+};
+
+size_t command_size(framing_enum framing, opcode_enum opcode, std::string_view topic, std::string_view payload) {
+
+    if (framing == FRAMING_BINARY) {
+        return FRAME_HEADER_SIZE + topic.size() + payload.size();
+    }
+
+    // Text command is "<COMMAND> <topic> <payload>", only PUBLISH has payload
+    size_t l_size = strlen(text_commands[opcode]);
+    if (opcode == OP_DISCONNECT) { return l_size; }
+    l_size += 1 + topic.size();
+    if (opcode == OP_PUBLISH) {
+        l_size += 1 + payload.size();
+    }
+    return l_size;
+}
+
+void encode_command(framing_enum framing, opcode_enum opcode, std::string_view topic,
+    std::string_view payload, char* out) {
+
+    if (framing == FRAMING_BINARY) {
+        FrameHeader l_header;
+        l_header.length = topic.size() + payload.size();
+        l_header.opcode = opcode;
+        l_header.flags = 0;
+        l_header.topic_len = topic.size();
+
+        encode_header(out, l_header);
+        memcpy(out + FRAME_HEADER_SIZE, topic.data(), topic.size());
+        memcpy(out + FRAME_HEADER_SIZE + topic.size(), payload.data(), payload.size());
+        return;
+    }
+
+    size_t l_len = strlen(text_commands[opcode]);
+    memcpy(out, text_commands[opcode], l_len);
+    if (opcode == OP_DISCONNECT) { return; }
+    out += l_len;
+    *out++ = ' ';
+    memcpy(out, topic.data(), topic.size());
+    if (opcode == OP_PUBLISH) {
+        out += topic.size();
+        *out++ = ' ';
+        memcpy(out, payload.data(), payload.size());
+    }
+}
+
+void encode_command(framing_enum framing, opcode_enum opcode, std::string_view topic,
+    std::string_view payload, std::string& out) {
+    out.resize(command_size(framing, opcode, topic, payload));
+    encode_command(framing, opcode, topic, payload, out.data());
+}
+
+void encode_command_id(opcode_enum opcode, uint16_t topic_id, std::string_view payload, char* out) {
+
+    FrameHeader l_header;
+    l_header.length = payload.size();
+    l_header.opcode = opcode;
+    l_header.flags = FLAG_TOPIC_ID;
+    l_header.topic_len = topic_id;
+
+    encode_header(out, l_header);
+    memcpy(out + FRAME_HEADER_SIZE, payload.data(), payload.size());
+}
+
+void encode_command_id(opcode_enum opcode, uint16_t topic_id, std::string_view payload, std::string& out) {
+    out.resize(command_id_size(payload));
+    encode_command_id(opcode, topic_id, payload, out.data());
+}
+
+void encode_bind(uint16_t topic_id, std::string_view topic, char* out) {
+    uint16_t l_id = htons(topic_id);
+    encode_command(FRAMING_BINARY, OP_BIND, topic, std::string_view((const char*)&l_id, 2), out);
+}
+
+void encode_bind(uint16_t topic_id, std::string_view topic, std::string& out) {
+    out.resize(bind_size(topic));
+    encode_bind(topic_id, topic, out.data());
+}
+
+bool decode_bind(std::string_view payload, uint16_t& topic_id) {
+    uint16_t l_id;
+    if (payload.size() != 2) { return false; }
+    memcpy(&l_id, payload.data(), 2);
+    topic_id = ntohs(l_id);
+    return topic_id != 0;
+}
+
+bool batch_next(std::string_view& body, std::string_view& frame) {
+
+    FrameHeader l_header;
+    if (body.size() < FRAME_HEADER_SIZE) { return false; }
+    decode_header(body.data(), l_header);
+    if (l_header.length > body.size() - FRAME_HEADER_SIZE) { return false; }
+
+    frame = body.substr(0, FRAME_HEADER_SIZE + l_header.length);
+    body.remove_prefix(frame.size());
+    return true;
+}
+
+bool decode_message(framing_enum framing, std::string_view frame, uint8_t& opcode,
+    uint16_t& topic_id, std::string_view& topic, std::string_view& payload) {
+
+    topic_id = 0;
+
+    if (framing == FRAMING_BINARY) {
+        FrameHeader l_header;
+        if (frame.size() < FRAME_HEADER_SIZE) { return false; }
+        decode_header(frame.data(), l_header);
+        if (l_header.length != frame.size() - FRAME_HEADER_SIZE) {
+            return false;
+        }
+        opcode = l_header.opcode;
+
+        // Sequence number sits between header and topic
+        size_t l_body = FRAME_HEADER_SIZE;
+        if (l_header.flags & FLAG_SEQ) {
+            if (l_header.length < SEQ_SIZE) { return false; }
+            l_body += SEQ_SIZE;
+            l_header.length -= SEQ_SIZE;
+        }
+
+        // Frame on a bound topic has no topic bytes
+        if (l_header.flags & FLAG_TOPIC_ID) {
+            if (l_header.topic_len == 0) { return false; }
+            topic_id = l_header.topic_len;
+            topic = std::string_view();
+            payload = frame.substr(l_body);
+            return true;
+        }
+        if (l_header.topic_len > l_header.length) { return false; }
+        topic = frame.substr(l_body, l_header.topic_len);
+        payload = frame.substr(l_body + l_header.topic_len);
+        return true;
+    }
+
+    // Text message is "<topic> <payload>"
+    size_t l_space = frame.find(' ');
+    opcode = OP_MESSAGE;
+    topic = frame.substr(0, l_space);
+    payload = l_space == std::string_view::npos ? std::string_view() : frame.substr(l_space + 1);
+    return true;
+}
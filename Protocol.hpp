@@ -0,0 +1,131 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Protocol.hpp
+// Product : PubSubx
+// Brief   : Wire format of PubSubX frames, text (EOM) and binary (length prefix)
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_PROTOCOL_H
+#define PUBSUBX_PROTOCOL_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define EOM "\n\nx"             // End of message string
+#define BINARY_TAG "BINARY"     // Added to CONNECT / OK / RESTORED when binary framing is used
+#define TOPIC_IDS_TAG "TOPIC_IDS" // Added after BINARY_TAG when topic ID bindings are used
+#define COMPRESS_TAG "DEFLATE"  // Added after BINARY_TAG when compressed payloads are accepted
+#define BATCH_TAG "BATCH"       // Added after BINARY_TAG when OP_PUBLISH_BATCH is accepted
+#define SEQ_TAG "SEQ"           // Added after BINARY_TAG when messages carry topic sequence numbers
+#define SHM_TAG "SHM"           // Added to CONNECT / OK / RESTORED when frames go through the shared memory link passed with CONNECT
+#define FRAME_HEADER_SIZE 8     // Size of the binary frame header
+#define MAX_FRAME_SIZE ((64)*(1024)*(1024)) // Largest accepted binary frame body
+#define SEQ_SIZE 8              // Size of a sequence number on the wire
+
+// Framing of everything that follows the CONNECT handshake
+enum framing_enum {
+    FRAMING_TEXT,               // Frames end with EOM, default and compatible mode
+    FRAMING_BINARY              // Frames start with a fixed size header
+};
+
+// Binary frame opcodes
+enum opcode_enum : uint8_t {
+    OP_PUBLISH = 1,             // Client -> server, publish payload on topic
+    OP_SUBSCRIBE,               // Client -> server, subscribe to topic
+    OP_UNSUBSCRIBE,             // Client -> server, unsubscribe from topic
+    OP_DISCONNECT,              // Client -> server, close session
+    OP_MESSAGE,                 // Server -> client, payload received on topic
+    OP_BIND,                    // Client -> server, bind topic to ID, payload is 16 bit ID
+    OP_BOUND,                   // Server -> client, binding confirmed, same layout as OP_BIND
+    OP_PUBLISH_BATCH,           // Client -> server, no topic, body is a sequence of OP_PUBLISH frames
+    OP_RESUME                   // Client -> server, topic and its last seen sequence, empty topic ends the list
+};
+
+// Binary frame flags
+#define FLAG_TOPIC_ID 0x01      // Topic length field carries a bound topic ID, body is payload only
+#define FLAG_COMPRESSED 0x02    // Payload is compressed (Compression.hpp), only sent to peers that accepted COMPRESS_TAG
+#define FLAG_SEQ 0x04           // Sequence number of the topic follows the header, counted in body length
+#define FLAG_REPLAY 0x08        // Message is replayed from the session history on resume
+
+// Binary frame header, all fields are big endian on the wire
+//   0..3  body length (topic + payload)
+//   4     opcode
+//   5     flags
+//   6..7  topic length, or topic ID with FLAG_TOPIC_ID
+struct FrameHeader {
+    uint32_t length;
+    uint8_t  opcode;
+    uint8_t  flags;
+    uint16_t topic_len;
+};
+
+
+/******************************************************************************/
+/*******************          PROTOCOL FUNCTIONS          *********************/
+/******************************************************************************/
+void encode_header(char* out, const FrameHeader& header);
+void decode_header(const char* in, FrameHeader& header);
+
+// Encode one command without text trailer (EOM is added by the send engine).
+// The char* forms write exactly the matching *_size() bytes into out.
+size_t command_size(framing_enum framing, opcode_enum opcode, std::string_view topic, std::string_view payload);
+void encode_command(framing_enum framing, opcode_enum opcode, std::string_view topic,
+    std::string_view payload, char* out);
+void encode_command(framing_enum framing, opcode_enum opcode, std::string_view topic,
+    std::string_view payload, std::string& out);
+
+// Encode binary command on a bound topic, frame carries only the ID
+inline size_t command_id_size(std::string_view payload) { return FRAME_HEADER_SIZE + payload.size(); }
+void encode_command_id(opcode_enum opcode, uint16_t topic_id, std::string_view payload, char* out);
+void encode_command_id(opcode_enum opcode, uint16_t topic_id, std::string_view payload, std::string& out);
+
+// Encode OP_BIND of a topic to ID / read the ID from OP_BIND or OP_BOUND payload
+inline size_t bind_size(std::string_view topic) { return FRAME_HEADER_SIZE + topic.size() + 2; }
+void encode_bind(uint16_t topic_id, std::string_view topic, char* out);
+void encode_bind(uint16_t topic_id, std::string_view topic, std::string& out);
+bool decode_bind(std::string_view payload, uint16_t& topic_id);
+
+// Flags of a binary frame, text frames have none
+inline uint8_t frame_flags(framing_enum framing, std::string_view frame) {
+    return framing == FRAMING_BINARY && frame.size() >= FRAME_HEADER_SIZE ? (uint8_t)frame[5] : 0;
+}
+
+// Big endian sequence numbers, carried by FLAG_SEQ frames and OP_RESUME payloads
+void     encode_seq(char* out, uint64_t seq);
+uint64_t decode_seq(const char* in);
+
+// Sequence number of a received frame, 0 if it carries none
+inline uint64_t frame_seq(framing_enum framing, std::string_view frame) {
+    return (frame_flags(framing, frame) & FLAG_SEQ) && frame.size() >= FRAME_HEADER_SIZE + SEQ_SIZE
+        ? decode_seq(frame.data() + FRAME_HEADER_SIZE) : 0;
+}
+
+// Split the next frame off the body of OP_PUBLISH_BATCH, false at the end or if the rest is malformed
+bool batch_next(std::string_view& body, std::string_view& frame);
+
+// Split a received frame into opcode, topic and payload, false if malformed.
+// Topic ID is set for frames on a bound topic (topic is empty), otherwise 0.
+bool decode_message(framing_enum framing, std::string_view frame, uint8_t& opcode,
+    uint16_t& topic_id, std::string_view& topic, std::string_view& payload);
+
+#endif
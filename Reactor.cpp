@@ -0,0 +1,408 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Reactor.cpp
+// Product : PubSubx
+// Brief   : Pluggable event loop backends (select, epoll, io_uring)
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Reactor.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#ifdef PUBSUBX_HAVE_IO_URING
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+
+/******************************************************************************/
+/**********************          REACTOR FACTORY          *********************/
+/******************************************************************************/
+std::unique_ptr<Reactor> Reactor::create(reactor_type_enum type) {
+
+    switch (type) {
+    case REACTOR_SELECT:
+        return std::unique_ptr<Reactor>(new SelectReactor());
+
+    case REACTOR_EPOLL: {
+        std::unique_ptr<EpollReactor> l_epoll(new EpollReactor());
+        if (!l_epoll->ok()) { return nullptr; }
+        return std::move(l_epoll);
+    }
+
+#ifdef PUBSUBX_HAVE_IO_URING
+    case REACTOR_URING: {
+        std::unique_ptr<UringReactor> l_uring(new UringReactor());
+        if (!l_uring->ok()) { return nullptr; }
+        return std::move(l_uring);
+    }
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+reactor_type_enum Reactor::parse(const std::string& name) {
+    if (name == "select") { return REACTOR_SELECT; }
+    if (name == "epoll")  { return REACTOR_EPOLL; }
+    if (name == "uring")  { return REACTOR_URING; }
+    return MAX_REACTORS;
+}
+
+
+/******************************************************************************/
+/*********************          SELECT REACTOR          ***********************/
+/******************************************************************************/
+bool SelectReactor::add(int fd, bool want_write) {
+    if (fd >= FD_SETSIZE) { return false; }
+    m_fds[fd] = { want_write, true };
+    return true;
+}
+
+bool SelectReactor::modify(int fd, bool want_write, bool want_read) {
+    m_fds[fd] = { want_write, want_read };
+    return true;
+}
+
+void SelectReactor::remove(int fd) {
+    m_fds.erase(fd);
+}
+
+int SelectReactor::wait(ReactorEvent* events, int max_events, int timeout_ms) {
+
+    fd_set l_readfds, l_writefds, l_errorfds;
+    struct timeval l_tv;
+    int l_nfds = 0;
+
+    // Rebuild sets on every call, select overwrites them
+    FD_ZERO(&l_readfds);
+    FD_ZERO(&l_writefds);
+    FD_ZERO(&l_errorfds);
+    for (auto& l_fd : m_fds) {
+        if (l_fd.second.want_read) {
+            FD_SET(l_fd.first, &l_readfds);
+        }
+        FD_SET(l_fd.first, &l_errorfds);
+        if (l_fd.second.want_write) {
+            FD_SET(l_fd.first, &l_writefds);
+        }
+        l_nfds = std::max(l_nfds, l_fd.first);
+    }
+
+    l_tv.tv_sec = timeout_ms / 1000;
+    l_tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    int l_ready = select(l_nfds + 1, &l_readfds, &l_writefds, &l_errorfds, timeout_ms < 0 ? NULL : &l_tv);
+    if (l_ready <= 0) {
+        return l_ready;
+    }
+
+    int l_count = 0;
+    for (auto& l_fd : m_fds) {
+        if (l_count == max_events) { break; }
+        ReactorEvent& l_ev = events[l_count];
+        l_ev.fd = l_fd.first;
+        l_ev.readable = FD_ISSET(l_fd.first, &l_readfds);
+        l_ev.writable = FD_ISSET(l_fd.first, &l_writefds);
+        l_ev.error = FD_ISSET(l_fd.first, &l_errorfds);
+        if (l_ev.readable || l_ev.writable || l_ev.error) {
+            l_count++;
+        }
+    }
+    return l_count;
+}
+
+
+/******************************************************************************/
+/**********************          EPOLL REACTOR          ***********************/
+/******************************************************************************/
+EpollReactor::EpollReactor() {
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+EpollReactor::~EpollReactor() {
+    if (m_epfd >= 0) { close(m_epfd); }
+}
+
+bool EpollReactor::add(int fd, bool want_write) {
+    struct epoll_event l_ev;
+    l_ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (want_write ? EPOLLOUT : 0);
+    l_ev.data.fd = fd;
+    return epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &l_ev) == 0;
+}
+
+bool EpollReactor::modify(int fd, bool want_write, bool want_read) {
+    // MOD re-evaluates readiness, so newly requested interest fires at once
+    struct epoll_event l_ev;
+    l_ev.events = EPOLLET | (want_read ? EPOLLIN | EPOLLRDHUP : 0) | (want_write ? EPOLLOUT : 0);
+    l_ev.data.fd = fd;
+    return epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &l_ev) == 0;
+}
+
+void EpollReactor::remove(int fd) {
+    epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EpollReactor::wait(ReactorEvent* events, int max_events, int timeout_ms) {
+
+    struct epoll_event l_evs[REACTOR_MAX_EVENTS];
+    if (max_events > REACTOR_MAX_EVENTS) { max_events = REACTOR_MAX_EVENTS; }
+
+    int l_ready = epoll_wait(m_epfd, l_evs, max_events, timeout_ms);
+    for (int i = 0; i < l_ready; i++) {
+        events[i].fd = l_evs[i].data.fd;
+        events[i].readable = l_evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP);
+        events[i].writable = l_evs[i].events & EPOLLOUT;
+        events[i].error = l_evs[i].events & EPOLLERR;
+    }
+    return l_ready;
+}
+
+
+#ifdef PUBSUBX_HAVE_IO_URING
+/******************************************************************************/
+/**********************          URING REACTOR          ***********************/
+/******************************************************************************/
+#define URING_ENTRIES   64
+#define URING_TAG_NONE  (~0ULL)    // user_data of requests whose completion is ignored
+
+static inline unsigned uring_load(unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void uring_store(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+UringReactor::UringReactor() {
+
+    struct io_uring_params l_params;
+    memset(&l_params, 0, sizeof(l_params));
+
+    int l_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &l_params);
+    if (l_fd < 0) { return; }
+
+    // Timed waits rely on IORING_ENTER_EXT_ARG
+    if (!(l_params.features & IORING_FEAT_EXT_ARG)) {
+        close(l_fd);
+        return;
+    }
+
+    m_sq_size = l_params.sq_off.array + l_params.sq_entries * sizeof(unsigned);
+    m_cq_size = l_params.cq_off.cqes + l_params.cq_entries * sizeof(struct io_uring_cqe);
+    if (l_params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+    }
+
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        m_sq_ptr = nullptr;
+        close(l_fd);
+        return;
+    }
+    if (l_params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED) {
+            m_cq_ptr = nullptr;
+            munmap(m_sq_ptr, m_sq_size);
+            m_sq_ptr = nullptr;
+            close(l_fd);
+            return;
+        }
+    }
+
+    m_sqes_size = l_params.sq_entries * sizeof(struct io_uring_sqe);
+    void* l_sqes = mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l_fd, IORING_OFF_SQES);
+    if (l_sqes == MAP_FAILED) {
+        if (m_cq_ptr != m_sq_ptr) { munmap(m_cq_ptr, m_cq_size); }
+        munmap(m_sq_ptr, m_sq_size);
+        m_sq_ptr = m_cq_ptr = nullptr;
+        close(l_fd);
+        return;
+    }
+    m_sqes = (struct io_uring_sqe*)l_sqes;
+
+    char* l_sq = (char*)m_sq_ptr;
+    char* l_cq = (char*)m_cq_ptr;
+    m_sq_head = (unsigned*)(l_sq + l_params.sq_off.head);
+    m_sq_tail = (unsigned*)(l_sq + l_params.sq_off.tail);
+    m_sq_mask = (unsigned*)(l_sq + l_params.sq_off.ring_mask);
+    m_sq_array = (unsigned*)(l_sq + l_params.sq_off.array);
+    m_cq_head = (unsigned*)(l_cq + l_params.cq_off.head);
+    m_cq_tail = (unsigned*)(l_cq + l_params.cq_off.tail);
+    m_cq_mask = (unsigned*)(l_cq + l_params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(l_cq + l_params.cq_off.cqes);
+    m_sq_entries = l_params.sq_entries;
+
+    m_ring_fd = l_fd;
+}
+
+UringReactor::~UringReactor() {
+    if (m_ring_fd < 0) { return; }
+    munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != m_sq_ptr) { munmap(m_cq_ptr, m_cq_size); }
+    munmap(m_sq_ptr, m_sq_size);
+    close(m_ring_fd);
+}
+
+struct io_uring_sqe* UringReactor::get_sqe(void) {
+
+    // Submission ring full, flush it before preparing more
+    if (m_to_submit == m_sq_entries) {
+        submit(0);
+    }
+
+    unsigned l_tail = *m_sq_tail + m_to_submit;
+    unsigned l_index = l_tail & *m_sq_mask;
+    struct io_uring_sqe* l_sqe = &m_sqes[l_index];
+    memset(l_sqe, 0, sizeof(*l_sqe));
+    m_sq_array[l_index] = l_index;
+    m_to_submit++;
+    return l_sqe;
+}
+
+int UringReactor::submit(unsigned min_complete) {
+
+    // Publish prepared sqes, one io_uring_enter covers the whole batch
+    uring_store(m_sq_tail, *m_sq_tail + m_to_submit);
+    unsigned l_count = m_to_submit;
+    m_to_submit = 0;
+
+    unsigned l_flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    return syscall(__NR_io_uring_enter, m_ring_fd, l_count, min_complete, l_flags, NULL, 0);
+}
+
+void UringReactor::arm(int fd, Watch& watch) {
+
+    struct io_uring_sqe* l_sqe = get_sqe();
+    l_sqe->opcode = IORING_OP_POLL_ADD;
+    l_sqe->fd = fd;
+    l_sqe->poll32_events = POLLERR | POLLHUP | (watch.want_read ? POLLIN | POLLRDHUP : 0) | (watch.want_write ? POLLOUT : 0);
+    l_sqe->user_data = ((uint64_t)(uint32_t)fd << 32) | watch.generation;
+    watch.armed = true;
+}
+
+bool UringReactor::add(int fd, bool want_write) {
+    Watch& l_watch = m_watches[fd];
+    l_watch.want_write = want_write;
+    l_watch.want_read = true;
+    l_watch.generation++;
+    arm(fd, l_watch);
+    return true;
+}
+
+bool UringReactor::modify(int fd, bool want_write, bool want_read) {
+
+    auto l_it = m_watches.find(fd);
+    if (l_it == m_watches.end()) { return false; }
+    Watch& l_watch = l_it->second;
+    if (l_watch.want_write == want_write && l_watch.want_read == want_read) { return true; }
+
+    // Cancel in flight poll, its completion is dropped by generation check
+    if (l_watch.armed) {
+        struct io_uring_sqe* l_sqe = get_sqe();
+        l_sqe->opcode = IORING_OP_POLL_REMOVE;
+        l_sqe->addr = ((uint64_t)(uint32_t)fd << 32) | l_watch.generation;
+        l_sqe->user_data = URING_TAG_NONE;
+    }
+    l_watch.want_write = want_write;
+    l_watch.want_read = want_read;
+    l_watch.generation++;
+    arm(fd, l_watch);
+    return true;
+}
+
+void UringReactor::remove(int fd) {
+
+    auto l_it = m_watches.find(fd);
+    if (l_it == m_watches.end()) { return; }
+    if (l_it->second.armed) {
+        struct io_uring_sqe* l_sqe = get_sqe();
+        l_sqe->opcode = IORING_OP_POLL_REMOVE;
+        l_sqe->addr = ((uint64_t)(uint32_t)fd << 32) | l_it->second.generation;
+        l_sqe->user_data = URING_TAG_NONE;
+    }
+    m_watches.erase(l_it);
+    submit(0);
+}
+
+int UringReactor::wait(ReactorEvent* events, int max_events, int timeout_ms) {
+
+    // Re-arm and pending changes go out together with the wait
+    uring_store(m_sq_tail, *m_sq_tail + m_to_submit);
+    unsigned l_count = m_to_submit;
+    m_to_submit = 0;
+
+    struct __kernel_timespec l_ts;
+    struct io_uring_getevents_arg l_arg;
+    memset(&l_arg, 0, sizeof(l_arg));
+    unsigned l_flags = IORING_ENTER_EXT_ARG;
+    unsigned l_min = 0;
+    if (timeout_ms != 0) {
+        l_flags |= IORING_ENTER_GETEVENTS;
+        l_min = 1;
+    }
+    if (timeout_ms > 0) {
+        l_ts.tv_sec = timeout_ms / 1000;
+        l_ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        l_arg.ts = (uint64_t)(uintptr_t)&l_ts;
+    }
+
+    int l_ret = syscall(__NR_io_uring_enter, m_ring_fd, l_count, l_min, l_flags, &l_arg, sizeof(l_arg));
+    if (l_ret < 0 && errno != ETIME) {
+        return -1;
+    }
+
+    // Reap completions
+    int l_events = 0;
+    unsigned l_head = *m_cq_head;
+    unsigned l_tail = uring_load(m_cq_tail);
+    while (l_head != l_tail && l_events < max_events) {
+        struct io_uring_cqe* l_cqe = &m_cqes[l_head & *m_cq_mask];
+        l_head++;
+
+        if (l_cqe->user_data == URING_TAG_NONE) { continue; }
+        int l_fd = (int)(l_cqe->user_data >> 32);
+        uint32_t l_gen = (uint32_t)l_cqe->user_data;
+
+        auto l_it = m_watches.find(l_fd);
+        if (l_it == m_watches.end() || l_it->second.generation != l_gen) { continue; }
+        Watch& l_watch = l_it->second;
+        l_watch.armed = false;
+
+        // Poll requests are one shot, re-arm is submitted with the next wait
+        arm(l_fd, l_watch);
+        if (l_cqe->res < 0) { continue; }
+
+        ReactorEvent& l_ev = events[l_events++];
+        l_ev.fd = l_fd;
+        l_ev.readable = l_cqe->res & (POLLIN | POLLRDHUP | POLLHUP);
+        l_ev.writable = l_cqe->res & POLLOUT;
+        l_ev.error = l_cqe->res & POLLERR;
+    }
+    uring_store(m_cq_head, l_head);
+
+    return l_events;
+}
+#endif
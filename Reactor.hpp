@@ -0,0 +1,185 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Reactor.hpp
+// Product : PubSubx
+// Brief   : Pluggable event loop backends (select, epoll, io_uring)
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_REACTOR_H
+#define PUBSUBX_REACTOR_H
+
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/select.h>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define REACTOR_MAX_EVENTS 64   // Maximum number of events returned by one wait
+
+enum reactor_type_enum {
+    REACTOR_SELECT,             // Portable select, level triggered
+    REACTOR_EPOLL,              // Edge triggered epoll
+    REACTOR_URING,              // io_uring poll requests with batched submission
+    MAX_REACTORS
+};
+
+// Single readiness notification
+struct ReactorEvent {
+    int  fd;
+    bool readable;
+    bool writable;
+    bool error;
+};
+
+
+/******************************************************************************/
+/**********************          REACTOR CLASS           **********************/
+/******************************************************************************/
+// Every registered fd is watched for error, read interest is on unless
+// paused and write interest is optional. Users must drain fds until EAGAIN
+// since backends may be edge triggered.
+class Reactor {
+
+public:
+    virtual ~Reactor() {}
+
+    virtual bool add(int fd, bool want_write) = 0;
+    virtual bool modify(int fd, bool want_write, bool want_read = true) = 0;
+    virtual void remove(int fd) = 0;
+
+    // Wait for events, timeout in ms (-1 blocks). Returns number of events
+    // or -1 on failure (errno is set)
+    virtual int  wait(ReactorEvent* events, int max_events, int timeout_ms) = 0;
+
+    virtual const char* name(void) const = 0;
+
+    // Backend factory, returns nullptr if backend is unavailable
+    static std::unique_ptr<Reactor> create(reactor_type_enum type);
+
+    // Parse backend name ("select", "epoll", "uring"), returns MAX_REACTORS if unknown
+    static reactor_type_enum parse(const std::string& name);
+};
+
+
+/******************************************************************************/
+/*******************          SELECT REACTOR CLASS           ******************/
+/******************************************************************************/
+class SelectReactor : public Reactor {
+
+public:
+    bool add(int fd, bool want_write) override;
+    bool modify(int fd, bool want_write, bool want_read = true) override;
+    void remove(int fd) override;
+    int  wait(ReactorEvent* events, int max_events, int timeout_ms) override;
+    const char* name(void) const override { return "select"; }
+
+private:
+    struct Interest {
+        bool want_write;
+        bool want_read;
+    };
+
+    std::map<int, Interest> m_fds;
+};
+
+
+/******************************************************************************/
+/*******************          EPOLL REACTOR CLASS           *******************/
+/******************************************************************************/
+class EpollReactor : public Reactor {
+
+public:
+    EpollReactor();
+    ~EpollReactor();
+
+    bool ok(void) const { return m_epfd >= 0; }
+
+    bool add(int fd, bool want_write) override;
+    bool modify(int fd, bool want_write, bool want_read = true) override;
+    void remove(int fd) override;
+    int  wait(ReactorEvent* events, int max_events, int timeout_ms) override;
+    const char* name(void) const override { return "epoll"; }
+
+private:
+    int m_epfd;
+};
+
+
+#ifdef PUBSUBX_HAVE_IO_URING
+/******************************************************************************/
+/*******************          URING REACTOR CLASS           *******************/
+/******************************************************************************/
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+class UringReactor : public Reactor {
+
+public:
+    UringReactor();
+    ~UringReactor();
+
+    bool ok(void) const { return m_ring_fd >= 0; }
+
+    bool add(int fd, bool want_write) override;
+    bool modify(int fd, bool want_write, bool want_read = true) override;
+    void remove(int fd) override;
+    int  wait(ReactorEvent* events, int max_events, int timeout_ms) override;
+    const char* name(void) const override { return "uring"; }
+
+private:
+    struct Watch {
+        bool     want_write;
+        bool     want_read;
+        uint32_t generation;        // Completions of older generations are stale
+        bool     armed;             // Poll request is in flight
+    };
+
+    int       m_ring_fd = -1;
+    void*     m_sq_ptr = nullptr;
+    void*     m_cq_ptr = nullptr;
+    size_t    m_sq_size = 0;
+    size_t    m_cq_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t    m_sqes_size = 0;
+
+    // Mapped ring fields
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_mask;
+    unsigned* m_sq_array;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned* m_cq_mask;
+    io_uring_cqe* m_cqes;
+    unsigned  m_sq_entries;
+
+    unsigned  m_to_submit = 0;      // Prepared but not yet submitted sqes
+    std::map<int, Watch> m_watches;
+
+    io_uring_sqe* get_sqe(void);
+    void arm(int fd, Watch& watch);
+    int  submit(unsigned min_complete);
+};
+#endif
+
+#endif
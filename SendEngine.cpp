@@ -0,0 +1,226 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : SendEngine.cpp
+// Product : PubSubx
+// Brief   : Scatter-gather writer of queued messages with exact resume offset
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "SendEngine.hpp"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <algorithm>
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+SendEngine::SendEngine(std::string_view trailer, size_t max_fragment)
+    :m_trailer(trailer),
+    m_max_fragment(max_fragment),
+    m_items(SEND_QUEUE_INIT)
+{
+}
+
+
+/******************************************************************************/
+/**********************          QUEUE FUNCTIONS          *********************/
+/******************************************************************************/
+void SendEngine::configure(std::string_view trailer, size_t max_fragment) {
+    m_trailer = trailer;
+    m_max_fragment = max_fragment;
+}
+
+void SendEngine::push(BufRef&& message, bool droppable) {
+
+    // Full ring doubles, messages are moved to the start of the new one
+    if (m_count == m_items.size()) {
+        std::vector<Item> l_items(m_items.size() * 2);
+        for (size_t i = 0; i < m_count; i++) {
+            l_items[i] = std::move(at(i));
+        }
+        m_items.swap(l_items);
+        m_head = 0;
+    }
+
+    m_queued_bytes += message.size();
+    Item& l_item = at(m_count++);
+    l_item.data = std::move(message);
+    l_item.droppable = droppable;
+}
+
+void SendEngine::push_front(BufRef&& message) {
+
+    if (m_count == m_items.size()) {
+        std::vector<Item> l_items(m_items.size() * 2);
+        for (size_t i = 0; i < m_count; i++) {
+            l_items[i] = std::move(at(i));
+        }
+        m_items.swap(l_items);
+        m_head = 0;
+    }
+
+    m_head = (m_head - 1) & (m_items.size() - 1);
+    m_count++;
+    m_queued_bytes += message.size();
+    at(0).data = std::move(message);
+    at(0).droppable = false;
+}
+
+void SendEngine::clear(void) {
+    for (size_t i = 0; i < m_count; i++) {
+        at(i).data.reset();
+    }
+    m_count = 0;
+    m_offset = 0;
+    m_queued_bytes = 0;
+}
+
+size_t SendEngine::drop_oldest(size_t max_messages, size_t max_bytes) {
+
+    size_t l_dropped = 0;
+
+    // Partially written front message has to be completed, survivors keep their order
+    size_t l_keep = m_offset ? 1 : 0;
+    for (size_t i = l_keep; i < m_count; i++) {
+        Item& l_item = at(i);
+        bool l_over = m_count - l_dropped > max_messages || m_queued_bytes > max_bytes;
+        if (l_over && l_item.droppable) {
+            m_queued_bytes -= l_item.data.size();
+            l_item.data.reset();
+            l_dropped++;
+            continue;
+        }
+        if (i != l_keep) {
+            at(l_keep) = std::move(l_item);
+        }
+        l_keep++;
+    }
+    m_count = l_keep;
+    return l_dropped;
+}
+
+size_t SendEngine::wire_size(const BufRef& message) const {
+    // Empty message is still sent as a single trailer
+    size_t l_fragments = 1;
+    if (m_max_fragment && message.size()) {
+        l_fragments = (message.size() + m_max_fragment - 1) / m_max_fragment;
+    }
+    return message.size() + l_fragments * m_trailer.size();
+}
+
+
+/******************************************************************************/
+/**********************          WRITE FUNCTIONS          *********************/
+/******************************************************************************/
+int SendEngine::gather(struct iovec* iov) {
+
+    int l_iovcnt = 0;
+    size_t l_fragment = m_max_fragment ? m_max_fragment : SIZE_MAX - m_trailer.size();
+    size_t l_stride = l_fragment + m_trailer.size();
+    size_t l_skip = m_offset;
+
+    // Gather fragments and trailers of queued messages, the first one may be
+    // partially written already
+    for (size_t i = 0; i < m_count && l_iovcnt < SEND_IOV_MAX - 1; i++) {
+        std::string_view l_msg = at(i).data.view();
+        size_t l_frag = l_skip / l_stride;
+        size_t l_inside = l_skip % l_stride;
+        l_skip = 0;
+
+        for (size_t l_pos = l_frag * l_fragment; l_iovcnt < SEND_IOV_MAX - 1; l_pos += l_fragment) {
+            size_t l_len = std::min(l_fragment, l_msg.size() - l_pos);
+
+            if (l_inside < l_len) {
+                iov[l_iovcnt].iov_base = (void*)(l_msg.data() + l_pos + l_inside);
+                iov[l_iovcnt].iov_len = l_len - l_inside;
+                l_iovcnt++;
+                l_inside = 0;
+            }
+            else {
+                l_inside -= l_len;
+            }
+            if (l_inside < m_trailer.size()) {
+                iov[l_iovcnt].iov_base = (void*)(m_trailer.data() + l_inside);
+                iov[l_iovcnt].iov_len = m_trailer.size() - l_inside;
+                l_iovcnt++;
+            }
+            l_inside = 0;
+
+            if (l_pos + l_len >= l_msg.size()) { break; }
+        }
+    }
+    return l_iovcnt;
+}
+
+void SendEngine::advance(size_t sent) {
+
+    m_syscalls++;
+    m_bytes += sent;
+
+    // Advance over completely written messages, remember offset in the last one
+    size_t l_left = sent;
+    while (l_left > 0 && m_count) {
+        Item& l_front = at(0);
+        size_t l_remaining = wire_size(l_front.data) - m_offset;
+        if (l_left < l_remaining) {
+            m_offset += l_left;
+            break;
+        }
+        l_left -= l_remaining;
+        m_offset = 0;
+        m_queued_bytes -= l_front.data.size();
+        l_front.data.reset();
+        m_head = (m_head + 1) & (m_items.size() - 1);
+        m_count--;
+        m_messages++;
+    }
+}
+
+ssize_t SendEngine::write(int fd) {
+
+    struct iovec l_iov[SEND_IOV_MAX];
+    int l_iovcnt = gather(l_iov);
+    if (l_iovcnt == 0) {
+        return 0;
+    }
+
+    struct msghdr l_msghdr = {};
+    l_msghdr.msg_iov = l_iov;
+    l_msghdr.msg_iovlen = l_iovcnt;
+
+    ssize_t l_sent = sendmsg(fd, &l_msghdr, MSG_NOSIGNAL);
+    if (l_sent < 0) {
+        return -1;
+    }
+    advance(l_sent);
+    return l_sent;
+}
+
+ssize_t SendEngine::write(ShmRing& ring) {
+
+    struct iovec l_iov[SEND_IOV_MAX];
+    int l_iovcnt = gather(l_iov);
+    if (l_iovcnt == 0) {
+        return 0;
+    }
+
+    ssize_t l_sent = ring.write(l_iov, l_iovcnt);
+    if (l_sent < 0) {
+        return -1;
+    }
+    advance(l_sent);
+    return l_sent;
+}
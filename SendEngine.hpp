@@ -0,0 +1,105 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : SendEngine.hpp
+// Product : PubSubx
+// Brief   : Scatter-gather writer of queued messages with exact resume offset
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_SEND_ENGINE_H
+#define PUBSUBX_SEND_ENGINE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "BufferPool.hpp"
+#include "ShmRing.hpp"
+#include <sys/types.h>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define SEND_IOV_MAX 256        // Maximum number of iovec entries in one write
+#define SEND_QUEUE_INIT 256     // Initial slots of the message ring, grows by doubling
+
+
+/******************************************************************************/
+/********************          SEND ENGINE CLASS           ********************/
+/******************************************************************************/
+// Queued messages are split into fragments of at most max_fragment bytes and
+// every fragment is followed by the trailer (EOM). Binary frames use no
+// trailer and max_fragment 0, which disables fragmentation. Fragments and trailers are
+// gathered straight from the queued buffers into one iovec, nothing is
+// copied. A partial write leaves an exact offset into the front message.
+// Queue is a ring of slots that only grows, so steady state allocates nothing.
+// Messages pushed as droppable may be evicted by drop_oldest() while they
+// have not started going out.
+class SendEngine {
+
+public:
+    SendEngine(std::string_view trailer, size_t max_fragment);
+
+    void   configure(std::string_view trailer, size_t max_fragment);
+    void   push(BufRef&& message, bool droppable = false);
+    void   push_front(BufRef&& message);    // Goes out first, only before the front started (rewind)
+    bool   empty(void) const { return m_count == 0; }
+    size_t size(void) const { return m_count; }
+    size_t queued_bytes(void) const { return m_queued_bytes; }  // Sum of queued message sizes
+    void   clear(void);
+
+    // Evict oldest droppable messages until both limits hold, returns number evicted
+    size_t drop_oldest(size_t max_messages, size_t max_bytes);
+    void   rewind(void) { m_offset = 0; }   // Resend front message from start (new connection)
+
+    // Write as much as the socket accepts with one sendmsg call. Returns
+    // number of bytes written or -1 with errno set (EAGAIN if socket is full)
+    ssize_t write(int fd);
+    ssize_t write(ShmRing& ring);           // Same into one record of a shared memory ring
+
+    // Coalescing statistics
+    uint64_t syscalls(void) const { return m_syscalls; }
+    uint64_t bytes(void) const { return m_bytes; }
+    uint64_t messages(void) const { return m_messages; }
+    double   bytes_per_syscall(void) const { return m_syscalls ? (double)m_bytes / m_syscalls : 0; }
+
+private:
+    struct Item {
+        BufRef data;
+        bool   droppable = false;
+    };
+
+    std::string        m_trailer;
+    size_t             m_max_fragment;
+    std::vector<Item>  m_items;         // Ring, size is a power of two
+    size_t             m_head = 0;      // Slot of the front message
+    size_t             m_count = 0;
+    size_t             m_offset = 0;    // Wire bytes of front message already written
+    size_t             m_queued_bytes = 0;
+
+    uint64_t           m_syscalls = 0;
+    uint64_t           m_bytes = 0;
+    uint64_t           m_messages = 0;
+
+    Item&  at(size_t index) { return m_items[(m_head + index) & (m_items.size() - 1)]; }
+    size_t wire_size(const BufRef& message) const;
+    int    gather(struct iovec* iov);       // Fills at most SEND_IOV_MAX entries, returns their number
+    void   advance(size_t sent);            // Drops written messages
+};
+
+#endif
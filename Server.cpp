@@ -0,0 +1,1056 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Server.cpp
+// Product : PubSubx
+// Brief   : Reference PubSubX broker, sharded reactors with shared fan-out
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Server.hpp"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#define MAX_SESSION_NAME 64     // Same limit as client names
+
+
+/******************************************************************************/
+/*******************          SUBSCRIBER TABLE          ***********************/
+/******************************************************************************/
+static bool is_wildcard(string_view topic) {
+    return topic.find_first_of(TOPIC_SINGLE TOPIC_MULTI) != string_view::npos;
+}
+
+void SubscriberTable::add(const string& topic, const SessionPtr& session) {
+
+    if (is_wildcard(topic)) {
+        unique_lock<shared_mutex> l_lock(m_wild_lock);
+        vector<SessionPtr>* l_list = m_wild.find(topic);
+        if (!l_list) {
+            m_wild.insert(topic, {});
+            l_list = m_wild.find(topic);
+        }
+        l_list->push_back(session);
+        m_wild_count++;
+        return;
+    }
+
+    Stripe& l_stripe = stripe(topic);
+    unique_lock<shared_mutex> l_lock(l_stripe.lock);
+    l_stripe.topics[topic].push_back(session);
+}
+
+void SubscriberTable::remove(const string& topic, const SessionPtr& session) {
+
+    auto l_erase = [&](vector<SessionPtr>& list) {
+        auto l_it = find(list.begin(), list.end(), session);
+        if (l_it == list.end()) { return false; }
+        *l_it = std::move(list.back());
+        list.pop_back();
+        return true;
+    };
+
+    if (is_wildcard(topic)) {
+        unique_lock<shared_mutex> l_lock(m_wild_lock);
+        vector<SessionPtr>* l_list = m_wild.find(topic);
+        if (l_list && l_erase(*l_list)) {
+            m_wild_count--;
+            if (l_list->empty()) { m_wild.erase(topic); }
+        }
+        return;
+    }
+
+    Stripe& l_stripe = stripe(topic);
+    unique_lock<shared_mutex> l_lock(l_stripe.lock);
+    auto l_it = l_stripe.topics.find(topic);
+    if (l_it != l_stripe.topics.end() && l_erase(l_it->second) && l_it->second.empty()) {
+        l_stripe.topics.erase(l_it);
+    }
+}
+
+void SubscriberTable::match(string_view topic, vector<SessionPtr>& out) {
+
+    size_t l_start = out.size();
+    {
+        Stripe& l_stripe = stripe(topic);
+        shared_lock<shared_mutex> l_lock(l_stripe.lock);
+        auto l_it = l_stripe.topics.find(topic);
+        if (l_it != l_stripe.topics.end()) {
+            out.insert(out.end(), l_it->second.begin(), l_it->second.end());
+        }
+    }
+
+    if (m_wild_count == 0) { return; }
+
+    size_t l_exact = out.size();
+    {
+        shared_lock<shared_mutex> l_lock(m_wild_lock);
+        m_wild.match(topic, [&](vector<SessionPtr>& list) {
+            out.insert(out.end(), list.begin(), list.end());
+        });
+    }
+
+    // A session subscribed through several filters gets the message once
+    if (out.size() > l_exact && out.size() - l_start > 1) {
+        sort(out.begin() + l_start, out.end());
+        out.erase(unique(out.begin() + l_start, out.end()), out.end());
+    }
+}
+
+
+/******************************************************************************/
+/*************************          SHARD          ****************************/
+/******************************************************************************/
+Shard::Shard(Server& server, int index, reactor_type_enum reactor)
+    :m_server(server),
+    m_index(index)
+{
+    m_reactor = Reactor::create(reactor);
+    if (!m_reactor) {
+        m_reactor = Reactor::create(REACTOR_EPOLL);
+    }
+}
+
+Shard::~Shard() {
+    join();
+}
+
+void Shard::start(void) {
+    m_outbox.resize(m_server.shards());
+    m_thread = thread(&Shard::loop, this);
+}
+
+void Shard::join(void) {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void Shard::post(vector<ShardMail>& mail) {
+
+    bool l_wake;
+    {
+        lock_guard<mutex> l_lock(m_inbox_lock);
+        l_wake = m_inbox.empty();
+        if (l_wake) {
+            m_inbox.swap(mail);
+        }
+        else {
+            move(mail.begin(), mail.end(), back_inserter(m_inbox));
+        }
+    }
+    mail.clear();
+
+    // Shard drains the eventfd before taking the inbox, one write per batch is enough
+    if (l_wake) {
+        m_notifier.force();
+    }
+}
+
+void Shard::loop(void) {
+
+    ReactorEvent l_events[REACTOR_MAX_EVENTS];
+    m_reactor->add(m_notifier.fd(), false);
+
+    while (true) {
+        int l_count = m_reactor->wait(l_events, REACTOR_MAX_EVENTS, -1);
+        if (l_count < 0) {
+            if (errno == EINTR) { continue; }
+            cerr << "ERROR: shard " << m_index << " event loop failed: " << strerror(errno) << "\n";
+            break;
+        }
+
+        bool l_stop = false;
+        for (int i = 0; i < l_count; i++) {
+            ReactorEvent& l_ev = l_events[i];
+
+            if (l_ev.fd == m_notifier.fd()) {
+                m_notifier.drain();
+                l_stop = !inbox_drain();
+                continue;
+            }
+
+            // Client committed to the link or made room in it
+            auto l_link = m_links.find(l_ev.fd);
+            if (l_link != m_links.end()) {
+                Connection* l_conn = l_link->second;
+                l_conn->link->drain();
+                if (read(l_conn) && !write(l_conn)) {
+                    close_conn(l_conn, true);
+                }
+                continue;
+            }
+
+            auto l_it = m_conns.find(l_ev.fd);
+            if (l_it == m_conns.end()) { continue; }
+            Connection* l_conn = l_it->second.get();
+
+            // Socket of a link carries nothing after CONNECT, any event means the client is gone
+            if (l_conn->link) {
+                if (read(l_conn)) {
+                    close_conn(l_conn, true);
+                }
+                continue;
+            }
+
+            if ((l_ev.readable || l_ev.error) && !read(l_conn)) {
+                continue;
+            }
+            if (l_ev.writable && !write(l_conn)) {
+                close_conn(l_conn, true);
+            }
+        }
+
+        // Hand over messages for other shards, then write everything queued here
+        outbox();
+
+        vector<Connection*> l_dirty;
+        l_dirty.swap(m_dirty);
+        for (Connection* l_conn : l_dirty) {
+            l_conn->dirty = false;
+            if (!write(l_conn)) {
+                close_conn(l_conn, true);
+            }
+        }
+
+        if (l_stop) { break; }
+    }
+
+    // Connections of a stopped server keep their sessions, the process ends anyway
+    while (!m_conns.empty()) {
+        close_conn(m_conns.begin()->second.get(), true);
+    }
+    m_reactor->remove(m_notifier.fd());
+}
+
+bool Shard::inbox_drain(void) {
+
+    vector<ShardMail> l_mail;
+    {
+        lock_guard<mutex> l_lock(m_inbox_lock);
+        l_mail.swap(m_inbox);
+    }
+
+    bool l_running = true;
+    for (ShardMail& l_item : l_mail) {
+        switch (l_item.type) {
+        case MAIL_ACCEPT:
+            accept(l_item.fd);
+            break;
+        case MAIL_DELIVER:
+            route(l_item.session, l_item.message);
+            break;
+        case MAIL_STOP:
+            l_running = false;
+            break;
+        }
+    }
+    return l_running;
+}
+
+void Shard::outbox(void) {
+    for (size_t i = 0; i < m_outbox.size(); i++) {
+        if (!m_outbox[i].empty()) {
+            m_server.shard(i).post(m_outbox[i]);
+        }
+    }
+}
+
+void Shard::accept(int fd) {
+
+    // Fails harmlessly on unix sockets, they have no Nagle delay
+    int l_one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &l_one, sizeof(l_one));
+
+    unique_ptr<Connection> l_conn(new Connection());
+    l_conn->fd = fd;
+    if (!m_reactor->add(fd, false)) {
+        close(fd);
+        return;
+    }
+    m_conns.emplace(fd, std::move(l_conn));
+}
+
+void Shard::close_conn(Connection* conn, bool keep_session) {
+
+    // Lost connection keeps the session for RESTORED, DISCONNECT already ended it
+    if (conn->session && keep_session) {
+        lock_guard<mutex> l_lock(conn->session->lock);
+        if (conn->session->conn == conn) {
+            conn->session->conn = nullptr;
+            conn->session->shard = -1;
+        }
+    }
+
+    if (conn->dirty) {
+        m_dirty.erase(find(m_dirty.begin(), m_dirty.end(), conn));
+    }
+    if (conn->link) {
+        m_reactor->remove(conn->link->fd());
+        m_links.erase(conn->link->fd());
+        conn->link.reset();
+    }
+    offered_close(conn);
+    m_reactor->remove(conn->fd);
+    shutdown(conn->fd, SHUT_RDWR);
+    close(conn->fd);
+    m_conns.erase(conn->fd);
+}
+
+void Shard::offered_close(Connection* conn) {
+    for (int i = 0; i < conn->offered_count; i++) {
+        close(conn->offered[i]);
+    }
+    conn->offered_count = 0;
+}
+
+
+/******************************************************************************/
+/**********************          RECEIVE FUNCTIONS          *******************/
+/******************************************************************************/
+bool Shard::read(Connection* conn) {
+
+    // Drain socket (or link), frames are handled after every read so the buffer stays small.
+    // Descriptors of a link may come along with CONNECT.
+    while (true) {
+        char* l_buf = conn->framer.prepare(SERVER_READ_SIZE);
+        ssize_t l_size;
+        if (conn->link) {
+            l_size = conn->link->recv(l_buf, SERVER_READ_SIZE);
+        }
+        else if (!conn->session) {
+            int l_fds[SHM_FDS];
+            int l_count;
+            l_size = ShmLink::receive(conn->fd, l_buf, SERVER_READ_SIZE, l_fds, l_count);
+            if (l_count > 0) {
+                offered_close(conn);
+                copy(l_fds, l_fds + l_count, conn->offered);
+                conn->offered_count = l_count;
+            }
+        }
+        else {
+            l_size = recv(conn->fd, l_buf, SERVER_READ_SIZE, 0);
+        }
+
+        if (l_size < 0 && errno == EINTR) { continue; }
+        if (l_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Empty ring is read again if the client committed something while the wakeup was armed
+            if (conn->link && !conn->link->sleep()) { continue; }
+            break;
+        }
+        if (l_size <= 0) {
+            close_conn(conn, true);
+            return false;
+        }
+        conn->framer.commit(l_size);
+
+        string_view l_frame;
+        while (conn->framer.next(l_frame)) {
+            if (!frame(conn, l_frame)) { return false; }
+        }
+        if (conn->framer.error()) {
+            close_conn(conn, true);
+            return false;
+        }
+    }
+
+    // Fragmented publish is complete once nothing more is buffered
+    if (conn->pending && conn->framer.pending() == 0) {
+        flush_pending(conn);
+    }
+    return true;
+}
+
+static bool starts_with_command(string_view frame) {
+    static const string_view l_commands[] = { "CONNECT ", "PUBLISH ", "SUBSCRIBE ", "UNSUBSCRIBE ", "DISCONNECT" };
+    for (string_view l_cmd : l_commands) {
+        if (frame.substr(0, l_cmd.size()) == l_cmd) { return true; }
+    }
+    return false;
+}
+
+bool Shard::frame(Connection* conn, string_view frame) {
+
+    // First frame must be the text CONNECT
+    if (!conn->session) {
+        if (frame.substr(0, strlen("CONNECT ")) != "CONNECT ") {
+            close_conn(conn, false);
+            return false;
+        }
+        return command_connect(conn, frame.substr(strlen("CONNECT ")));
+    }
+
+    if (conn->framing == FRAMING_BINARY) {
+        uint8_t l_opcode;
+        uint16_t l_topic_id;
+        string_view l_topic, l_payload;
+
+        if (!decode_message(FRAMING_BINARY, frame, l_opcode, l_topic_id, l_topic, l_payload)) {
+            return true;
+        }
+        if (l_topic_id != 0) {
+            if (l_topic_id >= conn->id_topics.size()) { return true; }
+            l_topic = conn->id_topics[l_topic_id];
+        }
+
+        switch (l_opcode) {
+        case OP_PUBLISH:
+            command_publish(conn, l_topic, l_payload, conn->compress && (frame_flags(FRAMING_BINARY, frame) & FLAG_COMPRESSED));
+            break;
+        case OP_PUBLISH_BATCH: command_publish_batch(conn, l_payload); break;
+        case OP_RESUME:      command_resume(conn, l_topic, l_payload); break;
+        case OP_SUBSCRIBE:   command_subscribe(conn, l_topic); break;
+        case OP_UNSUBSCRIBE: command_unsubscribe(conn, l_topic); break;
+        case OP_BIND:        command_bind(conn, l_topic, l_payload); break;
+        case OP_DISCONNECT:
+            command_disconnect(conn);
+            return false;
+        default: break;
+        }
+        return true;
+    }
+
+    // Clients split text longer than one fragment into several EOM frames,
+    // a full sized PUBLISH is continued by frames that are not commands
+    if (conn->pending) {
+        if (!starts_with_command(frame)) {
+            conn->pending_payload.append(frame);
+            if (frame.size() != SERVER_FRAGMENT) {
+                flush_pending(conn);
+            }
+            return true;
+        }
+        flush_pending(conn);
+    }
+
+    // Text command is "<COMMAND> <topic> <payload>"
+    size_t l_cmd_end = frame.find(' ');
+    string_view l_cmd = frame.substr(0, l_cmd_end);
+    string_view l_rest = l_cmd_end == string_view::npos ? string_view() : frame.substr(l_cmd_end + 1);
+    size_t l_topic_end = l_rest.find(' ');
+    string_view l_topic = l_rest.substr(0, l_topic_end);
+    string_view l_payload = l_topic_end == string_view::npos ? string_view() : l_rest.substr(l_topic_end + 1);
+
+    if (l_cmd == "PUBLISH") {
+        if (frame.size() == SERVER_FRAGMENT) {
+            conn->pending = true;
+            conn->pending_topic = l_topic;
+            conn->pending_payload = l_payload;
+        }
+        else {
+            command_publish(conn, l_topic, l_payload);
+        }
+    }
+    else if (l_cmd == "SUBSCRIBE") {
+        command_subscribe(conn, l_topic);
+    }
+    else if (l_cmd == "UNSUBSCRIBE") {
+        command_unsubscribe(conn, l_topic);
+    }
+    else if (l_cmd == "DISCONNECT") {
+        command_disconnect(conn);
+        return false;
+    }
+    return true;
+}
+
+void Shard::flush_pending(Connection* conn) {
+    conn->pending = false;
+    command_publish(conn, conn->pending_topic, conn->pending_payload);
+    conn->pending_topic.clear();
+    conn->pending_payload.clear();
+}
+
+
+/******************************************************************************/
+/**********************          COMMAND FUNCTIONS          *******************/
+/******************************************************************************/
+bool Shard::command_connect(Connection* conn, string_view args) {
+
+    // Arguments are "<name> [BINARY [TOPIC_IDS] [DEFLATE] [BATCH] [SEQ]] [SHM]"
+    size_t l_end = args.find(' ');
+    string l_name(args.substr(0, l_end));
+    string_view l_options = l_end == string_view::npos ? string_view() : args.substr(l_end);
+    bool l_binary = l_options.find(" " BINARY_TAG) != string_view::npos;
+    bool l_topic_ids = l_binary && l_options.find(" " TOPIC_IDS_TAG) != string_view::npos;
+    bool l_compress = l_binary && compression_available() && l_options.find(" " COMPRESS_TAG) != string_view::npos;
+    bool l_seq = l_binary && l_options.find(" " SEQ_TAG) != string_view::npos;
+
+    bool l_restored = false;
+    SessionPtr l_session;
+    if (!l_name.empty() && l_name.size() <= MAX_SESSION_NAME) {
+        l_session = m_server.session_open(l_name, m_index, conn, l_restored);
+    }
+
+    // Name is online on another connection
+    if (!l_session) {
+        send_reply(conn, string("ERROR") + EOM);
+        write(conn);
+        close_conn(conn, false);
+        return false;
+    }
+    conn->session = l_session;
+
+    // Link takes the offered descriptors, they are closed if it is not valid
+    unique_ptr<ShmLink> l_link;
+    if (l_options.find(" " SHM_TAG) != string_view::npos && conn->offered_count == SHM_FDS) {
+        l_link = ShmLink::attach(conn->offered);
+        conn->offered_count = 0;
+    }
+    offered_close(conn);
+
+    string l_reply = l_restored ? "RESTORED" : "OK";
+    if (l_binary) {
+        l_reply += " " BINARY_TAG;
+        if (l_topic_ids) { l_reply += " " TOPIC_IDS_TAG; }
+        if (l_compress) { l_reply += " " COMPRESS_TAG; }
+        if (l_options.find(" " BATCH_TAG) != string_view::npos) { l_reply += " " BATCH_TAG; }
+        if (l_seq) { l_reply += " " SEQ_TAG; }
+    }
+    if (l_link) { l_reply += " " SHM_TAG; }
+    l_reply += EOM;
+
+    // Restored session gets its topic list and the messages it missed, a history is kept
+    // for the next resume
+    deque<MessagePtr> l_missed;
+    {
+        lock_guard<mutex> l_lock(l_session->lock);
+        l_session->history = l_seq;
+    }
+    if (l_restored) {
+        lock_guard<mutex> l_lock(l_session->lock);
+        bool l_first = true;
+        for (const string& l_topic : l_session->topics) {
+            if (!l_first) { l_reply += " "; }
+            l_reply += l_topic;
+            l_first = false;
+        }
+        l_reply += EOM;
+        if (l_seq) {
+            l_missed = l_session->missed;
+        }
+        else {
+            l_missed.swap(l_session->missed);
+        }
+    }
+    send_reply(conn, std::move(l_reply));
+
+    // Reply still goes over the socket, it is written before the link takes over
+    if (l_link) {
+        if (!write(conn) || !conn->out.empty()) {
+            close_conn(conn, true);
+            return false;
+        }
+        conn->link = std::move(l_link);
+        m_reactor->add(conn->link->fd(), false);
+        m_links[conn->link->fd()] = conn;
+    }
+
+    // Everything after the reply uses negotiated framing
+    conn->framing = l_binary ? FRAMING_BINARY : FRAMING_TEXT;
+    conn->topic_ids = l_topic_ids;
+    conn->compress = l_compress;
+    conn->seq = l_seq;
+    conn->framer.set_framing(conn->framing);
+
+    // Sequenced client first sends what it has seen, see command_resume
+    if (l_restored && l_seq) {
+        conn->resuming = true;
+        conn->replay.swap(l_missed);
+        return true;
+    }
+    for (const MessagePtr& l_message : l_missed) {
+        send_message(conn, l_message);
+    }
+    return true;
+}
+
+void Shard::command_publish(Connection* conn, string_view topic, string_view payload, bool compressed) {
+
+    if (topic.empty() || topic.size() > UINT16_MAX) { return; }
+
+    // Encode once in both framings, subscribers only reference it
+    shared_ptr<SharedMessage> l_message = make_shared<SharedMessage>();
+    l_message->topic = topic;
+    l_message->seq = m_server.next_seq(topic);
+
+    // Compressed payload is forwarded as it is to subscribers accepting it, others get it expanded
+    if (compressed) {
+        size_t l_size = decompressed_size(payload);
+        if (l_size == 0 || l_size > MAX_FRAME_SIZE) { return; }
+        m_plain.resize(l_size);
+        if (!decompress_payload(payload, m_plain.data(), l_size)) { return; }
+
+        FrameHeader l_header;
+        l_header.length = topic.size() + payload.size();
+        l_header.opcode = OP_MESSAGE;
+        l_header.flags = FLAG_COMPRESSED;
+        l_header.topic_len = topic.size();
+        l_message->packed.resize(FRAME_HEADER_SIZE);
+        encode_header(&l_message->packed[0], l_header);
+        l_message->packed.append(topic).append(payload);
+        l_message->packed_offset = FRAME_HEADER_SIZE + topic.size();
+        payload = m_plain;
+    }
+
+    l_message->text.reserve(topic.size() + payload.size() + 1 + strlen(EOM));
+    l_message->text.append(topic).append(" ").append(payload).append(EOM);
+
+    FrameHeader l_header;
+    l_header.length = topic.size() + payload.size();
+    l_header.opcode = OP_MESSAGE;
+    l_header.flags = 0;
+    l_header.topic_len = topic.size();
+    l_message->binary.reserve(FRAME_HEADER_SIZE + l_header.length);
+    l_message->binary.resize(FRAME_HEADER_SIZE);
+    encode_header(&l_message->binary[0], l_header);
+    l_message->binary.append(topic).append(payload);
+    l_message->payload_offset = FRAME_HEADER_SIZE + topic.size();
+
+    MessagePtr l_shared = std::move(l_message);
+    m_match.clear();
+    m_server.table().match(topic, m_match);
+    for (const SessionPtr& l_session : m_match) {
+        route(l_session, l_shared);
+    }
+
+    m_server.m_published++;
+    m_server.m_delivered += m_match.size();
+    m_match.clear();
+}
+
+void Shard::command_publish_batch(Connection* conn, string_view body) {
+
+    // Every record is delivered as if it was published alone, a malformed rest is dropped
+    string_view l_record;
+    while (batch_next(body, l_record)) {
+        uint8_t l_opcode;
+        uint16_t l_topic_id;
+        string_view l_topic, l_payload;
+
+        if (!decode_message(FRAMING_BINARY, l_record, l_opcode, l_topic_id, l_topic, l_payload) || l_opcode != OP_PUBLISH) {
+            continue;
+        }
+        if (l_topic_id != 0) {
+            if (l_topic_id >= conn->id_topics.size()) { continue; }
+            l_topic = conn->id_topics[l_topic_id];
+        }
+        command_publish(conn, l_topic, l_payload, conn->compress && (frame_flags(FRAMING_BINARY, l_record) & FLAG_COMPRESSED));
+    }
+}
+
+void Shard::command_subscribe(Connection* conn, string_view topic) {
+
+    if (!TopicIndex<int>::valid(topic)) { return; }
+
+    string l_topic(topic);
+    lock_guard<mutex> l_lock(conn->session->lock);
+    if (conn->session->topics.insert(l_topic).second) {
+        m_server.table().add(l_topic, conn->session);
+    }
+}
+
+void Shard::command_unsubscribe(Connection* conn, string_view topic) {
+
+    string l_topic(topic);
+    lock_guard<mutex> l_lock(conn->session->lock);
+    if (conn->session->topics.erase(l_topic)) {
+        m_server.table().remove(l_topic, conn->session);
+    }
+}
+
+void Shard::command_bind(Connection* conn, string_view topic, string_view payload) {
+
+    uint16_t l_id;
+    if (!conn->topic_ids || topic.empty() || !decode_bind(payload, l_id)) { return; }
+
+    // Client IDs are dense and start at 1
+    auto l_it = conn->ids.find(topic);
+    if (l_it != conn->ids.end()) {
+        conn->id_topics[l_it->second].clear();
+        l_it->second = l_id;
+    }
+    else {
+        conn->ids.emplace(string(topic), l_id);
+    }
+    if (conn->id_topics.size() <= l_id) {
+        conn->id_topics.resize(l_id + 1);
+    }
+    conn->id_topics[l_id] = topic;
+
+    string l_reply;
+    encode_command(FRAMING_BINARY, OP_BOUND, topic, payload, l_reply);
+    send_reply(conn, std::move(l_reply));
+}
+
+void Shard::command_resume(Connection* conn, string_view topic, string_view payload) {
+
+    if (!conn->resuming) { return; }
+
+    // Last sequence seen by the client on one topic
+    if (!topic.empty()) {
+        if (payload.size() == SEQ_SIZE) {
+            conn->resume_from[string(topic)] = decode_seq(payload.data());
+        }
+        return;
+    }
+
+    // End of the list, history newer than the client's state goes first, then what was held
+    conn->resuming = false;
+    for (const MessagePtr& l_message : conn->replay) {
+        auto l_it = conn->resume_from.find(l_message->topic);
+        if (l_it == conn->resume_from.end() || l_message->seq > l_it->second) {
+            send_message(conn, l_message, true);
+        }
+    }
+    for (const MessagePtr& l_message : conn->held) {
+        send_message(conn, l_message);
+    }
+    conn->replay.clear();
+    conn->held.clear();
+    conn->resume_from.clear();
+}
+
+void Shard::command_disconnect(Connection* conn) {
+    m_server.session_close(conn->session);
+    close_conn(conn, false);
+}
+
+
+/******************************************************************************/
+/***********************          SEND FUNCTIONS          *********************/
+/******************************************************************************/
+void Shard::route(const SessionPtr& session, const MessagePtr& message) {
+
+    lock_guard<mutex> l_lock(session->lock);
+    if (session->closed) { return; }
+
+    // Offline session keeps the newest messages for RESTORED, with history delivered ones as well
+    if (session->shard < 0 || (session->history && session->shard == m_index)) {
+        session->missed.push_back(message);
+        if (session->missed.size() > SESSION_MAX_MISSED) {
+            session->missed.pop_front();
+        }
+        if (session->shard < 0) { return; }
+    }
+
+    // Session served by another shard, batched until the end of this iteration
+    if (session->shard != m_index) {
+        m_outbox[session->shard].push_back({ MAIL_DELIVER, -1, session, message });
+        return;
+    }
+
+    send_message(session->conn, message);
+}
+
+void Shard::send_message(Connection* conn, const MessagePtr& message, bool replay) {
+
+    // Nothing overtakes the replay
+    if (conn->resuming) {
+        conn->held.push_back(message);
+        return;
+    }
+
+    OutFrame l_frame;
+    l_frame.message = message;
+
+    if (conn->framing == FRAMING_TEXT) {
+        l_frame.data = message->text.data();
+        l_frame.size = message->text.size();
+    }
+    else {
+        bool l_packed = conn->compress && !message->packed.empty();
+        const string& l_binary = l_packed ? message->packed : message->binary;
+        size_t l_offset = l_packed ? message->packed_offset : message->payload_offset;
+
+        // Topic bound by this client or a sequence number, only the header differs from the shared frame
+        auto l_it = conn->topic_ids ? conn->ids.find(message->topic) : conn->ids.end();
+        bool l_bound = l_it != conn->ids.end();
+        if (l_bound || conn->seq) {
+            size_t l_start = l_bound ? l_offset : FRAME_HEADER_SIZE;
+            FrameHeader l_header;
+            l_header.length = l_binary.size() - l_start + (conn->seq ? SEQ_SIZE : 0);
+            l_header.opcode = OP_MESSAGE;
+            l_header.flags = (l_bound ? FLAG_TOPIC_ID : 0) | (l_packed ? FLAG_COMPRESSED : 0)
+                | (conn->seq ? FLAG_SEQ : 0) | (replay ? FLAG_REPLAY : 0);
+            l_header.topic_len = l_bound ? l_it->second : message->topic.size();
+            encode_header(l_frame.header, l_header);
+            l_frame.header_len = FRAME_HEADER_SIZE;
+            if (conn->seq) {
+                encode_seq(l_frame.header + FRAME_HEADER_SIZE, message->seq);
+                l_frame.header_len += SEQ_SIZE;
+            }
+            l_frame.data = l_binary.data() + l_start;
+            l_frame.size = l_binary.size() - l_start;
+        }
+        else {
+            l_frame.data = l_binary.data();
+            l_frame.size = l_binary.size();
+        }
+    }
+
+    conn->out.push_back(std::move(l_frame));
+    if (!conn->dirty) {
+        conn->dirty = true;
+        m_dirty.push_back(conn);
+    }
+}
+
+void Shard::send_reply(Connection* conn, string&& data) {
+
+    OutFrame l_frame;
+    l_frame.owned = make_shared<const string>(std::move(data));
+    l_frame.data = l_frame.owned->data();
+    l_frame.size = l_frame.owned->size();
+
+    conn->out.push_back(std::move(l_frame));
+    if (!conn->dirty) {
+        conn->dirty = true;
+        m_dirty.push_back(conn);
+    }
+}
+
+bool Shard::write(Connection* conn) {
+
+    while (!conn->out.empty()) {
+        struct iovec l_iov[SERVER_IOV_MAX];
+        int l_iovcnt = 0;
+        size_t l_skip = conn->out_offset;
+
+        // Gather private headers and shared bodies, first frame may be partly written
+        for (auto l_it = conn->out.begin(); l_it != conn->out.end() && l_iovcnt < SERVER_IOV_MAX - 1; ++l_it) {
+            if (l_skip < l_it->header_len) {
+                l_iov[l_iovcnt].iov_base = l_it->header + l_skip;
+                l_iov[l_iovcnt].iov_len = l_it->header_len - l_skip;
+                l_iovcnt++;
+                l_skip = 0;
+            }
+            else {
+                l_skip -= l_it->header_len;
+            }
+            if (l_skip < l_it->size) {
+                l_iov[l_iovcnt].iov_base = (void*)(l_it->data + l_skip);
+                l_iov[l_iovcnt].iov_len = l_it->size - l_skip;
+                l_iovcnt++;
+            }
+            l_skip = 0;
+        }
+
+        struct msghdr l_msghdr = {};
+        l_msghdr.msg_iov = l_iov;
+        l_msghdr.msg_iovlen = l_iovcnt;
+
+        ssize_t l_sent = conn->link ? conn->link->sendmsg(l_iov, l_iovcnt) : sendmsg(conn->fd, &l_msghdr, MSG_NOSIGNAL);
+        if (l_sent < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { return false; }
+
+            // Full ring is written again if the client made room while the wakeup was armed,
+            // otherwise its eventfd reports the room
+            if (conn->link) {
+                if (!conn->link->wait_space()) { continue; }
+                return true;
+            }
+
+            // Socket is full, continue when reactor reports it writable
+            if (!conn->want_write) {
+                conn->want_write = true;
+                m_reactor->modify(conn->fd, true);
+            }
+            return true;
+        }
+
+        // Drop written frames, remember offset into the partly written one
+        size_t l_left = l_sent;
+        while (l_left > 0 && !conn->out.empty()) {
+            size_t l_remaining = conn->out.front().header_len + conn->out.front().size - conn->out_offset;
+            if (l_left < l_remaining) {
+                conn->out_offset += l_left;
+                break;
+            }
+            l_left -= l_remaining;
+            conn->out_offset = 0;
+            conn->out.pop_front();
+        }
+    }
+
+    if (conn->want_write) {
+        conn->want_write = false;
+        m_reactor->modify(conn->fd, false);
+    }
+    return true;
+}
+
+
+/******************************************************************************/
+/*************************          SERVER          ***************************/
+/******************************************************************************/
+Server::Server(int port, int threads, reactor_type_enum reactor, const string& unix_path)
+    :m_port(port),
+    m_unix_path(unix_path),
+    m_reactor(reactor)
+{
+    for (int i = 0; i < threads; i++) {
+        m_shards.emplace_back(new Shard(*this, i, reactor));
+    }
+}
+
+Server::~Server() {
+    if (m_listen_fd >= 0) {
+        close(m_listen_fd);
+    }
+    if (m_unix_fd >= 0) {
+        close(m_unix_fd);
+        unlink(m_unix_path.c_str());
+    }
+}
+
+bool Server::run(void) {
+
+    // Only localhost is served
+    struct sockaddr_in l_addr = {};
+    l_addr.sin_family = AF_INET;
+    l_addr.sin_port = htons(m_port);
+    inet_pton(AF_INET, "127.0.0.1", &l_addr.sin_addr);
+
+    int l_one = 1;
+    m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listen_fd < 0 ||
+        setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &l_one, sizeof(l_one)) < 0 ||
+        bind(m_listen_fd, (struct sockaddr*)&l_addr, sizeof(l_addr)) < 0 ||
+        listen(m_listen_fd, SOMAXCONN) < 0) {
+        cerr << "ERROR: can not listen on port " << m_port << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    // Socket file left by a previous run is replaced
+    if (m_unix_path != "") {
+        struct sockaddr_un l_unix = {};
+        l_unix.sun_family = AF_UNIX;
+        if (m_unix_path.size() >= sizeof(l_unix.sun_path)) {
+            cerr << "ERROR: unix socket path too long: " << m_unix_path << "\n";
+            return false;
+        }
+        memcpy(l_unix.sun_path, m_unix_path.c_str(), m_unix_path.size() + 1);
+        unlink(m_unix_path.c_str());
+
+        m_unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_unix_fd < 0 ||
+            bind(m_unix_fd, (struct sockaddr*)&l_unix, sizeof(l_unix)) < 0 ||
+            listen(m_unix_fd, SOMAXCONN) < 0) {
+            cerr << "ERROR: can not listen on " << m_unix_path << ": " << strerror(errno) << "\n";
+            return false;
+        }
+    }
+
+    for (auto& l_shard : m_shards) {
+        l_shard->start();
+    }
+    cout << "INFO: Listening on 127.0.0.1:" << m_port;
+    if (m_unix_fd >= 0) {
+        cout << " and " << m_unix_path;
+    }
+    cout << " with " << m_shards.size() << " shards\n";
+    cout.flush();
+
+    // Accepted sockets of both listeners are spread over shards round robin
+    size_t l_next = 0;
+    while (m_running) {
+        struct pollfd l_polls[2] = { { m_listen_fd, POLLIN, 0 }, { m_unix_fd, POLLIN, 0 } };
+        if (poll(l_polls, m_unix_fd >= 0 ? 2 : 1, 200) <= 0) { continue; }
+
+        for (const struct pollfd& l_poll : l_polls) {
+            if (l_poll.fd < 0 || !(l_poll.revents & POLLIN)) { continue; }
+            int l_fd = accept4(l_poll.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (l_fd < 0) { continue; }
+
+            vector<ShardMail> l_mail = { { MAIL_ACCEPT, l_fd, nullptr, nullptr } };
+            m_shards[l_next]->post(l_mail);
+            l_next = (l_next + 1) % m_shards.size();
+        }
+    }
+
+    for (auto& l_shard : m_shards) {
+        vector<ShardMail> l_mail = { { MAIL_STOP, -1, nullptr, nullptr } };
+        l_shard->post(l_mail);
+    }
+    for (auto& l_shard : m_shards) {
+        l_shard->join();
+    }
+
+    cout << "INFO: Published " << m_published << " messages, delivered " << m_delivered << "\n";
+    return true;
+}
+
+SessionPtr Server::session_open(const string& name, int shard, Connection* conn, bool& restored) {
+
+    lock_guard<mutex> l_lock(m_sessions_lock);
+
+    SessionPtr& l_session = m_sessions[name];
+    restored = l_session != nullptr;
+    if (!l_session) {
+        l_session = make_shared<Session>();
+        l_session->name = name;
+    }
+
+    lock_guard<mutex> l_session_lock(l_session->lock);
+    if (l_session->shard >= 0) {
+        return nullptr;
+    }
+    l_session->shard = shard;
+    l_session->conn = conn;
+    return l_session;
+}
+
+uint64_t Server::next_seq(string_view topic) {
+
+    SeqStripe& l_stripe = m_seqs[TopicHash{}(topic) % TOPIC_STRIPES];
+    lock_guard<mutex> l_lock(l_stripe.lock);
+    auto l_it = l_stripe.seqs.find(topic);
+    if (l_it == l_stripe.seqs.end()) {
+        l_it = l_stripe.seqs.emplace(string(topic), 0).first;
+    }
+    return ++l_it->second;
+}
+
+void Server::session_close(const SessionPtr& session) {
+
+    {
+        lock_guard<mutex> l_lock(m_sessions_lock);
+        auto l_it = m_sessions.find(session->name);
+        if (l_it != m_sessions.end() && l_it->second == session) {
+            m_sessions.erase(l_it);
+        }
+    }
+
+    // Subscriptions end with the session
+    lock_guard<mutex> l_lock(session->lock);
+    session->closed = true;
+    session->shard = -1;
+    session->conn = nullptr;
+    for (const string& l_topic : session->topics) {
+        m_table.remove(l_topic, session);
+    }
+    session->topics.clear();
+    session->missed.clear();
+}
@@ -0,0 +1,289 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Server.hpp
+// Product : PubSubx
+// Brief   : Reference PubSubX broker, sharded reactors with shared fan-out
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_SERVER_H
+#define PUBSUBX_SERVER_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include "SpscQueue.hpp"
+#include "Reactor.hpp"
+#include "Protocol.hpp"
+#include "Framer.hpp"
+#include "TopicIndex.hpp"
+#include "Compression.hpp"
+#include "ShmRing.hpp"
+
+using namespace std;
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define SERVER_PORT 12000           // Default listening port
+#define SERVER_FRAGMENT ((1024) - (3))  // Text fragment size of clients (BUFFER_SIZE - strlen(EOM))
+#define SERVER_READ_SIZE ((64)*(1024))  // Size of one socket read
+#define SERVER_IOV_MAX 256          // Maximum number of iovec entries in one write
+#define SESSION_MAX_MISSED 4096     // Messages kept for a disconnected session, oldest are dropped
+#define TOPIC_STRIPES 64            // Lock stripes of the subscriber table
+
+// Published message, encoded once and shared by all subscribers
+struct SharedMessage {
+    string topic;
+    string text;                    // "<topic> <payload>" EOM
+    string binary;                  // Header, topic and payload
+    size_t payload_offset;          // Start of payload in binary
+    string packed;                  // Binary frame with the payload as published compressed, or empty
+    size_t packed_offset = 0;       // Start of payload in packed
+    uint64_t seq = 0;               // Sequence number within the topic, from 1
+};
+using MessagePtr = shared_ptr<const SharedMessage>;
+
+struct Connection;
+
+// Client state kept by name, survives a lost connection for RESTORED
+struct Session {
+    string      name;
+    mutex       lock;               // Protects all fields below
+    int         shard = -1;         // Shard of the live connection, -1 when offline
+    Connection* conn = nullptr;     // Live connection, owned by shard
+    bool        closed = false;     // Session ended with DISCONNECT
+    set<string> topics;             // Subscribed topic filters
+    deque<MessagePtr> missed;       // Messages received while offline, or also delivered ones with history
+    bool        history = false;    // Client tracks sequence numbers, resume filters missed by them
+};
+using SessionPtr = shared_ptr<Session>;
+
+// One queued write, optional private header followed by a view of a shared buffer
+struct OutFrame {
+    char          header[FRAME_HEADER_SIZE + SEQ_SIZE];
+    uint8_t       header_len = 0;
+    MessagePtr    message;          // Keeps the viewed buffer alive
+    shared_ptr<const string> owned; // Or a buffer owned by this frame (replies)
+    const char*   data = nullptr;
+    size_t        size = 0;
+};
+
+// Accepted socket, owned by one shard
+struct Connection {
+    int           fd;
+    Framer        framer{ EOM };
+    framing_enum  framing = FRAMING_TEXT;
+    bool          topic_ids = false;
+    bool          compress = false; // Accepts compressed payloads
+    bool          seq = false;      // Messages carry sequence numbers
+
+    // Restored session waits for the client's last seen sequences before anything is delivered
+    bool          resuming = false;
+    deque<MessagePtr> replay;       // Session history to filter
+    deque<MessagePtr> held;         // Messages routed meanwhile
+    unordered_map<string, uint64_t, TopicHash, equal_to<>> resume_from;
+    SessionPtr    session;          // Set by CONNECT
+    deque<OutFrame> out;
+    size_t        out_offset = 0;   // Bytes of front frame already written
+    bool          want_write = false;
+    bool          dirty = false;    // Has unwritten frames queued in this iteration
+
+    // Shared memory link offered with CONNECT, frames after the reply go through it
+    unique_ptr<ShmLink> link;
+    int           offered[SHM_FDS];
+    int           offered_count = 0;
+
+    // Topic IDs bound by the client on this connection
+    unordered_map<string, uint16_t, TopicHash, equal_to<>> ids;
+    vector<string> id_topics;       // Index is ID
+
+    // Text publish split in fragments by the client
+    string        pending_topic;
+    string        pending_payload;
+    bool          pending = false;
+};
+
+// Cross-shard mail, delivered through the shard inbox
+enum mail_type_enum {
+    MAIL_ACCEPT,                    // New socket assigned to the shard
+    MAIL_DELIVER,                   // Message for a session served by the shard
+    MAIL_STOP                       // Close all connections and end the shard thread
+};
+
+struct ShardMail {
+    mail_type_enum type;
+    int            fd = -1;
+    SessionPtr     session;
+    MessagePtr     message;
+};
+
+class Server;
+
+
+/******************************************************************************/
+/*******************          SUBSCRIBER TABLE CLASS           ****************/
+/******************************************************************************/
+// Exact topics are spread over lock stripes, readers of different topics
+// never contend. Wildcard filters share one index that is only searched
+// while at least one wildcard subscription exists.
+class SubscriberTable {
+
+public:
+    void add(const string& topic, const SessionPtr& session);
+    void remove(const string& topic, const SessionPtr& session);
+
+    // Append subscribers of the topic, every session at most once
+    void match(string_view topic, vector<SessionPtr>& out);
+
+private:
+    struct Stripe {
+        shared_mutex lock;
+        unordered_map<string, vector<SessionPtr>, TopicHash, equal_to<>> topics;
+    };
+
+    Stripe m_stripes[TOPIC_STRIPES];
+    shared_mutex m_wild_lock;
+    TopicIndex<vector<SessionPtr>> m_wild;
+    atomic<size_t> m_wild_count{ 0 };
+
+    Stripe& stripe(string_view topic) { return m_stripes[TopicHash{}(topic) % TOPIC_STRIPES]; }
+};
+
+
+/******************************************************************************/
+/***********************          SHARD CLASS           ***********************/
+/******************************************************************************/
+// One thread with its own reactor and connections. Messages for sessions of
+// other shards are collected per target shard and handed over once per
+// loop iteration.
+class Shard {
+
+public:
+    Shard(Server& server, int index, reactor_type_enum reactor);
+    ~Shard();
+
+    void start(void);
+    void join(void);
+    void post(vector<ShardMail>& mail);     // Called from other threads
+    int  index(void) const { return m_index; }
+
+    // Route a message to a session, called only on this shard's thread
+    void route(const SessionPtr& session, const MessagePtr& message);
+
+private:
+    Server&       m_server;
+    int           m_index;
+    thread        m_thread;
+    unique_ptr<Reactor> m_reactor;
+    unordered_map<int, unique_ptr<Connection>> m_conns;
+    unordered_map<int, Connection*> m_links;    // By link eventfd
+    vector<Connection*> m_dirty;            // Connections with new frames to write
+    vector<vector<ShardMail>> m_outbox;     // Per target shard
+    vector<SessionPtr> m_match;             // Reused subscriber list
+    string        m_plain;                  // Reused buffer of decompressed payloads
+
+    // Inbox filled by other shards
+    mutex         m_inbox_lock;
+    vector<ShardMail> m_inbox;
+    EventNotifier m_notifier;
+
+    void loop(void);
+    bool inbox_drain(void);                 // False when the shard must stop
+    void outbox(void);
+    void accept(int fd);
+    void close_conn(Connection* conn, bool keep_session);
+    void offered_close(Connection* conn);   // Closes link descriptors that were not taken
+
+    bool read(Connection* conn);            // False if connection is closed
+    bool frame(Connection* conn, string_view frame);   // False if connection is closed
+    bool command_connect(Connection* conn, string_view args);
+    void command_publish(Connection* conn, string_view topic, string_view payload, bool compressed = false);
+    void command_publish_batch(Connection* conn, string_view body);
+    void command_subscribe(Connection* conn, string_view topic);
+    void command_unsubscribe(Connection* conn, string_view topic);
+    void command_bind(Connection* conn, string_view topic, string_view payload);
+    void command_resume(Connection* conn, string_view topic, string_view payload);
+    void command_disconnect(Connection* conn);
+    void flush_pending(Connection* conn);
+
+    void send_reply(Connection* conn, string&& data);
+    void send_message(Connection* conn, const MessagePtr& message, bool replay = false);
+    bool write(Connection* conn);           // False if connection failed
+};
+
+
+/******************************************************************************/
+/**********************          SERVER CLASS           ***********************/
+/******************************************************************************/
+class Server {
+
+public:
+    // Unix socket at unix_path is served besides the tcp port, if given
+    Server(int port, int threads, reactor_type_enum reactor, const string& unix_path = "");
+    ~Server();
+
+    bool run(void);                         // Blocks, accepts on the calling thread until stop
+    void stop(void) { m_running = false; }  // Safe to call from a signal handler
+
+    SubscriberTable& table(void) { return m_table; }
+    Shard& shard(int index) { return *m_shards[index]; }
+    int    shards(void) const { return m_shards.size(); }
+
+    // Session registry, find or create by name and attach the connection to it.
+    // Returns nullptr if the name is online
+    SessionPtr session_open(const string& name, int shard, Connection* conn, bool& restored);
+    void       session_close(const SessionPtr& session);
+
+    // Next sequence number of the topic, sequences live as long as the server
+    uint64_t   next_seq(string_view topic);
+
+    // Statistics
+    atomic<uint64_t> m_published{ 0 };
+    atomic<uint64_t> m_delivered{ 0 };
+
+private:
+    int    m_port;
+    int    m_listen_fd = -1;
+    string m_unix_path;
+    int    m_unix_fd = -1;
+    atomic<bool> m_running{ true };
+    reactor_type_enum m_reactor;
+    vector<unique_ptr<Shard>> m_shards;
+    SubscriberTable m_table;
+
+    mutex  m_sessions_lock;
+    unordered_map<string, SessionPtr> m_sessions;
+
+    struct SeqStripe {
+        mutex lock;
+        unordered_map<string, uint64_t, TopicHash, equal_to<>> seqs;
+    };
+    SeqStripe m_seqs[TOPIC_STRIPES];
+};
+
+#endif
@@ -0,0 +1,406 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : ShmRing.cpp
+// Product : PubSubx
+// Brief   : Shared memory rings carrying frames between local processes
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "ShmRing.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#define SHM_MAGIC "PSXLINK1"
+#define SHM_SIZE_FIELD 8                    // Segment offset of the ring size
+#define SHM_UP_OFFSET 64                    // Ring header client to broker
+#define SHM_DOWN_OFFSET 256                 // Ring header broker to client
+#define SHM_DATA_OFFSET 4096                // Ring data, client to broker first
+#define SHM_PAD (1ULL << 63)                // Record length flag, rest of the ring end is skipped
+#define SHM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+static_assert(sizeof(ShmRingHeader) <= SHM_DOWN_OFFSET - SHM_UP_OFFSET, "ring headers overlap");
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free, "ring cursors must be lock free across processes");
+
+static size_t record_size(size_t len) {
+    return SHM_RECORD_HEADER + ((len + 7) & ~(size_t)7);
+}
+
+static std::atomic_ref<uint64_t> record_word(char* record) {
+    return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(record));
+}
+
+
+/******************************************************************************/
+/**********************          RING FUNCTIONS          **********************/
+/******************************************************************************/
+void ShmRing::attach(ShmRingHeader* header, char* data, size_t capacity, int reader_fd, int writer_fd) {
+    m_header = header;
+    m_data = data;
+    m_capacity = capacity;
+    m_reader_fd = reader_fd;
+    m_writer_fd = writer_fd;
+    m_offset = 0;
+}
+
+void ShmRing::wake(uint32_t& waiting, int fd) {
+
+    // Pairs with the fence of wait_read / wait_write, one of both sides sees the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::atomic_ref<uint32_t> l_waiting(waiting);
+    if (l_waiting.load(std::memory_order_relaxed) && l_waiting.exchange(0)) {
+        uint64_t l_one = 1;
+        ssize_t l_ret = ::write(fd, &l_one, sizeof(l_one));
+        (void)l_ret;
+    }
+}
+
+ssize_t ShmRing::write(const struct iovec* iov, int iovcnt, bool whole) {
+
+    size_t l_total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        l_total += iov[i].iov_len;
+    }
+    if (l_total == 0) { return 0; }
+    if (whole && record_size(l_total) > m_capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    std::atomic_ref<uint64_t> l_reserved(m_header->reserved);
+    std::atomic_ref<uint64_t> l_consumed(m_header->consumed);
+    uint64_t l_start = l_reserved.load(std::memory_order_relaxed);
+    size_t l_len = 0;
+
+    while (1) {
+        uint64_t l_used = l_start - l_consumed.load(std::memory_order_acquire);
+        if (l_used > m_capacity) {
+            errno = EPROTO;
+            return -1;
+        }
+        size_t l_free = m_capacity - l_used;
+        size_t l_contig = m_capacity - (l_start & (m_capacity - 1));
+        size_t l_room = std::min(l_free, l_contig);
+        size_t l_need = record_size(l_total);
+        size_t l_size;
+        bool   l_pad = false;
+
+        // Record that does not fit before the end of the ring starts over at its beginning,
+        // unless a shortened one is allowed and more than a header fits here
+        if (l_need <= l_room) {
+            l_len = l_total;
+            l_size = l_need;
+        }
+        else if (l_contig <= l_free && (whole || l_contig < record_size(1) || l_free - l_contig >= l_need)) {
+            l_pad = true;
+            l_size = l_contig;
+        }
+        else if (!whole && l_room >= record_size(1)) {
+            l_len = l_room - SHM_RECORD_HEADER;
+            l_size = l_room;
+        }
+        else {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        if (!l_reserved.compare_exchange_weak(l_start, l_start + l_size, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        // Padding is committed at once, the consumer skips it to reach the next record
+        if (l_pad) {
+            record_word(m_data + (l_start & (m_capacity - 1))).store(SHM_PAD | l_size, std::memory_order_release);
+            wake(m_header->reader_waiting, m_reader_fd);
+            l_start += l_size;
+            continue;
+        }
+        break;
+    }
+
+    // Claimed space is only ours, the length commits the copied bytes
+    char* l_record = m_data + (l_start & (m_capacity - 1));
+    char* l_dest = l_record + SHM_RECORD_HEADER;
+    size_t l_left = l_len;
+    for (int i = 0; i < iovcnt && l_left > 0; i++) {
+        size_t l_part = std::min(iov[i].iov_len, l_left);
+        memcpy(l_dest, iov[i].iov_base, l_part);
+        l_dest += l_part;
+        l_left -= l_part;
+    }
+    record_word(l_record).store(l_len, std::memory_order_release);
+    wake(m_header->reader_waiting, m_reader_fd);
+    return l_len;
+}
+
+ssize_t ShmRing::read(char* buf, size_t len) {
+
+    std::atomic_ref<uint64_t> l_consumed(m_header->consumed);
+    uint64_t l_pos = l_consumed.load(std::memory_order_relaxed);
+    size_t l_copied = 0;
+    bool   l_released = false;
+
+    while (l_copied < len) {
+        char* l_record = m_data + (l_pos & (m_capacity - 1));
+        uint64_t l_word = record_word(l_record).load(std::memory_order_acquire);
+        if (l_word == 0) { break; }
+
+        // Lengths come from the other process, they must stay inside the ring
+        size_t l_contig = m_capacity - (l_pos & (m_capacity - 1));
+        size_t l_size;
+        if (l_word & SHM_PAD) {
+            l_size = l_word & ~SHM_PAD;
+            if (l_size != l_contig) {
+                errno = EPROTO;
+                return -1;
+            }
+        }
+        else {
+            if (l_word > l_contig - SHM_RECORD_HEADER) {
+                errno = EPROTO;
+                return -1;
+            }
+            l_size = record_size(l_word);
+            size_t l_take = std::min<size_t>(l_word - m_offset, len - l_copied);
+            memcpy(buf + l_copied, l_record + SHM_RECORD_HEADER + m_offset, l_take);
+            l_copied += l_take;
+            m_offset += l_take;
+            if (m_offset < l_word) { break; }
+            m_offset = 0;
+        }
+
+        // Released space is zero again, the only state in which producers may claim it
+        memset(l_record, 0, (l_word & SHM_PAD) ? SHM_RECORD_HEADER : l_size);
+        l_pos += l_size;
+        l_consumed.store(l_pos, std::memory_order_release);
+        l_released = true;
+    }
+
+    if (l_released) {
+        wake(m_header->writer_waiting, m_writer_fd);
+    }
+    if (l_copied > 0) {
+        return l_copied;
+    }
+
+    // Closed is stored after the last record, one committed meanwhile is still read first
+    if (std::atomic_ref<uint32_t>(m_header->closed).load(std::memory_order_acquire)
+        && record_word(m_data + (l_pos & (m_capacity - 1))).load(std::memory_order_acquire) == 0) {
+        return 0;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+bool ShmRing::wait_read(void) {
+
+    std::atomic_ref<uint32_t> l_waiting(m_header->reader_waiting);
+    l_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t l_pos = std::atomic_ref<uint64_t>(m_header->consumed).load(std::memory_order_relaxed);
+    if (record_word(m_data + (l_pos & (m_capacity - 1))).load(std::memory_order_acquire) != 0
+        || std::atomic_ref<uint32_t>(m_header->closed).load(std::memory_order_acquire)) {
+        l_waiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool ShmRing::wait_write(void) {
+
+    std::atomic_ref<uint32_t> l_waiting(m_header->writer_waiting);
+    l_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Room for a header and a few bytes always lets a shortened record through
+    uint64_t l_used = std::atomic_ref<uint64_t>(m_header->reserved).load(std::memory_order_relaxed)
+        - std::atomic_ref<uint64_t>(m_header->consumed).load(std::memory_order_acquire);
+    if (l_used <= m_capacity - record_size(1)) {
+        l_waiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void ShmRing::close(void) {
+    std::atomic_ref<uint32_t>(m_header->closed).store(1, std::memory_order_release);
+    wake(m_header->reader_waiting, m_reader_fd);
+}
+
+
+/******************************************************************************/
+/**********************          LINK FUNCTIONS          **********************/
+/******************************************************************************/
+std::unique_ptr<ShmLink> ShmLink::create(size_t ring_size) {
+
+    size_t l_ring = SHM_RING_MIN;
+    while (l_ring < std::min<size_t>(ring_size, SHM_RING_MAX)) {
+        l_ring <<= 1;
+    }
+    size_t l_size = SHM_DATA_OFFSET + 2 * l_ring;
+
+    std::unique_ptr<ShmLink> l_link(new ShmLink());
+    l_link->m_segment_fd = memfd_create("pubsubx-link", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    l_link->m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    l_link->m_peer_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (l_link->m_segment_fd < 0 || l_link->m_wake_fd < 0 || l_link->m_peer_fd < 0
+        || ftruncate(l_link->m_segment_fd, l_size) != 0
+        || fcntl(l_link->m_segment_fd, F_ADD_SEALS, SHM_SEALS) != 0
+        || !l_link->map(l_link->m_segment_fd, l_size, false)) {
+        return nullptr;
+    }
+
+    // New file is zero, so both rings start empty
+    char* l_base = static_cast<char*>(l_link->m_base);
+    memcpy(l_base, SHM_MAGIC, strlen(SHM_MAGIC));
+    uint64_t l_ring64 = l_ring;
+    memcpy(l_base + SHM_SIZE_FIELD, &l_ring64, sizeof(l_ring64));
+    return l_link;
+}
+
+std::unique_ptr<ShmLink> ShmLink::attach(const int fds[SHM_FDS]) {
+
+    std::unique_ptr<ShmLink> l_link(new ShmLink());
+    l_link->m_wake_fd = fds[1];
+    l_link->m_peer_fd = fds[2];
+
+    // Size must match the sealed file, the client can not shrink it under the mapping
+    struct stat l_stat;
+    bool l_valid = fstat(fds[0], &l_stat) == 0 && S_ISREG(l_stat.st_mode)
+        && fcntl(fds[0], F_GET_SEALS) == SHM_SEALS && (size_t)l_stat.st_size > SHM_DATA_OFFSET;
+    size_t l_ring = l_valid ? (l_stat.st_size - SHM_DATA_OFFSET) / 2 : 0;
+    l_valid = l_valid && l_ring >= SHM_RING_MIN && l_ring <= SHM_RING_MAX && (l_ring & (l_ring - 1)) == 0
+        && SHM_DATA_OFFSET + 2 * l_ring == (size_t)l_stat.st_size
+        && l_link->map(fds[0], l_stat.st_size, true);
+    ::close(fds[0]);
+
+    uint64_t l_ring64 = 0;
+    if (l_valid) {
+        char* l_base = static_cast<char*>(l_link->m_base);
+        memcpy(&l_ring64, l_base + SHM_SIZE_FIELD, sizeof(l_ring64));
+        l_valid = memcmp(l_base, SHM_MAGIC, strlen(SHM_MAGIC)) == 0 && l_ring64 == l_ring;
+    }
+    return l_valid ? std::move(l_link) : nullptr;
+}
+
+bool ShmLink::map(int segment_fd, size_t size, bool broker) {
+
+    void* l_base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment_fd, 0);
+    if (l_base == MAP_FAILED) { return false; }
+    m_base = l_base;
+    m_size = size;
+
+    // Client writes the up ring and reads the down ring, the broker the other way round
+    size_t l_ring = (size - SHM_DATA_OFFSET) / 2;
+    char* l_bytes = static_cast<char*>(l_base);
+    ShmRingHeader* l_up = reinterpret_cast<ShmRingHeader*>(l_bytes + SHM_UP_OFFSET);
+    ShmRingHeader* l_down = reinterpret_cast<ShmRingHeader*>(l_bytes + SHM_DOWN_OFFSET);
+    char* l_up_data = l_bytes + SHM_DATA_OFFSET;
+    char* l_down_data = l_up_data + l_ring;
+    m_in.attach(broker ? l_up : l_down, broker ? l_up_data : l_down_data, l_ring, m_wake_fd, m_peer_fd);
+    m_out.attach(broker ? l_down : l_up, broker ? l_down_data : l_up_data, l_ring, m_peer_fd, m_wake_fd);
+    return true;
+}
+
+ShmLink::~ShmLink() {
+    if (m_base) {
+        m_out.close();
+        munmap(m_base, m_size);
+    }
+    for (int l_fd : { m_segment_fd, m_wake_fd, m_peer_fd }) {
+        if (l_fd >= 0) { ::close(l_fd); }
+    }
+}
+
+bool ShmLink::offer(int socket, std::string_view msg) const {
+
+    // Broker waits on the eventfd the client signals and signals the one the client waits on
+    int l_fds[SHM_FDS] = { m_segment_fd, m_peer_fd, m_wake_fd };
+    alignas(struct cmsghdr) char l_control[CMSG_SPACE(sizeof(l_fds))] = {};
+    struct iovec l_iov = { const_cast<char*>(msg.data()), msg.size() };
+    struct msghdr l_msghdr = {};
+    l_msghdr.msg_iov = &l_iov;
+    l_msghdr.msg_iovlen = 1;
+    l_msghdr.msg_control = l_control;
+    l_msghdr.msg_controllen = sizeof(l_control);
+
+    struct cmsghdr* l_cmsg = CMSG_FIRSTHDR(&l_msghdr);
+    l_cmsg->cmsg_level = SOL_SOCKET;
+    l_cmsg->cmsg_type = SCM_RIGHTS;
+    l_cmsg->cmsg_len = CMSG_LEN(sizeof(l_fds));
+    memcpy(CMSG_DATA(l_cmsg), l_fds, sizeof(l_fds));
+
+    return ::sendmsg(socket, &l_msghdr, MSG_NOSIGNAL) == (ssize_t)msg.size();
+}
+
+ssize_t ShmLink::receive(int socket, char* buf, size_t len, int fds[SHM_FDS], int& count) {
+
+    alignas(struct cmsghdr) char l_control[CMSG_SPACE(sizeof(int) * SHM_FDS)];
+    struct iovec l_iov = { buf, len };
+    struct msghdr l_msghdr = {};
+    l_msghdr.msg_iov = &l_iov;
+    l_msghdr.msg_iovlen = 1;
+    l_msghdr.msg_control = l_control;
+    l_msghdr.msg_controllen = sizeof(l_control);
+
+    count = 0;
+    ssize_t l_size = recvmsg(socket, &l_msghdr, MSG_CMSG_CLOEXEC);
+    if (l_size < 0) { return l_size; }
+
+    // Descriptors beyond SHM_FDS are closed, the kernel already dropped those that did not fit
+    for (struct cmsghdr* l_cmsg = CMSG_FIRSTHDR(&l_msghdr); l_cmsg; l_cmsg = CMSG_NXTHDR(&l_msghdr, l_cmsg)) {
+        if (l_cmsg->cmsg_level != SOL_SOCKET || l_cmsg->cmsg_type != SCM_RIGHTS) { continue; }
+        size_t l_count = (l_cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < l_count; i++) {
+            int l_fd;
+            memcpy(&l_fd, CMSG_DATA(l_cmsg) + i * sizeof(int), sizeof(int));
+            if (count < SHM_FDS) {
+                fds[count++] = l_fd;
+            }
+            else {
+                ::close(l_fd);
+            }
+        }
+    }
+    return l_size;
+}
+
+void ShmLink::drain(void) {
+    uint64_t l_count;
+    ssize_t l_ret = ::read(m_wake_fd, &l_count, sizeof(l_count));
+    (void)l_ret;
+}
+
+void ShmLink::kick(void) {
+    eventfd_write(m_wake_fd, 1);
+}
+
+bool ShmLink::block(int socket, int timeout_ms) {
+
+    struct pollfd l_polls[2] = { { m_wake_fd, POLLIN, 0 }, { socket, POLLIN, 0 } };
+    if (poll(l_polls, 2, timeout_ms) <= 0 || l_polls[1].revents) {
+        return false;
+    }
+    drain();
+    return true;
+}
@@ -0,0 +1,158 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : ShmRing.hpp
+// Product : PubSubx
+// Brief   : Shared memory rings carrying frames between local processes
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_SHM_RING_H
+#define PUBSUBX_SHM_RING_H
+
+#include <string_view>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define SHM_RING_SIZE ((4) << (20))         // Default bytes of each direction, a power of two
+#define SHM_RING_MIN 4096                   // Smallest ring a broker accepts
+#define SHM_RING_MAX ((1) << (30))          // Largest ring a broker accepts
+#define SHM_RECORD_HEADER 8                 // Length word in front of every record
+#define SHM_FDS 3                           // Segment, broker wakeup and client wakeup
+#define SHM_FLUSH_MS 1000                   // Longest wait for room while flushing on disconnect
+
+// Control block of one ring, lives in the segment. Fields are accessed through
+// atomic_ref, each cursor has a cache line of its own.
+struct ShmRingHeader {
+    alignas(64) uint64_t reserved;          // End of the space claimed by producers
+    alignas(64) uint64_t consumed;          // End of the records the consumer released
+    alignas(64) uint32_t reader_waiting;    // Consumer sleeps, next commit wakes it
+    uint32_t writer_waiting;                // A producer waits for room
+    uint32_t closed;                        // Producer side is gone
+};
+
+
+/******************************************************************************/
+/*************************          RING CLASS          ***********************/
+/******************************************************************************/
+// Multi producer, single consumer ring of records. A producer claims space by
+// advancing the reserved cursor with a compare and swap, copies its bytes and
+// then stores the record length, which commits the record; records of several
+// threads or processes are read in the order they were claimed. The consumer
+// zeroes what it has read before releasing it, so a zero length always means
+// not yet committed. Each side only touches the eventfd of the other one when
+// that side announced it is going to sleep, a busy pair makes no syscalls.
+class ShmRing {
+
+public:
+    ShmRing() = default;
+
+    // Ring over capacity bytes at data, reader_fd wakes the consumer, writer_fd the producers
+    void attach(ShmRingHeader* header, char* data, size_t capacity, int reader_fd, int writer_fd);
+
+    // Producer: the gathered bytes as one record, shortened to what fits unless whole is set.
+    // Returns bytes written or -1 with errno EAGAIN when full, EPROTO when the ring is corrupt.
+    ssize_t write(const struct iovec* iov, int iovcnt, bool whole = false);
+
+    // Consumer: up to len bytes of committed records, a record may be read in parts.
+    // Returns bytes read, 0 once the producer side closed and everything is read, or
+    // -1 with errno EAGAIN when empty, EPROTO when the ring is corrupt.
+    ssize_t read(char* buf, size_t len);
+
+    // Call before sleeping on the own eventfd, false if there is already something to do
+    bool wait_read(void);
+    bool wait_write(void);
+
+    // Producer side: no more records, the consumer reads 0 after the last one
+    void close(void);
+
+private:
+    ShmRingHeader* m_header = nullptr;
+    char*    m_data = nullptr;
+    size_t   m_capacity = 0;
+    int      m_reader_fd = -1;
+    int      m_writer_fd = -1;
+    size_t   m_offset = 0;                  // Consumer: bytes of the front record already read
+
+    static void wake(uint32_t& waiting, int fd);
+};
+
+
+/******************************************************************************/
+/*************************          LINK CLASS          ***********************/
+/******************************************************************************/
+// Two rings in one shared memory segment, one per direction, and an eventfd
+// per side. The client creates everything and passes the segment and both
+// eventfds to the broker with SCM_RIGHTS over a unix socket, which then only
+// tells either side that the other one went away. The segment is an anonymous
+// tmpfs file sealed against resizing, so neither side can make the mapping of
+// the other one fault. Calls mirror the socket calls they replace.
+class ShmLink {
+
+public:
+    // Client side, rings of ring_size bytes (rounded up to a power of two)
+    static std::unique_ptr<ShmLink> create(size_t ring_size = SHM_RING_SIZE);
+
+    // Broker side, takes the descriptors received by receive(), null if the segment is not valid
+    static std::unique_ptr<ShmLink> attach(const int fds[SHM_FDS]);
+
+    ~ShmLink();                             // Closes the outbound ring, the peer reads 0 after it
+
+    ShmLink(const ShmLink&) = delete;
+    ShmLink& operator=(const ShmLink&) = delete;
+
+    // Client: sends msg with the descriptors of the link attached, false if not all was sent
+    bool offer(int socket, std::string_view msg) const;
+
+    // Broker: recv() that also takes descriptors passed along, count is set to their number
+    static ssize_t receive(int socket, char* buf, size_t len, int fds[SHM_FDS], int& count);
+
+    int     fd(void) const { return m_wake_fd; }    // Readable when the peer woke this side
+    void    drain(void);
+    void    kick(void);                     // Makes fd() readable, records sent before sleep() was armed are read then
+    ssize_t recv(char* buf, size_t len) { return m_in.read(buf, len); }
+    ssize_t sendmsg(const struct iovec* iov, int iovcnt) { return m_out.write(iov, iovcnt); }
+    ShmRing& out(void) { return m_out; }
+
+    // Arms the wakeup before sleeping on fd(), false if data or room is there already
+    bool sleep(void) { return m_in.wait_read(); }
+    bool wait_space(void) { return m_out.wait_write(); }
+
+    // Blocks until the peer makes room, false on timeout or an event on socket (peer gone)
+    bool block(int socket, int timeout_ms);
+
+private:
+    ShmLink() = default;
+
+    void*   m_base = nullptr;
+    size_t  m_size = 0;
+    int     m_segment_fd = -1;              // Client only, passed by offer()
+    int     m_wake_fd = -1;                 // Own eventfd
+    int     m_peer_fd = -1;                 // Eventfd of the other side
+    ShmRing m_in;
+    ShmRing m_out;
+
+    bool map(int segment_fd, size_t size, bool broker);
+};
+
+#endif
@@ -0,0 +1,225 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : Spool.cpp
+// Product : PubSubx
+// Brief   : Memory mapped segmented spool of publishes made while offline
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Spool.hpp"
+#include "Protocol.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SPOOL_MAGIC "PSXSPOOL"
+#define SPOOL_WRITE 8           // Header offset of the end of written records
+#define SPOOL_READ 16           // Header offset of the end of consumed records
+
+
+/******************************************************************************/
+/*************************          CREATOR          **************************/
+/******************************************************************************/
+Spool::~Spool() {
+    close();
+}
+
+
+/******************************************************************************/
+/*********************          SEGMENT FUNCTIONS          ********************/
+/******************************************************************************/
+std::string Spool::path(uint64_t index) const {
+    return m_settings.dir + "/spool-" + std::to_string(index) + ".seg";
+}
+
+uint64_t Spool::header_get(const Segment& segment, size_t field) {
+    return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(segment.base + field)).load(std::memory_order_acquire);
+}
+
+void Spool::header_set(const Segment& segment, size_t field, uint64_t value) {
+    std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t*>(segment.base + field)).store(value, std::memory_order_release);
+}
+
+bool Spool::map_segment(uint64_t index, bool create) {
+
+    int l_fd = ::open(path(index).c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0644);
+    if (l_fd < 0) { return false; }
+
+    // New segment is sparse until written
+    struct stat l_stat;
+    if ((create && ftruncate(l_fd, m_settings.segment_size) != 0) || fstat(l_fd, &l_stat) != 0
+        || (size_t)l_stat.st_size <= SPOOL_HEADER_SIZE) {
+        ::close(l_fd);
+        return false;
+    }
+
+    void* l_base = mmap(nullptr, l_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0);
+    ::close(l_fd);
+    if (l_base == MAP_FAILED) { return false; }
+
+    Segment l_segment{ index, (char*)l_base, (size_t)l_stat.st_size };
+    if (create) {
+        memcpy(l_segment.base, SPOOL_MAGIC, strlen(SPOOL_MAGIC));
+        header_set(l_segment, SPOOL_WRITE, SPOOL_HEADER_SIZE);
+        header_set(l_segment, SPOOL_READ, SPOOL_HEADER_SIZE);
+    }
+
+    // Segment of another program or torn header is left alone
+    uint64_t l_write = header_get(l_segment, SPOOL_WRITE);
+    uint64_t l_read = header_get(l_segment, SPOOL_READ);
+    if (memcmp(l_segment.base, SPOOL_MAGIC, strlen(SPOOL_MAGIC)) != 0 || l_read < SPOOL_HEADER_SIZE
+        || l_read > l_write || l_write > l_segment.size) {
+        munmap(l_base, l_segment.size);
+        return false;
+    }
+
+    m_segments.push_back(l_segment);
+    m_file_bytes += l_segment.size;
+    m_pending_bytes += l_write - l_read;
+    return true;
+}
+
+void Spool::unmap_segment(const Segment& segment, bool remove) {
+    munmap(segment.base, segment.size);
+    m_file_bytes -= segment.size;
+    if (remove) {
+        unlink(path(segment.index).c_str());
+    }
+}
+
+
+/******************************************************************************/
+/**********************          SPOOL FUNCTIONS          *********************/
+/******************************************************************************/
+bool Spool::open(const SpoolSettings& settings) {
+
+    close();
+    std::lock_guard<std::mutex> l_lock(m_lock);
+    m_settings = settings;
+    m_settings.segment_size = std::max<size_t>(m_settings.segment_size, SPOOL_HEADER_SIZE + FRAME_HEADER_SIZE + 1);
+
+    if (mkdir(m_settings.dir.c_str(), 0755) != 0 && errno != EEXIST) { return false; }
+    DIR* l_dir = opendir(m_settings.dir.c_str());
+    if (!l_dir) { return false; }
+
+    // Only headers are read, recovery does not depend on the number of records
+    std::vector<uint64_t> l_indexes;
+    while (struct dirent* l_entry = readdir(l_dir)) {
+        unsigned long long l_index;
+        char l_tail[8];
+        if (sscanf(l_entry->d_name, "spool-%llu.%7s", &l_index, l_tail) == 2 && strcmp(l_tail, "seg") == 0) {
+            l_indexes.push_back(l_index);
+        }
+    }
+    closedir(l_dir);
+    sort(l_indexes.begin(), l_indexes.end());
+
+    for (uint64_t l_index : l_indexes) {
+        map_segment(l_index, false);
+        m_next_index = l_index + 1;
+    }
+
+    // Consumed segments are only kept as the tail
+    while (m_segments.size() > 1 && header_get(m_segments.front(), SPOOL_READ) == header_get(m_segments.front(), SPOOL_WRITE)) {
+        unmap_segment(m_segments.front(), true);
+        m_segments.pop_front();
+    }
+    return true;
+}
+
+void Spool::close(void) {
+    std::lock_guard<std::mutex> l_lock(m_lock);
+    for (const Segment& l_segment : m_segments) {
+        unmap_segment(l_segment, false);
+    }
+    m_segments.clear();
+    m_pending_bytes = 0;
+}
+
+bool Spool::append(std::string_view topic, std::string_view payload) {
+
+    size_t l_size = command_size(FRAMING_BINARY, OP_PUBLISH, topic, payload);
+    if (SPOOL_HEADER_SIZE + l_size > m_settings.segment_size) { return false; }
+
+    std::lock_guard<std::mutex> l_lock(m_lock);
+
+    // Full tail is followed by a new segment while the limit allows it
+    uint64_t l_write = m_segments.empty() ? 0 : header_get(m_segments.back(), SPOOL_WRITE);
+    if (m_segments.empty() || l_write + l_size > m_segments.back().size) {
+        if (m_file_bytes + m_settings.segment_size > m_settings.max_bytes) { return false; }
+        if (!map_segment(m_next_index, true)) { return false; }
+        m_next_index++;
+        l_write = SPOOL_HEADER_SIZE;
+    }
+
+    // Record is complete before the header publishes it
+    const Segment& l_tail = m_segments.back();
+    encode_command(FRAMING_BINARY, OP_PUBLISH, topic, payload, l_tail.base + l_write);
+    header_set(l_tail, SPOOL_WRITE, l_write + l_size);
+    m_pending_bytes.fetch_add(l_size, std::memory_order_release);
+    return true;
+}
+
+std::string_view Spool::peek(size_t max_bytes) {
+
+    std::lock_guard<std::mutex> l_lock(m_lock);
+    if (m_segments.empty()) { return {}; }
+
+    const Segment& l_head = m_segments.front();
+    uint64_t l_read = header_get(l_head, SPOOL_READ);
+    uint64_t l_write = header_get(l_head, SPOOL_WRITE);
+
+    // Whole records only, a record always fits its segment
+    uint64_t l_end = l_read;
+    while (l_end + FRAME_HEADER_SIZE <= l_write) {
+        FrameHeader l_header;
+        decode_header(l_head.base + l_end, l_header);
+        uint64_t l_size = FRAME_HEADER_SIZE + l_header.length;
+        if (l_end + l_size > l_write || (l_end > l_read && l_end + l_size - l_read > max_bytes)) { break; }
+        l_end += l_size;
+    }
+    return std::string_view(l_head.base + l_read, l_end - l_read);
+}
+
+void Spool::consume(size_t bytes) {
+
+    if (bytes == 0) { return; }
+
+    std::lock_guard<std::mutex> l_lock(m_lock);
+    if (m_segments.empty()) { return; }
+
+    const Segment& l_head = m_segments.front();
+    uint64_t l_read = header_get(l_head, SPOOL_READ) + bytes;
+    header_set(l_head, SPOOL_READ, l_read);
+    m_pending_bytes -= bytes;
+
+    // Consumed head is deleted, a consumed tail starts over
+    if (l_read == header_get(l_head, SPOOL_WRITE)) {
+        if (m_segments.size() > 1) {
+            unmap_segment(l_head, true);
+            m_segments.pop_front();
+        }
+        else {
+            header_set(l_head, SPOOL_WRITE, SPOOL_HEADER_SIZE);
+            header_set(l_head, SPOOL_READ, SPOOL_HEADER_SIZE);
+            madvise(l_head.base + SPOOL_HEADER_SIZE, l_head.size - SPOOL_HEADER_SIZE, MADV_REMOVE);
+        }
+    }
+}
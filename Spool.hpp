@@ -0,0 +1,107 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : Spool.hpp
+// Product : PubSubx
+// Brief   : Memory mapped segmented spool of publishes made while offline
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_SPOOL_H
+#define PUBSUBX_SPOOL_H
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define SPOOL_HEADER_SIZE 64                    // Segment header, records follow
+#define SPOOL_SEGMENT_SIZE ((16)*(1024)*(1024)) // Default segment file size
+#define SPOOL_MAX_BYTES ((1024)*(1024)*(1024))  // Default limit of all segment files
+#define SPOOL_DRAIN_BYTES ((1024)*(1024))       // Records handed to the socket per drain
+
+struct SpoolSettings {
+    std::string dir;                            // Empty switches the spool off
+    size_t segment_size = SPOOL_SEGMENT_SIZE;
+    size_t max_bytes = SPOOL_MAX_BYTES;
+};
+
+
+/******************************************************************************/
+/*************************          SPOOL CLASS          **********************/
+/******************************************************************************/
+// Append only queue of binary PUBLISH frames in files spool-<n>.seg of one
+// directory. Every segment is mapped shared and starts with a header holding
+// the end of its written records and the end of its consumed ones, so records
+// survive a crash of the process and open() reads only the headers, whatever
+// the number of records. A segment is deleted once all its records are
+// consumed. Appends may come from any thread, peek/consume from one consumer.
+class Spool {
+
+public:
+    Spool() = default;
+    ~Spool();
+
+    Spool(const Spool&) = delete;
+    Spool& operator=(const Spool&) = delete;
+
+    // Maps the segments left in dir (created if missing), false on I/O error
+    bool open(const SpoolSettings& settings);
+    void close(void);
+
+    // Appends one record, false if it does not fit a segment or the size limit
+    bool append(std::string_view topic, std::string_view payload);
+
+    // Oldest unconsumed records, whole frames of one segment and at most max_bytes
+    // unless the first record is larger. Valid until consume().
+    std::string_view peek(size_t max_bytes);
+    void consume(size_t bytes);
+
+    bool     empty(void) const { return m_pending_bytes.load(std::memory_order_acquire) == 0; }
+    uint64_t pending_bytes(void) const { return m_pending_bytes.load(std::memory_order_relaxed); }
+    uint64_t file_bytes(void) const { return m_file_bytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Segment {
+        uint64_t index;
+        char*    base;
+        size_t   size;
+    };
+
+    SpoolSettings m_settings;
+    std::mutex    m_lock;               // Protects m_segments and tail writes
+    std::deque<Segment> m_segments;     // Oldest first, the last one takes appends
+    uint64_t      m_next_index = 0;
+    std::atomic<uint64_t> m_pending_bytes{ 0 };
+    std::atomic<uint64_t> m_file_bytes{ 0 };
+
+    std::string path(uint64_t index) const;
+    bool        map_segment(uint64_t index, bool create);
+    void        unmap_segment(const Segment& segment, bool remove);
+
+    // Header fields live in the mapping, stored in native byte order
+    static uint64_t header_get(const Segment& segment, size_t field);
+    static void     header_set(const Segment& segment, size_t field, uint64_t value);
+};
+
+#endif
@@ -0,0 +1,166 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : SpscQueue.hpp
+// Product : PubSubx
+// Brief   : Lock-free single producer / single consumer ring and eventfd
+//           based wakeup used for inter-thread communication
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_SPSC_QUEUE_H
+#define PUBSUBX_SPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define CACHE_LINE_SIZE 64      // Used to keep producer and consumer indexes apart
+
+
+/******************************************************************************/
+/********************          SPSC QUEUE CLASS          **********************/
+/******************************************************************************/
+// Bounded ring of owned objects. push() may only be called from one thread and
+// pop() from one (other) thread. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue {
+
+public:
+    explicit SpscQueue(size_t capacity)
+    {
+        m_size = 2;
+        while (m_size < capacity) { m_size <<= 1; }
+        m_mask = m_size - 1;
+        m_slots.reset(new T[m_size]);
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side, returns false if the ring is full
+    bool push(T&& item) {
+        size_t l_tail = m_tail.load(std::memory_order_relaxed);
+        if (l_tail - m_head_cache == m_size) {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (l_tail - m_head_cache == m_size) { return false; }
+        }
+        m_slots[l_tail & m_mask] = std::move(item);
+        m_tail.store(l_tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if the ring is empty
+    bool pop(T& item) {
+        size_t l_head = m_head.load(std::memory_order_relaxed);
+        if (l_head == m_tail_cache) {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (l_head == m_tail_cache) { return false; }
+        }
+        item = std::move(m_slots[l_head & m_mask]);
+        m_head.store(l_head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Safe to call from either side, result may be stale
+    bool empty(void) const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity(void) const { return m_size; }
+
+private:
+    size_t           m_size;
+    size_t           m_mask;
+    std::unique_ptr<T[]> m_slots;
+
+    // Consumer owned line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head{ 0 };
+    size_t           m_tail_cache = 0;  // Consumer copy of the tail
+
+    // Producer owned line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail{ 0 };
+    size_t           m_head_cache = 0;  // Producer copy of the head
+};
+
+
+/******************************************************************************/
+/*******************          EVENT NOTIFIER CLASS          *******************/
+/******************************************************************************/
+// eventfd wrapper that a select/poll loop can wait on. The consumer arms the
+// notifier before blocking, so producers only pay for a write() when the
+// consumer is actually asleep.
+class EventNotifier {
+
+public:
+    EventNotifier() {
+        m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    ~EventNotifier() {
+        if (m_fd >= 0) { close(m_fd); }
+    }
+
+    EventNotifier(const EventNotifier&) = delete;
+    EventNotifier& operator=(const EventNotifier&) = delete;
+
+    int fd(void) const { return m_fd; }
+
+    // Producer side, call after publishing data to the queue
+    void notify(void) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_armed.load(std::memory_order_relaxed) && m_armed.exchange(false)) {
+            force();
+        }
+    }
+
+    // Unconditional wakeup
+    void force(void) {
+        uint64_t l_one = 1;
+        ssize_t l_ret = write(m_fd, &l_one, sizeof(l_one));
+        (void)l_ret;
+    }
+
+    // Consumer side, call before blocking and re-check the queue afterwards
+    void arm(void) {
+        m_armed.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    // Consumer side, call after waking up
+    void disarm(void) {
+        m_armed.store(false, std::memory_order_relaxed);
+    }
+
+    // Consumer side, clear the eventfd counter
+    void drain(void) {
+        uint64_t l_count;
+        ssize_t l_ret = read(m_fd, &l_count, sizeof(l_count));
+        (void)l_ret;
+    }
+
+private:
+    int               m_fd;
+    std::atomic<bool> m_armed{ false };
+};
+
+#endif
@@ -0,0 +1,270 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : TopicIndex.hpp
+// Product : PubSubx
+// Brief   : Segmented trie of topic filters with + and # wildcards
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_TOPIC_INDEX_H
+#define PUBSUBX_TOPIC_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define TOPIC_SEPARATOR '/'     // Separates levels of a hierarchical topic
+#define TOPIC_SINGLE    "+"     // Matches exactly one level
+#define TOPIC_MULTI     "#"     // Matches any number of levels, only as last level
+
+// Hash that accepts string_view, so lookups of received topics do not allocate
+struct TopicHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+
+/******************************************************************************/
+/********************          TOPIC INDEX CLASS           ********************/
+/******************************************************************************/
+// Maps topic filters ("sensors/+/temp", "sensors/#", "prices") to values.
+// Every level of a filter is one trie node with a hashed child table, so
+// matching a received topic costs one hash lookup per level plus the
+// wildcard branches, independent of the number of filters.
+template <typename T>
+class TopicIndex {
+
+public:
+    // Filter is valid if wildcards occupy whole levels and # is the last level
+    static bool valid(std::string_view filter) {
+        if (filter.empty()) { return false; }
+        size_t l_start = 0;
+        while (true) {
+            size_t l_end = filter.find(TOPIC_SEPARATOR, l_start);
+            std::string_view l_level = filter.substr(l_start, l_end == std::string_view::npos ? std::string_view::npos : l_end - l_start);
+            if (l_level.find_first_of("+#") != std::string_view::npos && l_level.size() != 1) { return false; }
+            if (l_level == TOPIC_MULTI && l_end != std::string_view::npos) { return false; }
+            if (l_end == std::string_view::npos) { return true; }
+            l_start = l_end + 1;
+        }
+    }
+
+    // Returns false if filter is already present
+    bool insert(std::string_view filter, T value) {
+        Node* l_node = &m_root;
+        bool l_multi = false;
+        walk(filter, [&](std::string_view level, bool last) {
+            if (last && level == TOPIC_MULTI) {
+                l_multi = true;
+                return;
+            }
+            std::unique_ptr<Node>& l_child = (level == TOPIC_SINGLE) ? l_node->single : child(l_node, level);
+            if (!l_child) { l_child.reset(new Node()); }
+            l_node = l_child.get();
+        });
+
+        std::unique_ptr<T>& l_slot = l_multi ? l_node->multi : l_node->exact;
+        if (l_slot) { return false; }
+        l_slot.reset(new T(std::move(value)));
+        m_size++;
+        return true;
+    }
+
+    // Returns false if filter was not present
+    bool erase(std::string_view filter) {
+        if (!erase_node(&m_root, filter)) { return false; }
+        m_size--;
+        return true;
+    }
+
+    // Value stored for exactly this filter, nullptr if not present
+    T* find(std::string_view filter) {
+        Node* l_node = &m_root;
+        bool l_multi = false;
+        walk(filter, [&](std::string_view level, bool last) {
+            if (!l_node) { return; }
+            if (last && level == TOPIC_MULTI) {
+                l_multi = true;
+                return;
+            }
+            if (level == TOPIC_SINGLE) {
+                l_node = l_node->single.get();
+            }
+            else {
+                auto l_it = l_node->children.find(level);
+                l_node = l_it == l_node->children.end() ? nullptr : l_it->second.get();
+            }
+        });
+        if (!l_node) { return nullptr; }
+        return l_multi ? l_node->multi.get() : l_node->exact.get();
+    }
+
+    // Call visit(value) for every filter matching the topic, returns number of matches
+    template <typename F>
+    size_t match(std::string_view topic, F&& visit) {
+        return match_node(&m_root, topic, false, visit);
+    }
+
+    // Call visit(filter, value) for every stored filter
+    template <typename F>
+    void for_each(F&& visit) {
+        std::string l_prefix;
+        for_each_node(&m_root, l_prefix, visit);
+    }
+
+    size_t size(void) const { return m_size; }
+    bool   empty(void) const { return m_size == 0; }
+    void   clear(void) { m_root = Node(); m_size = 0; }
+
+private:
+    struct Node {
+        std::unordered_map<std::string, std::unique_ptr<Node>, TopicHash, std::equal_to<>> children;
+        std::unique_ptr<Node> single;   // Child for + level
+        std::unique_ptr<T>    exact;    // Value of filter ending at this node
+        std::unique_ptr<T>    multi;    // Value of filter ending with # below this node
+
+        bool unused(void) const { return children.empty() && !single && !exact && !multi; }
+    };
+
+    Node   m_root;
+    size_t m_size = 0;
+
+    static std::unique_ptr<Node>& child(Node* node, std::string_view level) {
+        auto l_it = node->children.find(level);
+        if (l_it != node->children.end()) { return l_it->second; }
+        return node->children[std::string(level)];
+    }
+
+    // Split into levels, f(level, is_last)
+    template <typename F>
+    static void walk(std::string_view filter, F&& f) {
+        size_t l_start = 0;
+        while (true) {
+            size_t l_end = filter.find(TOPIC_SEPARATOR, l_start);
+            if (l_end == std::string_view::npos) {
+                f(filter.substr(l_start), true);
+                return;
+            }
+            f(filter.substr(l_start, l_end - l_start), false);
+            l_start = l_end + 1;
+        }
+    }
+
+    // Topic rest holds the levels below node, done is set once all levels are consumed
+    template <typename F>
+    static size_t match_node(Node* node, std::string_view rest, bool done, F& visit) {
+        size_t l_count = 0;
+
+        // # also matches the parent level itself ("a/#" matches "a")
+        if (node->multi) {
+            visit(*node->multi);
+            l_count++;
+        }
+        if (done) {
+            if (node->exact) {
+                visit(*node->exact);
+                l_count++;
+            }
+            return l_count;
+        }
+
+        size_t l_end = rest.find(TOPIC_SEPARATOR);
+        std::string_view l_level = rest.substr(0, l_end);
+        std::string_view l_rest = l_end == std::string_view::npos ? std::string_view() : rest.substr(l_end + 1);
+        bool l_done = l_end == std::string_view::npos;
+
+        auto l_it = node->children.find(l_level);
+        if (l_it != node->children.end()) {
+            l_count += match_node(l_it->second.get(), l_rest, l_done, visit);
+        }
+        if (node->single) {
+            l_count += match_node(node->single.get(), l_rest, l_done, visit);
+        }
+        return l_count;
+    }
+
+    bool erase_node(Node* node, std::string_view rest) {
+        size_t l_end = rest.find(TOPIC_SEPARATOR);
+        std::string_view l_level = rest.substr(0, l_end);
+
+        if (l_end == std::string_view::npos && l_level == TOPIC_MULTI) {
+            if (!node->multi) { return false; }
+            node->multi.reset();
+            return true;
+        }
+
+        // Find child of this level and remove it once it holds nothing
+        std::unique_ptr<Node>* l_child;
+        typename decltype(node->children)::iterator l_it;
+        if (l_level == TOPIC_SINGLE) {
+            l_child = &node->single;
+        }
+        else {
+            l_it = node->children.find(l_level);
+            if (l_it == node->children.end()) { return false; }
+            l_child = &l_it->second;
+        }
+        if (!*l_child) { return false; }
+
+        bool l_erased;
+        if (l_end == std::string_view::npos) {
+            l_erased = (bool)(*l_child)->exact;
+            (*l_child)->exact.reset();
+        }
+        else {
+            l_erased = erase_node(l_child->get(), rest.substr(l_end + 1));
+        }
+
+        if (l_erased && (*l_child)->unused()) {
+            if (l_level == TOPIC_SINGLE) { node->single.reset(); }
+            else { node->children.erase(l_it); }
+        }
+        return l_erased;
+    }
+
+    template <typename F>
+    static void for_each_node(Node* node, std::string& prefix, F& visit) {
+        size_t l_len = prefix.size();
+        std::string l_sep = prefix.empty() ? "" : std::string(1, TOPIC_SEPARATOR);
+
+        if (node->multi) {
+            prefix += l_sep + TOPIC_MULTI;
+            visit((const std::string&)prefix, *node->multi);
+            prefix.resize(l_len);
+        }
+        for (auto& l_child : node->children) {
+            prefix += l_sep + l_child.first;
+            if (l_child.second->exact) { visit((const std::string&)prefix, *l_child.second->exact); }
+            for_each_node(l_child.second.get(), prefix, visit);
+            prefix.resize(l_len);
+        }
+        if (node->single) {
+            prefix += l_sep + TOPIC_SINGLE;
+            if (node->single->exact) { visit((const std::string&)prefix, *node->single->exact); }
+            for_each_node(node->single.get(), prefix, visit);
+            prefix.resize(l_len);
+        }
+    }
+};
+
+#endif
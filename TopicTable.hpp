@@ -0,0 +1,101 @@
+//******************************************************************************//
+//                  ____        __   _____       __   _  __                     //
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    //
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     //
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      //
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      //
+//                                                                              //
+//******************************************************************************//
+// File    : TopicTable.hpp
+// Product : PubSubx
+// Brief   : Interning table that maps topic names to compact integer IDs
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+
+/******************************************************************************/
+/************************          INCLUDES           *************************/
+/******************************************************************************/
+
+#ifndef PUBSUBX_TOPIC_TABLE_H
+#define PUBSUBX_TOPIC_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "TopicIndex.hpp"
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define NO_TOPIC_ID 0           // Returned when a topic can not be interned
+#define MAX_TOPIC_IDS 0xFFFF    // IDs travel in the 16 bit topic length field
+
+
+/******************************************************************************/
+/********************          TOPIC TABLE CLASS           ********************/
+/******************************************************************************/
+// IDs are assigned once per name and never reused, so an ID handed out to
+// the application or to the server stays valid for the lifetime of the
+// table. Entries are heap allocated and keep their address. Each entry also
+// caches the handlers (T) matching its name, valid while epoch is current.
+template <typename T>
+class TopicTable {
+
+public:
+    struct Entry {
+        std::string     name;
+        uint16_t        id;
+        bool            bind_sent = false;  // Binding proposed to the server on this connection
+        bool            bound = false;      // Server confirmed the binding, frames may carry the ID
+        uint64_t        epoch = 0;          // Subscriptions epoch the handler cache was built for
+        std::vector<T*> handlers;           // Cached subscriptions matching name
+    };
+
+    // ID of the name, a new one is assigned on first use, NO_TOPIC_ID if table is full
+    uint16_t intern(std::string_view name) {
+        auto l_it = m_ids.find(name);
+        if (l_it != m_ids.end()) { return l_it->second; }
+        if (m_entries.size() >= MAX_TOPIC_IDS) { return NO_TOPIC_ID; }
+
+        uint16_t l_id = (uint16_t)(m_entries.size() + 1);
+        m_entries.emplace_back(new Entry{ std::string(name), l_id });
+        m_ids.emplace(m_entries.back()->name, l_id);
+        return l_id;
+    }
+
+    // ID of an already interned name, NO_TOPIC_ID otherwise
+    uint16_t find(std::string_view name) const {
+        auto l_it = m_ids.find(name);
+        return l_it == m_ids.end() ? NO_TOPIC_ID : l_it->second;
+    }
+
+    // Entry of the ID, nullptr if it was never assigned
+    Entry* get(uint16_t id) {
+        if (id == NO_TOPIC_ID || id > m_entries.size()) { return nullptr; }
+        return m_entries[id - 1].get();
+    }
+
+    // Bindings belong to one connection, IDs themselves are kept
+    void unbind_all(void) {
+        for (auto& l_entry : m_entries) {
+            l_entry->bind_sent = false;
+            l_entry->bound = false;
+        }
+    }
+
+    size_t size(void) const { return m_entries.size(); }
+
+private:
+    std::unordered_map<std::string_view, uint16_t, TopicHash> m_ids; // Keys view names owned by entries
+    std::vector<std::unique_ptr<Entry>> m_entries;                  // Index is ID - 1
+};
+
+#endif
@@ -0,0 +1,578 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : bench.cpp
+// Product : PubSubx
+// Brief   : Micro-benchmarks of the client parsing, framing, send and transport paths
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Cli.hpp"
+#include "TopicIndex.hpp"
+#include "ShmRing.hpp"
+
+#include <sys/socket.h>
+#include <thread>
+#include <random>
+#include <new>
+#include <cstdlib>
+
+/******************************************************************************/
+/***********************          DEFINITIONS          ************************/
+/******************************************************************************/
+#define BENCH_MESSAGES 100000   // Default number of messages per run
+#define BENCH_RUNS 5            // Timed runs, the fastest one is reported
+#define BENCH_SEED 12345        // Streams are the same in every run of the binary
+#define BENCH_TOPICS 1000       // Subscribed topics in the dispatch benchmark
+#define BENCH_PINGPONG 10000    // Round trips of the transport latency benchmarks
+#define BENCH_PING_SIZE 64      // Bytes of one round trip message
+#define BENCH_PRODUCERS 4       // Threads sharing one ring in the multi producer benchmark
+
+// Every allocation of the process is counted, benchmarks read the difference
+static uint64_t g_allocs = 0;
+
+void* operator new(size_t size) {
+    g_allocs++;
+    void* l_ptr = malloc(size ? size : 1);
+    if (!l_ptr) { throw bad_alloc(); }
+    return l_ptr;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+struct BenchResult {
+    string   name;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    double   ns_per_msg = 0;
+    double   bytes_per_sec = 0;
+    double   allocs_per_msg = 0;
+    double   ratio = 0;             // Original / compressed bytes, compression benchmarks only
+};
+
+// Synthetic traffic, shared by all benchmarks
+struct BenchData {
+    vector<string> topics;          // Hierarchical topic names
+    vector<size_t> sizes;           // Payload size of every message
+    vector<size_t> topic_of;        // Topic index of every message
+    vector<size_t> reads;           // Sizes of socket reads feeding the framer
+    string         payload;         // Payloads are prefixes of this string
+    string         telemetry;       // JSON records with varying values, prefixes are compressed
+};
+
+
+/******************************************************************************/
+/********************          HELPER FUNCTIONS          **********************/
+/******************************************************************************/
+// Mostly small messages with a long tail: 70% 16-128 B, 25% 128 B-1 KB, 5% 1-8 KB
+static BenchData bench_data(size_t count) {
+
+    BenchData l_data;
+    mt19937 l_rng(BENCH_SEED);
+
+    for (size_t i = 0; i < BENCH_TOPICS; i++) {
+        l_data.topics.push_back("market/eu/" + to_string(i % 10) + "/instrument" + to_string(i));
+    }
+
+    uniform_int_distribution<int> l_pct(0, 99);
+    for (size_t i = 0; i < count; i++) {
+        int l_p = l_pct(l_rng);
+        size_t l_lo = l_p < 70 ? 16 : l_p < 95 ? 128 : 1024;
+        size_t l_hi = l_p < 70 ? 128 : l_p < 95 ? 1024 : 8192;
+        l_data.sizes.push_back(uniform_int_distribution<size_t>(l_lo, l_hi)(l_rng));
+        l_data.topic_of.push_back(uniform_int_distribution<size_t>(0, BENCH_TOPICS - 1)(l_rng));
+    }
+
+    // Reads of odd sizes make EOMs and headers straddle read boundaries
+    uniform_int_distribution<size_t> l_read(1, 4096);
+    for (size_t i = 0; i < 4096; i++) {
+        l_data.reads.push_back(l_read(l_rng));
+    }
+
+    for (size_t i = 0; i < 8192; i++) {
+        l_data.payload += (char)('a' + i % 26);
+    }
+
+    // Telemetry as published in production, repeated keys and random digits
+    uniform_int_distribution<int> l_digits(0, 99999);
+    for (uint64_t l_ts = 1644912000000; l_data.telemetry.size() < 8192; l_ts += l_pct(l_rng)) {
+        l_data.telemetry += "{\"ts\":" + to_string(l_ts) + ",\"sym\":\"EURUSD\",\"bid\":1." + to_string(l_digits(l_rng))
+            + ",\"ask\":1." + to_string(l_digits(l_rng)) + ",\"vol\":" + to_string(l_digits(l_rng)) + "},";
+    }
+    return l_data;
+}
+
+// Receive stream as sent by the server in the given framing
+static string bench_stream(const BenchData& data, framing_enum framing) {
+
+    string l_stream, l_frame;
+    for (size_t i = 0; i < data.sizes.size(); i++) {
+        string_view l_topic = data.topics[data.topic_of[i]];
+        string_view l_payload(data.payload.data(), data.sizes[i]);
+
+        if (framing == FRAMING_TEXT) {
+            l_stream.append(l_topic).append(" ").append(l_payload).append(EOM);
+            continue;
+        }
+        FrameHeader l_header = { (uint32_t)(l_topic.size() + l_payload.size()), OP_MESSAGE, 0, (uint16_t)l_topic.size() };
+        char l_buf[FRAME_HEADER_SIZE];
+        encode_header(l_buf, l_header);
+        l_stream.append(l_buf, FRAME_HEADER_SIZE).append(l_topic).append(l_payload);
+    }
+    return l_stream;
+}
+
+// Both ends of a shared memory link, handed over a socket pair as a client and broker do
+static bool bench_link(unique_ptr<ShmLink>& client, unique_ptr<ShmLink>& broker) {
+
+    int l_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, l_fds) < 0) { return false; }
+    client = ShmLink::create();
+    char l_buf[8];
+    int l_passed[SHM_FDS];
+    int l_count = 0;
+    if (client && client->offer(l_fds[0], "LINK") && ShmLink::receive(l_fds[1], l_buf, sizeof(l_buf), l_passed, l_count) > 0) {
+        if (l_count == SHM_FDS) {
+            broker = ShmLink::attach(l_passed);
+        }
+        else {
+            for (int i = 0; i < l_count; i++) { close(l_passed[i]); }
+        }
+    }
+    close(l_fds[0]);
+    close(l_fds[1]);
+    return client && broker;
+}
+
+// Reads exactly len bytes from the link, sleeping on its eventfd while the ring is empty
+static void bench_link_read(ShmLink& link, char* buf, size_t len) {
+    for (size_t l_done = 0; l_done < len; ) {
+        ssize_t l_size = link.recv(buf + l_done, len - l_done);
+        if (l_size > 0) { l_done += l_size; }
+        else if (link.sleep()) { link.block(-1, -1); }
+    }
+}
+
+// Run body BENCH_RUNS times, keep the fastest run and allocations of the first
+template <typename F>
+static BenchResult bench_run(const string& name, uint64_t messages, uint64_t bytes, F&& body) {
+
+    BenchResult l_result;
+    l_result.name = name;
+    l_result.messages = messages;
+    l_result.bytes = bytes;
+
+    double l_best = 0;
+    for (int l_run = 0; l_run < BENCH_RUNS; l_run++) {
+        uint64_t l_allocs = g_allocs;
+        auto l_start = chrono::steady_clock::now();
+        body();
+        auto l_end = chrono::steady_clock::now();
+        if (l_run == 0) {
+            l_result.allocs_per_msg = (double)(g_allocs - l_allocs) / messages;
+        }
+
+        double l_ns = chrono::duration<double, nano>(l_end - l_start).count();
+        if (l_run == 0 || l_ns < l_best) { l_best = l_ns; }
+    }
+
+    l_result.ns_per_msg = l_best / messages;
+    l_result.bytes_per_sec = bytes / (l_best / 1e9);
+    return l_result;
+}
+
+
+/******************************************************************************/
+/*********************          BENCHMARKS          ***************************/
+/******************************************************************************/
+// Command line split into words, as done for every entered command
+static BenchResult bench_split(const BenchData& data, const vector<string>& lines, uint64_t bytes) {
+    size_t l_words = 0;
+    BenchResult l_result = bench_run("split", lines.size(), bytes, [&]() {
+        for (const string& l_line : lines) {
+            l_words += split(l_line, " ").size();
+        }
+    });
+    if (l_words == 0) { cerr << "split produced no words\n"; }
+    return l_result;
+}
+
+static BenchResult bench_command_parse(Cli& cli, const vector<string>& lines, uint64_t bytes) {
+    size_t l_parsed = 0;
+    BenchResult l_result = bench_run("command_parse", lines.size(), bytes, [&]() {
+        for (const string& l_line : lines) {
+            l_parsed += cli.command_parse(l_line);
+        }
+    });
+    if (l_parsed != lines.size() * BENCH_RUNS) { cerr << "command_parse rejected input\n"; }
+    return l_result;
+}
+
+// Receive stream fed in odd sized reads, frames are counted
+static BenchResult bench_framer(const BenchData& data, framing_enum framing, const string& name) {
+
+    string l_stream = bench_stream(data, framing);
+    size_t l_frames = 0;
+
+    BenchResult l_result = bench_run(name, data.sizes.size(), l_stream.size(), [&]() {
+        Framer l_framer(EOM);
+        l_framer.set_framing(framing);
+        string_view l_frame;
+        size_t l_pos = 0, l_read = 0;
+        l_frames = 0;
+
+        while (l_pos < l_stream.size()) {
+            size_t l_size = min(data.reads[l_read++ % data.reads.size()], l_stream.size() - l_pos);
+            memcpy(l_framer.prepare(l_size), l_stream.data() + l_pos, l_size);
+            l_framer.commit(l_size);
+            l_pos += l_size;
+            while (l_framer.next(l_frame)) {
+                l_frames++;
+            }
+        }
+    });
+    if (l_frames != data.sizes.size()) { cerr << name << " returned " << l_frames << " frames\n"; }
+    return l_result;
+}
+
+// Decode and topic lookup of every received frame, as the socket loop does
+static BenchResult bench_dispatch(const BenchData& data, framing_enum framing, const string& name) {
+
+    TopicIndex<MessageHandler> l_topics;
+    size_t l_calls = 0;
+    MessageHandler l_handler = [&](string_view, span<const byte>) { l_calls++; };
+    for (size_t i = 0; i < data.topics.size(); i += 2) {
+        l_topics.insert(data.topics[i], l_handler);
+    }
+    l_topics.insert("market/eu/7/#", l_handler);
+
+    string l_stream = bench_stream(data, framing);
+    Framer l_framer(EOM);
+    l_framer.set_framing(framing);
+    l_framer.append(l_stream.data(), l_stream.size());
+    vector<string_view> l_frames;
+    string_view l_frame;
+    while (l_framer.next(l_frame)) {
+        l_frames.push_back(l_frame);
+    }
+
+    return bench_run(name, l_frames.size(), l_stream.size(), [&]() {
+        for (string_view l_msg : l_frames) {
+            uint8_t l_opcode;
+            uint16_t l_topic_id;
+            string_view l_topic, l_payload;
+            decode_message(framing, l_msg, l_opcode, l_topic_id, l_topic, l_payload);
+            span<const byte> l_bytes = as_bytes(span<const char>(l_payload.data(), l_payload.size()));
+            l_topics.match(l_topic, [&](MessageHandler& handler) {
+                handler(l_topic, l_bytes);
+            });
+        }
+    });
+}
+
+// Commands encoded into pooled buffers and sent through the gather writer into a socket pair
+// (or a shared memory link), batched publishes share OP_PUBLISH_BATCH frames as with linger
+static BenchResult bench_send(const BenchData& data, framing_enum framing, const string& name, bool batched = false, bool link = false) {
+
+    int l_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, l_fds) < 0) {
+        cerr << "socketpair failed\n";
+        return BenchResult();
+    }
+    unique_ptr<ShmLink> l_client, l_broker;
+    if (link && !bench_link(l_client, l_broker)) {
+        cerr << name << ": no shared memory link\n";
+        close(l_fds[0]);
+        close(l_fds[1]);
+        return BenchResult();
+    }
+
+    uint64_t l_bytes = 0;
+    for (size_t i = 0; i < data.sizes.size(); i++) {
+        l_bytes += command_size(framing, OP_PUBLISH, data.topics[data.topic_of[i]], string_view(data.payload.data(), data.sizes[i]));
+    }
+
+    // Every message is encoded into a pooled buffer as publish does, warm pool allocates nothing
+    BufferPool l_pool;
+    vector<char> l_sink(1 << 20);
+    BenchResult l_result = bench_run(name, data.sizes.size(), l_bytes, [&]() {
+        SendEngine l_sender(EOM, BUFFER_SIZE - strlen(EOM));
+        if (framing == FRAMING_BINARY) { l_sender.configure("", 0); }
+
+        // Queue in batches like the socket loop does after draining the ring
+        size_t l_next = 0;
+        BufRef l_batch;
+        auto l_close = [&]() {
+            FrameHeader l_header = { (uint32_t)(l_batch.size() - FRAME_HEADER_SIZE), OP_PUBLISH_BATCH, 0, 0 };
+            encode_header(l_batch.data(), l_header);
+            l_sender.push(std::move(l_batch));
+        };
+        while (l_next < data.sizes.size() || !l_sender.empty() || l_batch) {
+            for (size_t i = 0; i < 64 && l_next < data.sizes.size(); i++, l_next++) {
+                string_view l_topic = data.topics[data.topic_of[l_next]];
+                string_view l_payload(data.payload.data(), data.sizes[l_next]);
+                size_t l_size = command_size(framing, OP_PUBLISH, l_topic, l_payload);
+                if (!batched || l_size > PUBLISH_BATCH_BYTES / 2) {
+                    BufRef l_buf = l_pool.get(l_size);
+                    encode_command(framing, OP_PUBLISH, l_topic, l_payload, l_buf.data());
+                    l_buf.set_size(l_size);
+                    l_sender.push(std::move(l_buf));
+                    continue;
+                }
+                if (l_batch && l_batch.size() + l_size > l_batch.capacity()) { l_close(); }
+                if (!l_batch) {
+                    l_batch = l_pool.get(FRAME_HEADER_SIZE + PUBLISH_BATCH_BYTES);
+                    l_batch.set_size(FRAME_HEADER_SIZE);
+                }
+                encode_command(framing, OP_PUBLISH, l_topic, l_payload, l_batch.data() + l_batch.size());
+                l_batch.set_size(l_batch.size() + l_size);
+            }
+            if (l_batch && l_next == data.sizes.size()) { l_close(); }
+            if (link) {
+                while (!l_sender.empty() && l_sender.write(l_client->out()) > 0) {}
+                while (l_broker->recv(l_sink.data(), l_sink.size()) > 0) {}
+                continue;
+            }
+            while (!l_sender.empty() && l_sender.write(l_fds[0]) > 0) {}
+            while (recv(l_fds[1], l_sink.data(), l_sink.size(), 0) > 0) {}
+        }
+    });
+
+    close(l_fds[0]);
+    close(l_fds[1]);
+    return l_result;
+}
+
+// Round trips of one message between two threads that sleep while there is nothing to read,
+// over a unix socket pair or a shared memory link
+static BenchResult bench_pingpong(bool link, const string& name) {
+
+    int l_fds[2];
+    unique_ptr<ShmLink> l_client, l_broker;
+    if (link ? !bench_link(l_client, l_broker) : socketpair(AF_UNIX, SOCK_STREAM, 0, l_fds) < 0) {
+        cerr << name << ": no transport\n";
+        return BenchResult();
+    }
+
+    // Socket calls loop like the ring reads, a stream may split the message
+    auto l_read = [&](bool client, char* buf) {
+        if (link) { bench_link_read(client ? *l_client : *l_broker, buf, BENCH_PING_SIZE); return; }
+        for (size_t l_done = 0; l_done < BENCH_PING_SIZE; ) {
+            ssize_t l_size = recv(l_fds[client ? 0 : 1], buf + l_done, BENCH_PING_SIZE - l_done, 0);
+            if (l_size > 0) { l_done += l_size; }
+        }
+    };
+    auto l_write = [&](bool client, char* buf) {
+        struct iovec l_iov = { buf, BENCH_PING_SIZE };
+        if (link) { (client ? l_client : l_broker)->sendmsg(&l_iov, 1); return; }
+        send(l_fds[client ? 0 : 1], buf, BENCH_PING_SIZE, MSG_NOSIGNAL);
+    };
+
+    BenchResult l_result = bench_run(name, BENCH_PINGPONG, 2 * BENCH_PINGPONG * BENCH_PING_SIZE, [&]() {
+        thread l_echo([&]() {
+            char l_buf[BENCH_PING_SIZE];
+            for (int i = 0; i < BENCH_PINGPONG; i++) {
+                l_read(false, l_buf);
+                l_write(false, l_buf);
+            }
+        });
+        char l_buf[BENCH_PING_SIZE] = {};
+        for (int i = 0; i < BENCH_PINGPONG; i++) {
+            l_write(true, l_buf);
+            l_read(true, l_buf);
+        }
+        l_echo.join();
+    });
+
+    if (!link) {
+        close(l_fds[0]);
+        close(l_fds[1]);
+    }
+    return l_result;
+}
+
+// Producers of several threads commit whole records into one ring, the consumer reads them in order
+// of their claims. Both sides only spin, the ring is never idle long enough to sleep.
+static BenchResult bench_link_mpsc(const BenchData& data, const string& name) {
+
+    unique_ptr<ShmLink> l_client, l_broker;
+    if (!bench_link(l_client, l_broker)) {
+        cerr << name << ": no shared memory link\n";
+        return BenchResult();
+    }
+    uint64_t l_bytes = 0;
+    for (size_t l_size : data.sizes) {
+        l_bytes += l_size;
+    }
+
+    vector<char> l_sink(1 << 20);
+    BenchResult l_result = bench_run(name, data.sizes.size(), l_bytes, [&]() {
+        vector<thread> l_producers;
+        for (size_t p = 0; p < BENCH_PRODUCERS; p++) {
+            l_producers.emplace_back([&, p]() {
+                for (size_t i = p; i < data.sizes.size(); i += BENCH_PRODUCERS) {
+                    struct iovec l_iov = { (void*)data.payload.data(), data.sizes[i] };
+                    while (l_client->out().write(&l_iov, 1, true) < 0) {
+                        this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (uint64_t l_read = 0; l_read < l_bytes; ) {
+            ssize_t l_size = l_broker->recv(l_sink.data(), l_sink.size());
+            if (l_size > 0) { l_read += l_size; }
+            else { this_thread::yield(); }
+        }
+        for (thread& l_producer : l_producers) {
+            l_producer.join();
+        }
+    });
+    return l_result;
+}
+
+
+// Telemetry payloads above the compression threshold, as publish compresses them
+static BenchResult bench_compress(const BenchData& data, bool expand, const string& name) {
+
+    vector<string_view> l_payloads;
+    uint64_t l_bytes = 0;
+    for (size_t l_size : data.sizes) {
+        if (l_size >= COMPRESS_THRESHOLD) {
+            l_payloads.push_back(string_view(data.telemetry.data(), l_size));
+            l_bytes += l_size;
+        }
+    }
+    if (l_payloads.empty() || !compression_available()) {
+        cerr << name << ": no compression\n";
+        return BenchResult();
+    }
+
+    // Packed payloads are prepared once, decompression reads them
+    vector<string> l_packed;
+    uint64_t l_packed_bytes = 0;
+    vector<char> l_out(compress_bound(data.telemetry.size()));
+    for (string_view l_payload : l_payloads) {
+        size_t l_size = compress_payload(l_payload, COMPRESS_LEVEL, l_out.data());
+        l_packed.emplace_back(l_out.data(), l_size);
+        l_packed_bytes += l_size;
+    }
+
+    BenchResult l_result = bench_run(name, l_payloads.size(), l_bytes, [&]() {
+        for (size_t i = 0; i < l_payloads.size(); i++) {
+            if (expand) {
+                decompress_payload(l_packed[i], l_out.data(), l_payloads[i].size());
+            }
+            else {
+                compress_payload(l_payloads[i], COMPRESS_LEVEL, l_out.data());
+            }
+        }
+    });
+    l_result.ratio = (double)l_bytes / l_packed_bytes;
+    return l_result;
+}
+
+
+/******************************************************************************/
+/**************************          MAIN          ****************************/
+/******************************************************************************/
+static void print_json(const vector<BenchResult>& results) {
+    cout << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        cout << "    {\"name\": \"" << r.name << "\", \"messages\": " << r.messages
+            << ", \"bytes\": " << r.bytes << ", \"ns_per_msg\": " << r.ns_per_msg
+            << ", \"bytes_per_sec\": " << (uint64_t)r.bytes_per_sec
+            << ", \"allocs_per_msg\": " << r.allocs_per_msg
+            << (r.ratio > 0 ? ", \"ratio\": " + to_string(r.ratio) : string()) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    cout << "  ]\n}\n";
+}
+
+static void print_table(const vector<BenchResult>& results) {
+    printf("%-22s %10s %12s %12s %14s %8s\n", "benchmark", "messages", "ns/msg", "MB/s", "allocs/msg", "ratio");
+    for (const BenchResult& r : results) {
+        printf("%-22s %10lu %12.1f %12.1f %14.3f", r.name.c_str(), (unsigned long)r.messages,
+            r.ns_per_msg, r.bytes_per_sec / 1e6, r.allocs_per_msg);
+        if (r.ratio > 0) { printf(" %8.2f", r.ratio); }
+        printf("\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t l_count = BENCH_MESSAGES;
+    bool l_json = false;
+    string l_filter;
+    bool l_usage = false;
+
+    // Optional: --json, -n <messages>, -f <name filter>
+    for (int i = 1; i < argc; i++) {
+        string l_opt = argv[i];
+        if (l_opt == "--json") {
+            l_json = true;
+        }
+        else if (l_opt == "-n" && i + 1 < argc && atol(argv[i + 1]) > 0) {
+            l_count = atol(argv[++i]);
+        }
+        else if (l_opt == "-f" && i + 1 < argc) {
+            l_filter = argv[++i];
+        }
+        else {
+            l_usage = true;
+        }
+    }
+    if (l_usage) {
+        cout << "usage: " << argv[0] << " [--json] [-n messages] [-f name_filter]\n";
+        return 1;
+    }
+
+    BenchData l_data = bench_data(l_count);
+
+    // Command lines as typed into the CLI
+    vector<string> l_lines;
+    uint64_t l_line_bytes = 0;
+    for (size_t i = 0; i < l_count; i++) {
+        l_lines.push_back("publish " + l_data.topics[l_data.topic_of[i]] + " " + l_data.payload.substr(0, l_data.sizes[i]));
+        l_line_bytes += l_lines.back().size();
+    }
+
+    Client l_client("localhost");
+    Cli l_cli(l_client);
+
+    auto l_selected = [&](const string& name) { return l_filter.empty() || name.find(l_filter) != string::npos; };
+    vector<BenchResult> l_results;
+
+    if (l_selected("split")) { l_results.push_back(bench_split(l_data, l_lines, l_line_bytes)); }
+    if (l_selected("command_parse")) { l_results.push_back(bench_command_parse(l_cli, l_lines, l_line_bytes)); }
+    if (l_selected("framer_text")) { l_results.push_back(bench_framer(l_data, FRAMING_TEXT, "framer_text")); }
+    if (l_selected("framer_binary")) { l_results.push_back(bench_framer(l_data, FRAMING_BINARY, "framer_binary")); }
+    if (l_selected("dispatch_text")) { l_results.push_back(bench_dispatch(l_data, FRAMING_TEXT, "dispatch_text")); }
+    if (l_selected("dispatch_binary")) { l_results.push_back(bench_dispatch(l_data, FRAMING_BINARY, "dispatch_binary")); }
+    if (l_selected("send_text")) { l_results.push_back(bench_send(l_data, FRAMING_TEXT, "send_text")); }
+    if (l_selected("send_binary")) { l_results.push_back(bench_send(l_data, FRAMING_BINARY, "send_binary")); }
+    if (l_selected("send_batched")) { l_results.push_back(bench_send(l_data, FRAMING_BINARY, "send_batched", true)); }
+    if (l_selected("send_link")) { l_results.push_back(bench_send(l_data, FRAMING_BINARY, "send_link", false, true)); }
+    if (l_selected("pingpong_socket")) { l_results.push_back(bench_pingpong(false, "pingpong_socket")); }
+    if (l_selected("pingpong_link")) { l_results.push_back(bench_pingpong(true, "pingpong_link")); }
+    if (l_selected("link_mpsc")) { l_results.push_back(bench_link_mpsc(l_data, "link_mpsc")); }
+    if (l_selected("compress")) { l_results.push_back(bench_compress(l_data, false, "compress")); }
+    if (l_selected("decompress")) { l_results.push_back(bench_compress(l_data, true, "decompress")); }
+
+    if (l_json) {
+        print_json(l_results);
+    }
+    else {
+        print_table(l_results);
+    }
+    return 0;
+}
@@ -16,13 +16,129 @@
 // Copyright(C) Goran Josipovic.All rights reserved.
 //******************************************************************************/
 
-#include "Client.hpp"
+#include "Cli.hpp"
+
+#include <fcntl.h>
 
 int main(int argc, char* argv[])
 {
+    reactor_type_enum l_reactor = REACTOR_EPOLL;
+    framing_enum l_framing = FRAMING_TEXT;
+    bool l_interactive = isatty(STDOUT_FILENO);
+    int  l_flush_ms = SINK_FLUSH_MS;
+    bool l_usage = false;
+    string l_endpoint = "localhost";
+    string l_batch;
+    CompressionSettings l_compression;
+    PublishBatching l_batching;
+    SpoolSettings l_spool;
+    ReconnectSettings l_reconnect;
+    DispatchSettings l_dispatch;
+    ConnectTimeouts l_timeouts;
+    OutboundLimits l_limits;
+    const vector<string> l_policies = { "block", "fail", "drop-oldest", "drop-newest" };
+
+    // Optional server for CONNECT <port>, a host or tcp://host[:port], unix:///path.sock or shm:///path.sock: -e <endpoint>
+    // Optional event loop backend: -r select|epoll|uring
+    // Optional framing requested from server: -f text|binary
+    // Optional output mode, prompts only on a terminal by default: -o auto|tty|plain
+    // Optional time received messages may wait before written: -i <ms>
+    // Optional publish behaviour on a congested outbound queue: -q block|fail|drop-oldest|drop-newest
+    // Optional compression of payloads from <bytes> up, binary framing only: -z <bytes>
+    // Optional publish batching, publishes wait up to <us> to share a frame, binary framing only: -l <us>
+    // Optional deadline of the connect and of the handshake: -c <ms>
+    // Optional automatic reconnect with delays up to <ms>: -a <max_ms>
+    // Optional handler workers, received messages are printed in order per topic: -w <workers>
+    // Optional spool directory for publishes made while disconnected or congested: -s <dir>
+    // Optional batch mode, commands read from a file or stdin without prompts: -b <file|->
+    for (int i = 1; i < argc; i += 2) {
+        string l_opt = argv[i];
+        string l_val = i + 1 < argc ? argv[i + 1] : "";
+
+        if (l_opt == "-e" && l_val != "") {
+            l_endpoint = l_val;
+        }
+        else if (l_opt == "-r" && Reactor::parse(l_val) != MAX_REACTORS) {
+            l_reactor = Reactor::parse(l_val);
+        }
+        else if (l_opt == "-f" && (l_val == "text" || l_val == "binary")) {
+            l_framing = l_val == "binary" ? FRAMING_BINARY : FRAMING_TEXT;
+        }
+        else if (l_opt == "-o" && (l_val == "auto" || l_val == "tty" || l_val == "plain")) {
+            l_interactive = l_val == "auto" ? isatty(STDOUT_FILENO) : l_val == "tty";
+        }
+        else if (l_opt == "-i" && l_val != "" && l_val.size() < 6 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_flush_ms = stoi(l_val);
+        }
+        else if (l_opt == "-q" && count(l_policies.begin(), l_policies.end(), l_val)) {
+            l_limits.policy = (overflow_enum)(find(l_policies.begin(), l_policies.end(), l_val) - l_policies.begin());
+        }
+        else if (l_opt == "-z" && l_val != "" && l_val.size() < 9 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_compression.enabled = true;
+            l_compression.threshold = stoul(l_val);
+        }
+        else if (l_opt == "-l" && l_val != "" && l_val.size() < 9 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_batching.linger = chrono::microseconds(stoul(l_val));
+        }
+        else if (l_opt == "-c" && l_val != "" && l_val.size() < 9 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_timeouts.connect = chrono::milliseconds(stoul(l_val));
+            l_timeouts.handshake = l_timeouts.connect;
+        }
+        else if (l_opt == "-a" && l_val != "" && l_val.size() < 9 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_reconnect.enabled = true;
+            l_reconnect.max = chrono::milliseconds(stoul(l_val));
+            l_reconnect.initial = min(l_reconnect.initial, l_reconnect.max);
+        }
+        else if (l_opt == "-w" && l_val != "" && l_val.size() < 4 && l_val.find_first_not_of("0123456789") == string::npos) {
+            l_dispatch.workers = stoul(l_val);
+        }
+        else if (l_opt == "-s" && l_val != "") {
+            l_spool.dir = l_val;
+        }
+        else if (l_opt == "-b" && l_val != "") {
+            l_batch = l_val;
+        }
+        else {
+            l_usage = true;
+        }
+    }
+
+    int l_batch_fd = STDIN_FILENO;
+    if (!l_usage && l_batch != "" && l_batch != "-") {
+        l_batch_fd = open(l_batch.c_str(), O_RDONLY);
+        if (l_batch_fd < 0) {
+            cerr << "Can not open " << l_batch << "\n";
+            return 1;
+        }
+    }
+    if (l_usage) {
+        cout << "usage: " << argv[0] << " [-e endpoint] [-r select|epoll|uring] [-f text|binary] [-o auto|tty|plain] [-i flush_ms]\n"
+            << "       [-q block|fail|drop-oldest|drop-newest] [-z min_bytes] [-l linger_us]\n"
+            << "       [-c connect_ms] [-a max_reconnect_ms] [-w workers] [-s spool_dir] [-b file|-]\n";
+        return 1;
+    }
+
+    Client client(l_endpoint, l_reactor);
+    client.set_framing(l_framing);
+    client.set_outbound_limits(l_limits);
+    client.set_compression(l_compression);
+    client.set_publish_batching(l_batching);
+    client.set_reconnect(l_reconnect);
+    client.set_connect_timeouts(l_timeouts);
+    client.set_dispatch(l_dispatch);
+    if (l_spool.dir != "" && !client.set_spool(l_spool)) {
+        cerr << "Can not use spool directory " << l_spool.dir << "\n";
+        return 1;
+    }
 
-    Client client("localhost");
-    client.command_loop();
+    // Batch mode never prompts
+    Cli cli(client, l_interactive && l_batch == "", chrono::milliseconds(l_flush_ms));
+    if (l_batch != "") {
+        cli.command_batch(l_batch_fd);
+    }
+    else {
+        cli.command_loop();
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+//******************************************************************************#
+//                  ____        __   _____       __   _  __                    #
+//                  / __ \__  __/ /_ / ___/__  __/ /_ | |/ /                    #
+//                 / /_/ / / / / __ \\__ \/ / / / __ \|   /                     #
+//                / ____/ /_/ / /_/ /__/ / /_/ / /_/ /   |                      #
+//               /_/    \__,_/_.___/____/\__,_/_.___/_/|_|                      #
+//                                                                              #
+//******************************************************************************#
+// File    : server_main.cpp
+// Product : PubSubx
+// Brief   : Reference PubSubX broker for local load tests and profiling
+// Ingroup : PubSubx
+// Version : 0.1
+// Updated : February 15 2022
+//
+// Copyright(C) Goran Josipovic.All rights reserved.
+//******************************************************************************/
+
+#include "Server.hpp"
+
+#include <signal.h>
+
+static Server* g_server = nullptr;
+
+static void on_signal(int) {
+    if (g_server) { g_server->stop(); }
+}
+
+int main(int argc, char* argv[])
+{
+    int l_port = SERVER_PORT;
+    int l_threads = max(1u, thread::hardware_concurrency());
+    reactor_type_enum l_reactor = REACTOR_EPOLL;
+    string l_unix_path;
+    bool l_usage = false;
+
+    // Optional port: -p <port>, shard threads: -t <count>, backend: -r select|epoll|uring,
+    // unix socket served besides the port: -u <path>
+    for (int i = 1; i < argc; i += 2) {
+        string l_opt = argv[i];
+        string l_val = i + 1 < argc ? argv[i + 1] : "";
+        bool l_number = !l_val.empty() && l_val.size() <= 5 && l_val.find_first_not_of("0123456789") == string::npos;
+
+        if (l_opt == "-p" && l_number && stoi(l_val) > 0 && stoi(l_val) < 65536) {
+            l_port = stoi(l_val);
+        }
+        else if (l_opt == "-t" && l_number && stoi(l_val) > 0) {
+            l_threads = stoi(l_val);
+        }
+        else if (l_opt == "-r" && Reactor::parse(l_val) != MAX_REACTORS) {
+            l_reactor = Reactor::parse(l_val);
+        }
+        else if (l_opt == "-u" && l_val != "") {
+            l_unix_path = l_val;
+        }
+        else {
+            l_usage = true;
+        }
+    }
+    if (l_usage) {
+        cout << "usage: " << argv[0] << " [-p port] [-t threads] [-r select|epoll|uring] [-u unix_path]\n";
+        return 1;
+    }
+
+    Server server(l_port, l_threads, l_reactor, l_unix_path);
+    g_server = &server;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    return server.run() ? 0 : 1;
+}